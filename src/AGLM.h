@@ -7,10 +7,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/norm.hpp>
 #include <glm/gtc/epsilon.hpp>
+#include <algorithm>
 #include <limits>
 #include <memory>
-#include <random>
 #include <cmath>
+#include "rng.h"
 
 extern std::ostream& operator<<(std::ostream& o, const glm::mat4& m);
 extern std::ostream& operator<<(std::ostream& o, const glm::mat3& m);
@@ -26,54 +27,82 @@ namespace glm
 const float pi = glm::pi<float>();
 const float infinity = std::numeric_limits<float>::infinity();
 
+// the perceived brightness of a linear color (Rec. 709 weights)
+inline float luminance(const glm::color& c)
+{
+   return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+// uniform in [0, 1), drawn from the stream of the calling thread (see rng.h)
 inline float random_float() 
 {
-   static std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
-   static std::mt19937 generator;
-   return distribution(generator); 
+   return thread_rng().next_float();
 }
 
 inline float random_float(float min, float max) 
 {
-   static std::uniform_real_distribution<float> distribution(min, max);
-   static std::mt19937 generator;
-   return distribution(generator);
+   return min + (max - min) * random_float();
+}
+
+// fill out[0] ... out[n-1] with uniforms in [0, 1)
+inline void random_floats(float* out, int n)
+{
+   thread_rng().fill(out, n);
 }
 
 inline glm::vec3 random_unit_cube() 
 {
-   float x = random_float(-1,1);
-   float y = random_float(-1,1);
-   float z = random_float(-1,1);
-   return glm::vec3(x, y, z);
+   float u[3];
+   random_floats(u, 3);
+   return glm::vec3(2.0f * u[0] - 1.0f, 2.0f * u[1] - 1.0f, 2.0f * u[2] - 1.0f);
 }
 
 inline glm::vec3 random_unit_square() 
 {
-   float x = random_float(-1,1);
-   float y = random_float(-1,1);
-   return glm::vec3(x, y, 0);
+   float u[2];
+   random_floats(u, 2);
+   return glm::vec3(2.0f * u[0] - 1.0f, 2.0f * u[1] - 1.0f, 0);
 }
 
+// The helpers below map their uniforms in closed form rather than by rejection, so that they draw
+// a fixed count of numbers and evenly spread uniforms give evenly spread points (see sampler.h).
+
+// a random unit vector: z uniform in [-1, 1], then the angle around z
+inline glm::vec3 random_unit_vector() 
+{
+   float u[2];
+   random_floats(u, 2);
+   float z = 1.0f - 2.0f * u[0];
+   float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+   float phi = 2.0f * pi * u[1];
+   return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
 
+// a point in the unit ball: a direction, and a radius whose cube is uniform
 inline glm::vec3 random_unit_sphere() 
 {
-   glm::vec3 p = random_unit_cube();
-   while (glm::length(p) >= 1.0f) 
-   {
-      p = random_unit_cube();
-   } 
-   return p;
+   glm::vec3 direction = random_unit_vector();
+   return std::cbrt(random_float()) * direction;
 }
 
+// a point in the unit disk on the xy plane, by the concentric map of the square onto the disk
+// (Shirley and Chiu, "A Low Distortion Map Between Disk and Square", 1997)
 inline glm::vec3 random_unit_disk()
 {
-    glm::vec3 p = random_unit_square();
-    while (glm::length(p) >= 1.0f)
-    {
-        p = random_unit_square();
-    }
-    return p;
+   glm::vec3 p = random_unit_square();
+   if (p.x == 0 && p.y == 0) return p;
+   float r, theta;
+   if (std::abs(p.x) > std::abs(p.y))
+   {
+      r = p.x;
+      theta = (pi / 4) * (p.y / p.x);
+   }
+   else
+   {
+      r = p.y;
+      theta = pi / 2 - (pi / 4) * (p.x / p.y);
+   }
+   return glm::vec3(r * std::cos(theta), r * std::sin(theta), 0);
 }
 
 // Generate random direction in hemisphere around normal
@@ -91,11 +120,15 @@ inline glm::vec3 random_hemisphere(const glm::vec3& normal)
    }
 }
 
-// Generate random unit vector
-// from https://raytracing.github.io/books/RayTracingInOneWeekend.html (Peter Shirley)
-inline glm::vec3 random_unit_vector() 
+// two unit vectors t, b that make an orthonormal basis with the unit vector n
+// from Duff et al., "Building an Orthonormal Basis, Revisited", JCGT 2017
+inline void orthonormal_basis(const glm::vec3& n, glm::vec3& t, glm::vec3& b)
 {
-   return glm::normalize(random_unit_sphere());
+   float sign = std::copysign(1.0f, n.z);
+   float a = -1.0f / (sign + n.z);
+   float c = n.x * n.y * a;
+   t = glm::vec3(1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x);
+   b = glm::vec3(c, sign + n.y * n.y * a, -n.y);
 }
 
 // test for vec3 close to zero (avoid numerical instability)
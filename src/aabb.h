@@ -0,0 +1,98 @@
+// aabb.h, from https://raytracing.github.io by Peter Shirley, 2018-2020
+// modified 2021 to support glm/float, t intervals and the surface area heuristic
+
+#ifndef AABB_H
+#define AABB_H
+
+#include "AGLM.h"
+#include "ray.h"
+
+class aabb {
+public:
+   // an empty box; growing it by any point or box gives that point or box
+   aabb() : minimum(infinity), maximum(-infinity) {}
+   aabb(const glm::point3& a, const glm::point3& b) : minimum(a), maximum(b) {}
+
+   glm::point3 min() const { return minimum; }
+   glm::point3 max() const { return maximum; }
+
+   bool empty() const {
+      return maximum[0] < minimum[0] || maximum[1] < minimum[1] || maximum[2] < minimum[2];
+   }
+
+   glm::point3 centroid() const {
+      return 0.5f * (minimum + maximum);
+   }
+
+   glm::vec3 extent() const {
+      return maximum - minimum;
+   }
+
+   float surface_area() const {
+      if (empty()) return 0;
+      glm::vec3 d = extent();
+      return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+   }
+
+   // the axis (0, 1 or 2) along which the box is the longest
+   int longest_axis() const {
+      glm::vec3 d = extent();
+      if (d[0] > d[1] && d[0] > d[2]) return 0;
+      return d[1] > d[2] ? 1 : 2;
+   }
+
+   void grow(const glm::point3& p) {
+      minimum = glm::min(minimum, p);
+      maximum = glm::max(maximum, p);
+   }
+
+   void grow(const aabb& box) {
+      minimum = glm::min(minimum, box.minimum);
+      maximum = glm::max(maximum, box.maximum);
+   }
+
+   // flat primitives (triangles, lines, axis aligned planes) give boxes with no thickness;
+   // give them a tiny one so that the slab test below stays well defined
+   aabb& pad(float delta = 1e-4f) {
+      for (int a = 0; a < 3; a++)
+      {
+         if (maximum[a] - minimum[a] < delta)
+         {
+            minimum[a] -= 0.5f * delta;
+            maximum[a] += 0.5f * delta;
+         }
+      }
+      return *this;
+   }
+
+   // slab test; inv_dir holds 1/r.direction() so that it is computed once per ray
+   inline bool hit(const ray& r, const glm::vec3& inv_dir, float t_min, float t_max) const {
+      for (int a = 0; a < 3; a++)
+      {
+         float t0 = (minimum[a] - r.orig[a]) * inv_dir[a];
+         float t1 = (maximum[a] - r.orig[a]) * inv_dir[a];
+         if (inv_dir[a] < 0.0f) std::swap(t0, t1);
+         // written so that a NaN (0 * inf) keeps the current interval
+         t_min = t0 > t_min ? t0 : t_min;
+         t_max = t1 < t_max ? t1 : t_max;
+         if (t_max < t_min) return false;
+      }
+      return true;
+   }
+
+   bool hit(const ray& r, float t_min, float t_max) const {
+      return hit(r, 1.0f / r.direction(), t_min, t_max);
+   }
+
+public:
+   glm::point3 minimum;
+   glm::point3 maximum;
+};
+
+inline aabb surrounding_box(const aabb& box0, const aabb& box1) {
+   aabb box = box0;
+   box.grow(box1);
+   return box;
+}
+
+#endif
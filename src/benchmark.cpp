@@ -0,0 +1,919 @@
+// benchmark.cpp, measures ray intersection throughput (rays/sec) of the
+// linear hittable_list scan against the bounding volume hierarchy, of closest
+// hit against occlusion queries, of triangle objects against a triangle_mesh,
+// how fast meshes load from .obj and .ply files, how rendering scales
+// with the number of threads, baked copies of a mesh against instances,
+// a planet ring as triangles against a disk, the noise of path tracing
+// with and without light sampling, and with each sampler, and the scalar
+// leaf tests of spheres and mesh triangles against the SSE2 and AVX2 kernels,
+// and camera rays and whole renders traced one by one against traced
+// together as ray streams,
+// and hits shaded in ray order through virtual calls against sorted by material,
+// and objects called through virtual calls against by their class
+// usage: benchmark [width height] [--threads max_threads]
+
+#include "AGLM.h"
+#include "ray.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
+#include "mesh_loader.h"
+#include "camera.h"
+#include "material.h"
+#include "hittable_list.h"
+#include "scenes.h"
+#include "render.h"
+#include "render_settings.h"
+#include "integrator.h"
+#include "sampler.h"
+#include "simd.h"
+#include "sphere_set.h"
+#include "ray_stream.h"
+#include "tile.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+typedef chrono::steady_clock benchmark_clock;
+
+// one jittered camera ray per pixel
+vector<ray> primary_rays(const camera& cam, int width, int height)
+{
+   vector<ray> rays;
+   rays.reserve(width * height);
+   for (int j = 0; j < height; j++)
+   {
+      for (int i = 0; i < width; i++)
+      {
+         float u = float(i + random_float()) / (width - 1);
+         float v = float(height - j - 1 - random_float()) / (height - 1);
+         rays.push_back(cam.get_ray(u, v));
+      }
+   }
+   return rays;
+}
+
+// diffuse bounce rays leaving the first hit of each primary ray
+vector<ray> secondary_rays(const vector<ray>& primary, const hittable_list& world)
+{
+   vector<ray> rays;
+   rays.reserve(primary.size());
+   for (const ray& r : primary)
+   {
+      hit_record rec;
+      if (world.hit(r, 0.001f, infinity, rec))
+      {
+         rays.push_back(ray(rec.p, random_hemisphere(rec.normal)));
+      }
+   }
+   return rays;
+}
+
+struct trace_result
+{
+   double rays_per_sec;
+   int hits;
+   double t_sum; // sum of hit times, to check that both methods agree
+};
+
+trace_result trace(const vector<ray>& rays, const hittable_list& world, size_t max_rays)
+{
+   size_t count = std::min(rays.size(), max_rays);
+   trace_result result = { 0, 0, 0 };
+
+   benchmark_clock::time_point start = benchmark_clock::now();
+   for (size_t i = 0; i < count; i++)
+   {
+      hit_record rec;
+      if (world.hit(rays[i], 0.001f, infinity, rec))
+      {
+         result.hits++;
+         result.t_sum += rec.t;
+      }
+   }
+   double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+   result.rays_per_sec = count / std::max(seconds, 1e-9);
+   return result;
+}
+
+void compare(const string& label, const vector<ray>& rays, hittable_list& world, size_t max_list_rays)
+{
+   world.clear_bvh();
+   trace_result list = trace(rays, world, max_list_rays);
+
+   world.build_bvh();
+   trace_result accel = trace(rays, world, rays.size());
+
+   // both methods must find the same hits on the rays traced by the list
+   trace_result accel_prefix = max_list_rays < rays.size() ? trace(rays, world, max_list_rays) : accel;
+   bool agree = accel_prefix.hits == list.hits;
+
+   printf("%-32s %10zu rays  list %12.0f rays/s  bvh %12.0f rays/s  speedup %8.1fx  %s\n",
+      label.c_str(), rays.size(), list.rays_per_sec, accel.rays_per_sec,
+      accel.rays_per_sec / list.rays_per_sec, agree ? "" : "(hit counts differ!)");
+}
+
+// closest hit queries against occlusion (any hit) queries, on the bvh
+void compare_occlusion(const string& label, const vector<ray>& rays, hittable_list& world)
+{
+   world.build_bvh();
+   trace_result closest = trace(rays, world, rays.size());
+
+   int blocked = 0;
+   benchmark_clock::time_point start = benchmark_clock::now();
+   for (const ray& r : rays)
+   {
+      if (world.occluded(r, 0.001f, infinity)) blocked++;
+   }
+   double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+   double occluded_per_sec = rays.size() / std::max(seconds, 1e-9);
+
+   printf("%-32s %10zu rays  hit  %12.0f rays/s  occluded %8.0f rays/s  speedup %8.1fx  %s\n",
+      label.c_str(), rays.size(), closest.rays_per_sec, occluded_per_sec,
+      occluded_per_sec / closest.rays_per_sec, blocked == closest.hits ? "" : "(hit counts differ!)");
+}
+
+// hittable_list::hit() through virtual calls on every object, as it was before the objects were
+// stored by class (see typed_objects.h), against hittable_list::hit()
+void compare_dispatch(const string& label, const vector<ray>& rays, hittable_list& world)
+{
+   world.build_bvh();
+   trace_result virtual_calls = { 0, 0, 0 };
+   benchmark_clock::time_point start = benchmark_clock::now();
+   for (const ray& r : rays)
+   {
+      hit_record rec, temp_rec;
+      const hittable* closest = 0;
+      float closest_so_far = infinity;
+      auto leaf = [&](int offset, int count, float leaf_min_t, float& leaf_max_t) -> bool
+      {
+         bool hit_leaf = false;
+         for (int i = offset; i < offset + count; i++)
+         {
+            if (world.bounded[i]->intersect(r, leaf_min_t, leaf_max_t, temp_rec))
+            {
+               hit_leaf = true;
+               leaf_max_t = temp_rec.t;
+               rec = temp_rec;
+               closest = world.bounded[i].get();
+            }
+         }
+         return hit_leaf;
+      };
+      if (world.accel.traverse(r, 0.001f, closest_so_far, leaf)) closest_so_far = rec.t;
+      for (const auto& object : world.unbounded)
+      {
+         if (object->intersect(r, 0.001f, closest_so_far, temp_rec))
+         {
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+            closest = object.get();
+         }
+      }
+      if (!closest) continue;
+      closest->complete_hit(r, rec);
+      virtual_calls.hits++;
+      virtual_calls.t_sum += rec.t;
+   }
+   double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+   virtual_calls.rays_per_sec = rays.size() / std::max(seconds, 1e-9);
+
+   trace_result typed = trace(rays, world, rays.size());
+
+   printf("%-32s %10zu rays  virtual %9.0f rays/s  typed %12.0f rays/s  speedup %6.2fx  %s\n",
+      label.c_str(), rays.size(), virtual_calls.rays_per_sec, typed.rays_per_sec,
+      typed.rays_per_sec / virtual_calls.rays_per_sec,
+      typed.hits == virtual_calls.hits && typed.t_sum == virtual_calls.t_sum ? "" : "(hits differ!)");
+}
+
+// bvh over triangle objects against one triangle_mesh, in rays/sec and bytes per triangle
+void compare_mesh(const string& label, const vector<ray>& rays, hittable_list& triangles,
+   hittable_list& meshes, const triangle_mesh& mesh)
+{
+   triangles.build_bvh();
+   meshes.build_bvh();
+   trace_result objects = trace(rays, triangles, rays.size());
+   trace_result indexed = trace(rays, meshes, rays.size());
+   bool agree = objects.hits == indexed.hits;
+
+   // a triangle object is the triangle, the control block of make_shared, a pointer in
+   // objects and one in bounded, and its share of the bvh nodes
+   size_t n = triangles.objects.size();
+   double object_bytes = sizeof(triangle) + 2 * sizeof(long) +
+      2 * sizeof(shared_ptr<hittable>) + triangles.accel.nodes.size() * sizeof(bvh_node) / double(n);
+   double mesh_bytes = mesh.memory_bytes() / double(mesh.num_triangles());
+
+   printf("%-32s %10zu rays  tris %12.0f rays/s  mesh %12.0f rays/s  speedup %8.1fx  %s\n",
+      label.c_str(), rays.size(), objects.rays_per_sec, indexed.rays_per_sec,
+      indexed.rays_per_sec / objects.rays_per_sec, agree ? "" : "(hit counts differ!)");
+   printf("%-32s %10.1f bytes/triangle as objects  %10.1f as a mesh\n", label.c_str(), object_bytes, mesh_bytes);
+}
+
+// a belt of n planets whose rings are baked into a mesh each, against the same belt with every
+// ring an instance of one shared mesh, in rays/sec and bytes of ring geometry
+void compare_instances(const string& label, int n, int width, int height)
+{
+   hittable_list baked, instanced;
+   shared_ptr<triangle_mesh> ring = unit_circle(0);
+   size_t baked_bytes = 0;
+   for (int i = 0; i < n; i++)
+   {
+      point3 c(60.0f * random_float() - 30.0f, 8.0f * random_float() - 4.0f, -20.0f - 60.0f * random_float());
+      float r = 0.2f + 0.4f * random_float();
+      vec3 a = float(M_PI) * random_unit_cube();
+      shared_ptr<triangle_mesh> mesh = make_shared<triangle_mesh>(0);
+      circle(c, 1.5f * r, a, *mesh);
+      mesh->build();
+      baked.add(make_shared<sphere>(c, r, 0));
+      baked.add(mesh);
+      planet(c, r, 0.5f * r, 0, 0, a, ring, instanced);
+      baked_bytes += sizeof(triangle_mesh) + mesh->memory_bytes();
+   }
+   size_t instanced_bytes = sizeof(triangle_mesh) + ring->memory_bytes() + n * sizeof(instance);
+
+   camera cam(point3(0, 2, 0), point3(0, 0, -50), vec3(0, 1, 0), 60, width / float(height), 0, 1);
+   vector<ray> primary = primary_rays(cam, width, height);
+   baked.build_bvh();
+   instanced.build_bvh();
+   trace_result a = trace(primary, baked, primary.size());
+   trace_result b = trace(primary, instanced, primary.size());
+
+   printf("%-32s %10zu rays  baked %11.0f rays/s  instanced %7.0f rays/s  speedup %8.2fx  %s\n",
+      label.c_str(), primary.size(), a.rays_per_sec, b.rays_per_sec, b.rays_per_sec / a.rays_per_sec,
+      std::abs(a.hits - b.hits) <= a.hits / 1000 ? "" : "(hit counts differ!)");
+   printf("%-32s %10zu bytes of rings baked  %10zu instanced\n", label.c_str(), baked_bytes, instanced_bytes);
+}
+
+// the ring of the Space Station planet as ten triangle objects, as a triangle_mesh and as a disk,
+// in rays/sec, on rays from the camera at its bounding box
+void compare_ring(const string& label, int width, int height)
+{
+   point3 c(0, 0, -120);
+   vec3 a(-0.45f * M_PI, 0, 0.1f * M_PI);
+   hittable_list triangles, meshes, disks;
+   circle(c, 40.0f, 0, a, triangles);
+   shared_ptr<triangle_mesh> mesh = make_shared<triangle_mesh>(0);
+   circle(c, 40.0f, a, *mesh);
+   mesh->build();
+   meshes.add(mesh);
+   disks.add(make_shared<disk>(c, glm::toMat3(glm::quat(a)) * vec3(0, 0, 1), 0.0f, 40.0f, 0));
+
+   // aim the rays at the ring's box, so that every ray pays for the ring
+   aabb box;
+   disks.objects[0]->bounding_box(box);
+   vector<ray> rays;
+   for (int i = 0; i < width * height; i++)
+   {
+      point3 target = box.minimum + box.extent() * (0.5f * random_unit_cube() + vec3(0.5f));
+      rays.push_back(ray(point3(0), target));
+   }
+   triangles.build_bvh();
+   meshes.build_bvh();
+   disks.build_bvh();
+   trace_result t = trace(rays, triangles, rays.size());
+   trace_result m = trace(rays, meshes, rays.size());
+   trace_result d = trace(rays, disks, rays.size());
+
+   printf("%-32s %10zu rays  tris %12.0f rays/s  mesh %12.0f rays/s  disk %12.0f rays/s  speedup %6.1fx / %.1fx\n",
+      label.c_str(), rays.size(), t.rays_per_sec, m.rays_per_sec, d.rays_per_sec,
+      d.rays_per_sec / t.rays_per_sec, d.rays_per_sec / m.rays_per_sec);
+   // the tests alone, without the bvh and the list: ten triangles against one disk
+   auto time_tests = [&](const hittable_list& list)
+   {
+      benchmark_clock::time_point start = benchmark_clock::now();
+      int hits = 0;
+      for (const ray& r : rays)
+      {
+         hit_record rec;
+         for (const auto& object : list.objects) hits += object->intersect(r, 0.001f, infinity, rec);
+      }
+      double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+      return hits >= 0 ? 1e9 * seconds / rays.size() : 0.0;
+   };
+   double triangle_ns = time_tests(triangles);
+   double disk_ns = time_tests(disks);
+   printf("%-32s %10zu rays  tris %9.1f ns/ray  disk %9.1f ns/ray  speedup %6.1fx\n", label.c_str(), rays.size(),
+      triangle_ns, disk_ns, triangle_ns / disk_ns);
+
+   // the disk is round where the ten triangles cut its rim
+   printf("%-32s %10d hits as triangles %10d as a mesh %10d as a disk\n", label.c_str(), t.hits, m.hits, d.hits);
+}
+
+// rays/sec of a world built by build() with each kernel of simd.h the CPU runs, against the
+// scalar one; build() runs again for each, since the kernels set the leaf size of the bvh
+void compare_kernels(const string& label, const vector<ray>& rays, const function<void(hittable_list&)>& build)
+{
+   simd_level detected = detected_simd_level();
+   trace_result scalar = { 0, 0, 0 };
+   for (int level = simd_scalar; level <= detected; level++)
+   {
+      active_simd_level() = (simd_level) level;
+      hittable_list world;
+      build(world);
+      world.build_bvh();
+      trace_result result = trace(rays, world, rays.size());
+      if (level == simd_scalar) scalar = result;
+      printf("%-32s %10zu rays  %-6s %12.0f rays/s  speedup %6.2fx  %s\n", label.c_str(), rays.size(),
+         active_kernels().name, result.rays_per_sec, result.rays_per_sec / scalar.rays_per_sec,
+         result.hits == scalar.hits ? "" : "(hit counts differ!)");
+   }
+   active_simd_level() = detected;
+}
+
+// primitive tests per second of each kernel on leaves of 8, without the bvh around them: rays
+// through a dense cluster of n spheres and of n triangles, each ray against every leaf
+void compare_leaf_tests(const string& label, int n, int num_rays)
+{
+   soa_array spheres, tris;
+   spheres.resize(n, sphere_components);
+   tris.resize(n, triangle_components);
+   for (int i = 0; i < n; i++)
+   {
+      point3 c = random_unit_cube();
+      vec3 e1 = 0.3f * random_unit_sphere(), e2 = 0.3f * random_unit_sphere();
+      float radius = random_float(0.05f, 0.3f);
+      spheres[sphere_r2][i] = radius * radius;
+      for (int axis = 0; axis < 3; axis++)
+      {
+         spheres[sphere_cx + axis][i] = c[axis];
+         tris[triangle_v0x + axis][i] = c[axis];
+         tris[triangle_e1x + axis][i] = e1[axis];
+         tris[triangle_e2x + axis][i] = e2[axis];
+      }
+   }
+   vector<kernel_ray> rays;
+   for (int i = 0; i < num_rays; i++)
+   {
+      point3 origin = 4.0f * random_unit_vector();
+      rays.push_back(kernel_ray(ray(origin, 0.5f * random_unit_cube() - origin)));
+   }
+
+   // one pass of every ray over every leaf; returns primitive tests per second
+   auto time_kernel = [&](leaf_kernel kernel, const soa_array& prims, int& hits)
+   {
+      benchmark_clock::time_point start = benchmark_clock::now();
+      hits = 0;
+      for (const kernel_ray& r : rays)
+      {
+         for (int first = 0; first + 8 <= n; first += 8)
+         {
+            float t_max = infinity;
+            hits += kernel(prims, first, 8, r, 0.001f, t_max) >= 0;
+         }
+      }
+      double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+      return double(rays.size()) * (n / 8 * 8) / std::max(seconds, 1e-9);
+   };
+
+   int scalar_sphere_hits = 0, scalar_triangle_hits = 0;
+   double scalar_spheres = time_kernel(kernels(simd_scalar).nearest_sphere, spheres, scalar_sphere_hits);
+   double scalar_triangles = time_kernel(kernels(simd_scalar).nearest_triangle, tris, scalar_triangle_hits);
+   for (int level = simd_scalar; level <= detected_simd_level(); level++)
+   {
+      const simd_kernels& k = kernels((simd_level) level);
+      int sphere_hits = scalar_sphere_hits, triangle_hits = scalar_triangle_hits;
+      double sphere_rate = level == simd_scalar ? scalar_spheres : time_kernel(k.nearest_sphere, spheres, sphere_hits);
+      double triangle_rate = level == simd_scalar ? scalar_triangles : time_kernel(k.nearest_triangle, tris, triangle_hits);
+      printf("%-32s %-6s spheres %12.0f tests/s %6.2fx  triangles %12.0f tests/s %6.2fx  %s\n", label.c_str(), k.name,
+         sphere_rate, sphere_rate / scalar_spheres, triangle_rate, triangle_rate / scalar_triangles,
+         sphere_hits == scalar_sphere_hits && triangle_hits == scalar_triangle_hits ? "" : "(hit counts differ!)");
+   }
+}
+
+// camera rays traced one by one with hittable_list::hit() against traced a tile at a time with
+// hit_stream(), both on the bvh; the rays come tile by tile, as render() hands them out
+void compare_stream(const string& label, const camera& cam, hittable_list& world, int width, int height)
+{
+   world.build_bvh();
+   vector<ray> primary = primary_rays(cam, width, height);
+   vector<tile> tiles = make_tiles(width, height, global_render_settings().tile_size);
+   vector<ray> rays;
+   rays.reserve(primary.size());
+   vector<size_t> tile_ends;
+   for (const tile& t : tiles)
+   {
+      for (int j = t.y0; j < t.y1; j++)
+      {
+         for (int i = t.x0; i < t.x1; i++) rays.push_back(primary[(size_t) j * width + i]);
+      }
+      tile_ends.push_back(rays.size());
+   }
+
+   trace_result single = trace(rays, world, rays.size());
+
+   trace_result streamed = { 0, 0, 0 };
+   ray_stream stream;
+   benchmark_clock::time_point start = benchmark_clock::now();
+   size_t begin = 0;
+   for (size_t end : tile_ends)
+   {
+      stream.resize((int) (end - begin));
+      for (size_t k = begin; k < end; k++) stream.set((int) (k - begin), rays[k], 0.001f, infinity);
+      hit_stream(world, stream);
+      for (int k = 0; k < stream.size(); k++)
+      {
+         if (!stream.hit(k)) continue;
+         streamed.hits++;
+         streamed.t_sum += stream.hits[k].t;
+      }
+      begin = end;
+   }
+   double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+   streamed.rays_per_sec = rays.size() / std::max(seconds, 1e-9);
+
+   printf("%-32s %10zu rays  single %12.0f rays/s  stream %12.0f rays/s  speedup %6.2fx  %s\n",
+      label.c_str(), rays.size(), single.rays_per_sec, streamed.rays_per_sec,
+      streamed.rays_per_sec / single.rays_per_sec,
+      streamed.hits == single.hits && streamed.t_sum == single.t_sum ? "" : "(hits differ!)");
+}
+
+// an asteroid field of n spheres as sphere objects, then as a sphere_set with each kernel
+void compare_asteroids(const string& label, int n, int width, int height)
+{
+   shared_ptr<sphere_set> field = asteroid_field(n, point3(-40, -10, -120), point3(40, 10, -20), 0.1f, 0.6f, 0);
+   hittable_list objects;
+   for (int i = 0; i < field->size(); i++)
+   {
+      objects.add(make_shared<sphere>(field->centers[i], field->radii[i], 0));
+   }
+   objects.build_bvh();
+
+   camera cam(point3(0, 2, 0), point3(0, 0, -70), vec3(0, 1, 0), 60, width / float(height), 0, 1);
+   vector<ray> primary = primary_rays(cam, width, height);
+   trace_result a = trace(primary, objects, primary.size());
+   printf("%-32s %10zu rays  %-6s %12.0f rays/s\n", label.c_str(), primary.size(), "objects", a.rays_per_sec);
+   compare_dispatch(label + " (dispatch)", primary, objects);
+   compare_stream(label + " (stream)", cam, objects, width, height);
+   compare_kernels(label, primary, [&](hittable_list& world)
+   {
+      shared_ptr<sphere_set> set = make_shared<sphere_set>();
+      for (int i = 0; i < field->size(); i++) set->add(field->centers[i], field->radii[i], 0);
+      set->build();
+      world.add(set);
+   });
+   // as in compare_mesh(), an object is the sphere, its control block, two pointers and its share of the bvh
+   double object_bytes = sizeof(sphere) + 2 * sizeof(long) + 2 * sizeof(shared_ptr<hittable>) +
+      objects.accel.nodes.size() * sizeof(bvh_node) / double(n);
+   printf("%-32s %10.1f bytes/sphere as objects  %10.1f in a set\n", label.c_str(), object_bytes,
+      field->memory_bytes() / double(n));
+}
+
+// the sky of materials.cpp
+color sky_background(const ray& r)
+{
+   vec3 unit_direction = normalize(r.direction());
+   float t = 0.5f * (unit_direction.y + 1.0f);
+   return (1.0f - t) * color(1, 1, 1) + t * color(0.5f, 0.7f, 1.0f);
+}
+
+color black_background(const ray& r)
+{
+   return color(0);
+}
+
+// the mean radiance of every pixel over samples paths, each seeded by its pixel, its number and
+// seed, with the numbers of the sampler s if given
+vector<color> render_radiance(const path_tracer& tracer, const camera& cam, int width, int height,
+   int samples, uint32_t seed, const sampler* s = 0)
+{
+   vector<color> pixels(width * height, color(0));
+   for (int j = 0; j < height; j++)
+   {
+      for (int i = 0; i < width; i++)
+      {
+         for (int k = 0; k < samples; k++)
+         {
+            thread_rng().seed(j * width + i, k, seed, s);
+            float u = float(i + random_float()) / (width - 1);
+            float v = float(height - j - 1 - random_float()) / (height - 1);
+            pixels[j * width + i] += tracer.trace(cam.get_ray(u, v)) / float(samples);
+         }
+      }
+   }
+   // s may be gone before the next numbers are drawn
+   thread_rng().release_source();
+   return pixels;
+}
+
+// the root mean square difference of two images in the displayed range [0, 1]
+double display_rmse(const vector<color>& a, const vector<color>& b)
+{
+   double sum = 0;
+   for (size_t p = 0; p < a.size(); p++)
+   {
+      vec3 d = clamp(a[p], 0.0f, 1.0f) - clamp(b[p], 0.0f, 1.0f);
+      sum += dot(d, d) / 3;
+   }
+   return sqrt(sum / a.size());
+}
+
+// the lamp room at a few samples per pixel, with light sampling and with scattered rays alone:
+// the error of each against a render with many samples, in the displayed range [0, 1], and the
+// time per sample
+void compare_light_sampling(const string& label, int width, int height, int samples)
+{
+   hittable_list world;
+   lamp_room(world);
+   world.build_bvh();
+   camera cam = lamp_room_camera(width / float(height));
+   path_tracer tracer(world, black_background);
+   vector<color> reference = render_radiance(tracer, cam, width, height, 64 * samples, 1);
+
+   auto error = [&](bool sample_lights, double& ns)
+   {
+      tracer.sample_lights = sample_lights;
+      benchmark_clock::time_point start = benchmark_clock::now();
+      vector<color> pixels = render_radiance(tracer, cam, width, height, samples, 2);
+      double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+      ns = 1e9 * seconds / (pixels.size() * samples);
+      return display_rmse(pixels, reference);
+   };
+   double sampled_ns, scattered_ns;
+   double sampled = error(true, sampled_ns);
+   double scattered = error(false, scattered_ns);
+   printf("%-32s %4d spp  scattered rays RMSE %8.4f (%6.0f ns/path)  light sampling RMSE %8.4f (%6.0f ns/path)"
+      "  %6.1fx lower\n", label.c_str(), samples, scattered, scattered_ns, sampled, sampled_ns, scattered / sampled);
+}
+
+// scatter() over the hits of n random rays in the world, in the order of the rays through the
+// virtual call, against binned by material kind (a counting sort) and scattered by a loop per
+// kind that calls the final class; each hit draws from its own random stream, so both scatter
+// the same rays
+template <class M>
+int scatter_batch(const hittable_list& world, const vector<ray>& rays, const vector<hit_record>& hits,
+   const int* first, const int* last, glm::vec3& sum)
+{
+   int scattered_count = 0;
+   for (const int* k = first; k != last; k++)
+   {
+      const hit_record& rec = hits[*k];
+      const M& m = static_cast<const M&>(world.materials[rec.mat_id]);
+      thread_rng().seed(*k, 0);
+      color attenuation;
+      ray scattered;
+      if (m.scatter(rays[*k], rec, world, attenuation, scattered)) scattered_count++;
+      sum += scattered.direction() + attenuation;
+   }
+   return scattered_count;
+}
+
+void compare_shading(const string& label, const hittable_list& world, const camera& cam, int width, int height)
+{
+   // first hits of camera rays, and the hits of the bounces that follow, shuffled together
+   vector<ray> rays;
+   vector<hit_record> hits;
+   vector<ray> primary = primary_rays(cam, width, height);
+   for (const ray& r : primary)
+   {
+      hit_record rec;
+      if (!world.hit(r, 0.001f, infinity, rec)) continue;
+      rays.push_back(r);
+      hits.push_back(rec);
+      ray bounce(rec.p, random_hemisphere(rec.normal));
+      if (!world.hit(bounce, 0.001f, infinity, rec)) continue;
+      rays.push_back(bounce);
+      hits.push_back(rec);
+   }
+   int n = (int) hits.size();
+   vector<material_kind> kinds;
+   for (int m = 0; m < world.materials.size(); m++) kinds.push_back(world.materials[m].kind());
+
+   const int repeats = 5;
+   glm::vec3 virtual_sum(0), sorted_sum(0);
+   int virtual_count = 0, sorted_count = 0;
+   benchmark_clock::time_point start = benchmark_clock::now();
+   for (int repeat = 0; repeat < repeats; repeat++)
+   {
+      for (int k = 0; k < n; k++)
+      {
+         const material& m = world.materials[hits[k].mat_id];
+         thread_rng().seed(k, 0);
+         color attenuation;
+         ray scattered;
+         if (m.scatter(rays[k], hits[k], world, attenuation, scattered)) virtual_count++;
+         virtual_sum += scattered.direction() + attenuation;
+      }
+   }
+   double virtual_seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+
+   // binned a tile of 256 hits at a time, as trace_stream() does
+   const int batch = 256;
+   vector<int> order(batch);
+   start = benchmark_clock::now();
+   for (int repeat = 0; repeat < repeats; repeat++)
+   {
+      for (int begin = 0; begin < n; begin += batch)
+      {
+         int end = std::min(n, begin + batch);
+         int starts[material_kinds + 1] = {0};
+         for (int k = begin; k < end; k++) starts[kinds[hits[k].mat_id] + 1]++;
+         for (int kind = 0; kind < material_kinds; kind++) starts[kind + 1] += starts[kind];
+         int next[material_kinds];
+         std::copy(starts, starts + material_kinds, next);
+         for (int k = begin; k < end; k++) order[next[kinds[hits[k].mat_id]]++] = k;
+
+         const int* bins = order.data();
+         sorted_count += scatter_batch<material>(world, rays, hits, bins + starts[material_other],
+            bins + starts[material_other + 1], sorted_sum);
+         sorted_count += scatter_batch<lambertian>(world, rays, hits, bins + starts[material_lambertian],
+            bins + starts[material_lambertian + 1], sorted_sum);
+         sorted_count += scatter_batch<diffuse_light>(world, rays, hits, bins + starts[material_light],
+            bins + starts[material_light + 1], sorted_sum);
+         sorted_count += scatter_batch<phong>(world, rays, hits, bins + starts[material_phong],
+            bins + starts[material_phong + 1], sorted_sum);
+         sorted_count += scatter_batch<metal>(world, rays, hits, bins + starts[material_metal],
+            bins + starts[material_metal + 1], sorted_sum);
+         sorted_count += scatter_batch<dielectric>(world, rays, hits, bins + starts[material_dielectric],
+            bins + starts[material_dielectric + 1], sorted_sum);
+      }
+   }
+   double sorted_seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+
+   double virtual_rate = double(n) * repeats / std::max(virtual_seconds, 1e-9);
+   double sorted_rate = double(n) * repeats / std::max(sorted_seconds, 1e-9);
+   // the sums add the same values in another order, so they only agree closely
+   bool agree = virtual_count == sorted_count && length(virtual_sum - sorted_sum) <= 1e-3f * length(virtual_sum);
+   printf("%-32s %10d hits  virtual %12.0f hits/s  sorted %12.0f hits/s  speedup %6.2fx  %s\n", label.c_str(), n,
+      virtual_rate, sorted_rate, sorted_rate / virtual_rate, agree ? "" : "(scattered rays differ!)");
+}
+
+// the error of each sampler at 4, 16 and 64 samples per pixel against a render with many samples,
+// in the displayed range, and the samples per pixel independent numbers need for the error of
+// each sampler at 16 (the error falls with the square root of the samples)
+void compare_samplers(const string& label, const hittable_list& world, const camera& cam,
+   background_fn background, int width, int height)
+{
+   path_tracer tracer(world, background);
+   vector<color> reference = render_radiance(tracer, cam, width, height, 1024, 1);
+   double independent16 = 0;
+   for (int id = 0; id < 4; id++)
+   {
+      unique_ptr<sampler> s;
+      printf("%-32s %-12s", label.c_str(), sampler_names[id]);
+      double error16 = 0;
+      for (int samples = 4; samples <= 64; samples *= 4)
+      {
+         s = make_sampler(id, 2, width, samples);
+         double error = display_rmse(render_radiance(tracer, cam, width, height, samples, 2, s.get()), reference);
+         if (samples == 16) error16 = error;
+         printf("  %2d spp RMSE %8.4f", samples, error);
+      }
+      if (id == 0) independent16 = error16;
+      printf("  as good as %5.1f independent spp\n", 16 * (independent16 / error16) * (independent16 / error16));
+   }
+}
+
+// write a mesh as a Wavefront .obj file
+void write_obj(const string& filename, const triangle_mesh& mesh)
+{
+   FILE* file = fopen(filename.c_str(), "w");
+   for (const point3& v : mesh.vertices)
+   {
+      fprintf(file, "v %.6f %.6f %.6f\n", v.x, v.y, v.z);
+   }
+   for (size_t i = 0; i < mesh.indices.size(); i += 3)
+   {
+      fprintf(file, "f %d %d %d\n", mesh.indices[i] + 1, mesh.indices[i + 1] + 1, mesh.indices[i + 2] + 1);
+   }
+   fclose(file);
+}
+
+// write a mesh as a binary .ply file in the byte order of this machine
+void write_ply(const string& filename, const triangle_mesh& mesh)
+{
+   uint16_t one = 1;
+   bool little_endian = *(const unsigned char*) &one == 1;
+   FILE* file = fopen(filename.c_str(), "wb");
+   fprintf(file, "ply\nformat %s 1.0\nelement vertex %zu\nproperty float x\nproperty float y\nproperty float z\n"
+      "element face %d\nproperty list uchar int vertex_indices\nend_header\n",
+      little_endian ? "binary_little_endian" : "binary_big_endian", mesh.vertices.size(), mesh.num_triangles());
+   fwrite(&mesh.vertices[0], sizeof(point3), mesh.vertices.size(), file);
+   for (size_t i = 0; i < mesh.indices.size(); i += 3)
+   {
+      unsigned char corners = 3;
+      fwrite(&corners, 1, 1, file);
+      fwrite(&mesh.indices[i], sizeof(int), 3, file);
+   }
+   fclose(file);
+}
+
+// time loading a mesh file, in triangles/sec and megabytes/sec
+void load_time(const string& label, const string& filename, int num_threads)
+{
+   FILE* file = fopen(filename.c_str(), "rb");
+   fseek(file, 0, SEEK_END);
+   double megabytes = ftell(file) / (1024.0 * 1024.0);
+   fclose(file);
+
+   triangle_mesh mesh;
+   benchmark_clock::time_point start = benchmark_clock::now();
+   bool loaded = load_mesh(filename, mesh, num_threads);
+   double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+
+   printf("%-32s %3d threads  %8.3f s  %12.0f tris/s  %8.1f MB/s  %s\n", label.c_str(), num_threads,
+      seconds, mesh.num_triangles() / seconds, megabytes / seconds, loaded ? "" : "(failed!)");
+}
+
+// the background of the Space Station scene, as in basic.cpp
+color space_background(const ray& r)
+{
+   return color(1.0f/255.0f, 5.0f/255.0f, 14.0f/255.0f);
+}
+
+// render the scene with 1, 2, 4, ... threads and report the speedup over one thread
+void thread_scaling(const string& label, const hittable_list& world, const camera& cam,
+   int width, int height, int max_threads)
+{
+   agl::ppm_image image(width, height);
+   path_tracer tracer(world, space_background);
+   render_settings& settings = global_render_settings();
+   double single = 0;
+   for (int n = 1; n <= max_threads; n *= 2)
+   {
+      settings.num_threads = n;
+      benchmark_clock::time_point start = benchmark_clock::now();
+      render(image, cam, 10, [&](const ray& r) { return tracer.trace(r); });
+      double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+      if (n == 1) single = seconds;
+      printf("%-32s %3d threads  %8.3f s  speedup %6.2fx\n", label.c_str(), n, seconds, single / seconds);
+   }
+}
+
+// whole renders on one thread with each path traced alone against the paths of a tile traced
+// together a bounce at a time (--stream on), the best of a few runs each, taken in turns
+void compare_stream_render(const string& label, const hittable_list& world, const camera& cam,
+   background_fn background, int width, int height)
+{
+   agl::ppm_image image(width, height);
+   path_tracer tracer(world, background);
+   render_settings& settings = global_render_settings();
+   int threads = settings.num_threads;
+   bool streaming = settings.streaming;
+   settings.num_threads = 1;
+   double best[2] = { 1e30, 1e30 };
+   hdr_image renders[2];
+   for (int run = 0; run < 6; run++)
+   {
+      settings.streaming = run % 2 != 0;
+      benchmark_clock::time_point start = benchmark_clock::now();
+      render(image, cam, 10, [&](const ray& r) { return tracer.trace(r); },
+         [&](vector<stream_sample>& samples) { tracer.trace_stream(samples); });
+      double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+      best[run % 2] = std::min(best[run % 2], seconds);
+      renders[run % 2] = global_hdr_image();
+   }
+   settings.num_threads = threads;
+   settings.streaming = streaming;
+
+   bool same = true;
+   for (int j = 0; j < height; j++)
+   {
+      for (int i = 0; i < width; i++) same = same && renders[0].sum(j, i) == renders[1].sum(j, i);
+   }
+   printf("%-32s single %8.3f s  stream %8.3f s  speedup %6.2fx  %s\n", label.c_str(), best[0], best[1],
+      best[0] / best[1], same ? "" : "(images differ!)");
+}
+
+// a wavy height field made of 2 * n * n triangles, seen from the default camera.
+// The triangles are added one by one, or as a single mesh when mesh is not null.
+void height_field(int n, hittable_list& world, shared_ptr<triangle_mesh> mesh = 0)
+{
+   material_id gray = world.materials.add(make_shared<lambertian>(color(0.5f)));
+   float size = 40.0f;
+   auto height = [=](int i, int j) {
+      float x = i / float(n), z = j / float(n);
+      return -4.0f + 1.5f * sin(12.0f * x) * cos(9.0f * z) + 0.3f * sin(60.0f * x * z);
+   };
+   auto vertex = [=](int i, int j) {
+      return point3(-0.5f * size + size * i / n, height(i, j), -2.0f - size * j / n);
+   };
+
+   if (mesh)
+   {
+      mesh->mat_id = gray;
+      for (int j = 0; j <= n; j++)
+      {
+         for (int i = 0; i <= n; i++)
+         {
+            mesh->add_vertex(vertex(i, j));
+         }
+      }
+      auto index = [=](int i, int j) { return j * (n + 1) + i; };
+      for (int j = 0; j < n; j++)
+      {
+         for (int i = 0; i < n; i++)
+         {
+            mesh->add_triangle(index(i, j), index(i + 1, j), index(i + 1, j + 1));
+            mesh->add_triangle(index(i, j), index(i + 1, j + 1), index(i, j + 1));
+         }
+      }
+      mesh->build();
+      world.add(mesh);
+      return;
+   }
+
+   for (int j = 0; j < n; j++)
+   {
+      for (int i = 0; i < n; i++)
+      {
+         world.add(make_shared<triangle>(vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1), gray));
+         world.add(make_shared<triangle>(vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1), gray));
+      }
+   }
+}
+
+int main(int argc, char** argv)
+{
+   bool sized = argc > 2 && argv[1][0] != '-';
+   int width = sized ? atoi(argv[1]) : 320;
+   int height = sized ? atoi(argv[2]) : 240;
+   parse_render_settings(argc, argv);
+   int max_threads = global_render_settings().num_threads > 0 ?
+      global_render_settings().num_threads : thread_pool::default_size();
+   float aspect = width / float(height);
+
+   // the Space Station scene from basic.cpp
+   {
+      hittable_list world;
+      space_station(world, point3(0));
+      camera cam = space_station_camera(aspect);
+
+      vector<ray> primary = primary_rays(cam, width, height);
+      compare("space station (primary)", primary, world, primary.size());
+
+      vector<ray> secondary = secondary_rays(primary, world);
+      compare("space station (secondary)", secondary, world, secondary.size());
+      compare_occlusion("space station (occlusion)", secondary, world);
+      compare_dispatch("space station (primary)", primary, world);
+      compare_dispatch("space station (secondary)", secondary, world);
+
+      thread_scaling("space station (render)", world, cam, width, height, max_threads);
+      compare_stream("space station (stream)", cam, world, width, height);
+      compare_stream_render("space station (stream render)", world, cam, space_background, width, height);
+   }
+
+   // about 100k triangles
+   {
+      hittable_list world;
+      height_field(224, world);
+      camera cam(point3(0, 4, 4), point3(0, -4, -20), vec3(0, 1, 0), 60, aspect, 0, 1);
+
+      // the linear scan costs 100k tests per ray, so only time it on a few rays
+      vector<ray> primary = primary_rays(cam, width, height);
+      compare("height field 100k tris (primary)", primary, world, 2000);
+
+      vector<ray> secondary = secondary_rays(primary, world);
+      compare("height field 100k tris (secondary)", secondary, world, 2000);
+      compare_occlusion("height field 100k tris (occlusion)", secondary, world);
+      compare_dispatch("height field 100k tris (secondary)", secondary, world);
+      compare_stream("height field 100k tris (stream)", cam, world, width, height);
+      compare_stream_render("height field 100k tris (stream render)", world, cam, space_background, width, height);
+
+      hittable_list meshes;
+      shared_ptr<triangle_mesh> mesh = make_shared<triangle_mesh>();
+      height_field(224, meshes, mesh);
+      compare_mesh("height field mesh (primary)", primary, world, meshes, *mesh);
+      compare_mesh("height field mesh (secondary)", secondary, world, meshes, *mesh);
+      compare_kernels("height field mesh (kernels)", secondary, [](hittable_list& world)
+      {
+         height_field(224, world, make_shared<triangle_mesh>());
+      });
+
+      write_obj("benchmark_mesh.obj", *mesh);
+      write_ply("benchmark_mesh.ply", *mesh);
+      for (int n = 1; n <= max_threads; n *= 2)
+      {
+         load_time("height field mesh (load .obj)", "benchmark_mesh.obj", n);
+      }
+      load_time("height field mesh (load .ply)", "benchmark_mesh.ply", 1);
+      remove("benchmark_mesh.obj");
+      remove("benchmark_mesh.ply");
+   }
+
+   compare_instances("planet belt 2000 rings (primary)", 2000, width, height);
+   compare_ring("planet ring", width, height);
+   compare_leaf_tests("leaf tests (dense cluster)", 4096, 2000);
+   compare_asteroids("asteroid field 20k spheres", 20000, width, height);
+   compare_light_sampling("lamp room", width / 4, height / 4, 16);
+
+   {
+      hittable_list world;
+      materials_scene(world, point3(0, 0, 6));
+      world.build_bvh();
+      compare_samplers("materials (samplers)", world, materials_camera(aspect), sky_background, width / 4, height / 4);
+      compare_shading("materials (shading)", world, materials_camera(aspect), width, height);
+      compare_stream_render("materials (stream render)", world, materials_camera(aspect), sky_background, width, height);
+
+      hittable_list lamps;
+      lamp_room(lamps);
+      lamps.build_bvh();
+      compare_samplers("lamp room (samplers)", lamps, lamp_room_camera(aspect), black_background, width / 4, height / 4);
+   }
+
+   return 0;
+}
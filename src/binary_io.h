@@ -0,0 +1,78 @@
+// binary_io.h, plain values and arrays in binary files, as they are laid out in memory
+// Used by compiled scenes (scene_file.h) and render checkpoints (checkpoint.h). The files are only
+// meant for the kind of machine that wrote them.
+
+#ifndef BINARY_IO_H_
+#define BINARY_IO_H_
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// appends plain values and arrays of them to a binary file
+class binary_writer {
+public:
+   binary_writer(std::ostream& o) : out(o) {}
+
+   template <class T>
+   void put(const T& value) { out.write((const char*) &value, sizeof(T)); }
+
+   template <class T>
+   void put_array(const std::vector<T>& values) {
+      put((uint64_t) values.size());
+      if (!values.empty()) out.write((const char*) values.data(), values.size() * sizeof(T));
+   }
+
+   void put_string(const std::string& s) {
+      put((uint64_t) s.size());
+      out.write(s.data(), s.size());
+   }
+
+private:
+   std::ostream& out;
+};
+
+// reads the values written by binary_writer back from bytes in memory (e.g. a mapped file).
+// Reading past the end fails, and so does every read after that.
+class binary_reader {
+public:
+   binary_reader(const char* begin, const char* end) : p(begin), last(end), good(true) {}
+
+   template <class T>
+   bool get(T& value) {
+      if (!good || (size_t) (last - p) < sizeof(T)) return good = false;
+      memcpy((void*) &value, p, sizeof(T));
+      p += sizeof(T);
+      return true;
+   }
+
+   // arrays are copied out in one piece
+   template <class T>
+   bool get_array(std::vector<T>& values) {
+      uint64_t n;
+      if (!get(n) || n > (uint64_t) (last - p) / sizeof(T)) return good = false;
+      values.resize((size_t) n);
+      if (n > 0) memcpy((void*) values.data(), p, (size_t) n * sizeof(T));
+      p += n * sizeof(T);
+      return true;
+   }
+
+   bool get_string(std::string& s) {
+      uint64_t n;
+      if (!get(n) || n > (uint64_t) (last - p)) return good = false;
+      s.assign(p, (size_t) n);
+      p += n;
+      return true;
+   }
+
+   bool ok() const { return good; }
+
+private:
+   const char* p;
+   const char* last;
+   bool good;
+};
+
+#endif
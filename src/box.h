@@ -4,21 +4,82 @@
 #include "hittable.h"
 #include "AGLM.h"
 
+// a box of any orientation: center c, the directions xdir, ydir and zdir of its edges (at right
+// angles), and halfx, halfy and halfz, whose lengths are half its size along each direction
 class box : public hittable {
 public:
-   box() : c(0), ax(0), ay(0), az(0), hx(0), hy(0), hz(0), mat_ptr(0) {}
+   box() : c(0), ax(1,0,0), ay(0,1,0), az(0,0,1), hx(0), hy(0), hz(0), mat_id(-1) {}
    box(const glm::point3& center, 
        const glm::vec3& xdir, const glm::vec3& ydir, const glm::vec3& zdir,
        const glm::vec3& halfx, const glm::vec3& halfy, const glm::vec3& halfz,
-       std::shared_ptr<material> m) : c(center), ax(xdir), ay(ydir), az(zdir), 
-          hx(halfx), hy(halfy), hz(halfz), mat_ptr(m) {};
+       material_id m) : c(center), ax(xdir), ay(ydir), az(zdir), 
+          hx(halfx), hy(halfy), hz(halfz), mat_id(m) {};
 
-   virtual bool hit(const ray& r, hit_record& rec) const override
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override
    {
-      // todo
+      RT_COUNT(tests);
+
+      // the ray enters the box at near and leaves it at far; a ray that starts inside hits the
+      // far side, as with a sphere
+      float near, far;
+      int near_axis, far_axis;
+      if (!slabs(r, near, far, near_axis, far_axis)) return false;
+      if (near >= t_min && near <= t_max)
+      {
+         rec.t = near;
+         rec.part = near_axis;
+         return true;
+      }
+      if (far >= t_min && far <= t_max)
+      {
+         rec.t = far;
+         rec.part = far_axis;
+         return true;
+      }
       return false;
    }
 
+   virtual void complete_hit(const ray& r, hit_record& rec) const override
+   {
+      rec.p = r.at(rec.t);
+      rec.mat_id = mat_id;
+      // the face hit is the one of the axis in rec.part on the side of the hit point
+      glm::vec3 u = normalize(axis(rec.part));
+      rec.set_face_normal(r, glm::dot(rec.p - c, u) < 0 ? -u : u);
+   }
+
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override
+   {
+      RT_COUNT(tests);
+
+      float near, far;
+      int near_axis, far_axis;
+      if (!slabs(r, near, far, near_axis, far_axis)) return false;
+      return (near >= t_min && near <= t_max) || (far >= t_min && far <= t_max);
+   }
+
+   virtual bool bounding_box(aabb& output_box) const override
+   {
+      // each axis of the box reaches as far along a world axis as its half extent times the
+      // cosine between the two
+      glm::vec3 reach(0);
+      for (int a = 0; a < 3; a++)
+      {
+         reach += extent(a) * glm::abs(normalize(axis(a)));
+      }
+      output_box = aabb(c - reach, c + reach);
+      return true;
+   }
+
+private:
+   // the direction of axis a of the box, and half its size along it
+   const glm::vec3& axis(int a) const { return a == 0 ? ax : a == 1 ? ay : az; }
+   float extent(int a) const { return glm::length(a == 0 ? hx : a == 1 ? hy : hz); }
+
+   // the times at which r enters and leaves the box, and the axes of the faces it crosses there
+   // (the slab test of aabb::hit(), along the axes of the box); false if it misses the box
+   bool slabs(const ray& r, float& near, float& far, int& near_axis, int& far_axis) const;
+
 public:
    glm::vec3 c;
    glm::vec3 ax;
@@ -27,7 +88,43 @@ public:
    glm::vec3 hx;
    glm::vec3 hy;
    glm::vec3 hz;
-   std::shared_ptr<material> mat_ptr;
+   material_id mat_id;
 };
 
+bool box::slabs(const ray& r, float& near, float& far, int& near_axis, int& far_axis) const
+{
+   near = -infinity;
+   far = infinity;
+   near_axis = far_axis = 0;
+   glm::vec3 to_center = c - r.origin();
+   for (int a = 0; a < 3; a++)
+   {
+      glm::vec3 u = normalize(axis(a));
+      float e = extent(a);
+      float o = glm::dot(to_center, u);
+      float d = glm::dot(r.direction(), u);
+      if (std::fabs(d) < 1e-8f)
+      {
+         // parallel with the faces of this axis: the ray is between them or misses
+         if (std::fabs(o) > e) return false;
+         continue;
+      }
+      float t0 = (o - e) / d;
+      float t1 = (o + e) / d;
+      if (t0 > t1) std::swap(t0, t1);
+      if (t0 > near)
+      {
+         near = t0;
+         near_axis = a;
+      }
+      if (t1 < far)
+      {
+         far = t1;
+         far_axis = a;
+      }
+      if (near > far) return false;
+   }
+   return true;
+}
+
 #endif
@@ -0,0 +1,366 @@
+// bvh.h, bounding volume hierarchy built with the surface area heuristic (SAH)
+// binned construction follows Wald, "On fast Construction of SAH-based Bounding Volume Hierarchies", 2007
+// and the flattened layout follows pbrt-v3 (Pharr, Jakob, Humphreys), section 4.3
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "aabb.h"
+#include <vector>
+#include <algorithm>
+
+struct bvh_node {
+   aabb box;
+   int offset; // leaf: position of the first primitive; interior: index of the second child
+   int count;  // leaf: number of primitives; interior: 0 (the first child is always the next node)
+   int axis;   // split axis of an interior node, used to visit the nearer child first
+};
+
+class bvh {
+public:
+   bvh() {}
+
+   // build the tree over one box per primitive. Afterwards, indices[] lists the primitives
+   // in leaf order: a leaf covers indices[offset] ... indices[offset + count - 1]. When leaves
+   // are tested leaf_width primitives at a time (see simd.h), a leaf of n costs n / leaf_width
+   // tests, rounded up.
+   void build(const std::vector<aabb>& boxes, int max_leaf_size = 4, int leaf_width = 1);
+
+   void clear() { nodes.clear(); indices.clear(); }
+   bool empty() const { return nodes.empty(); }
+   aabb bounds() const { return nodes.empty() ? aabb() : nodes[0].box; }
+
+   // walk the tree front to back and call leaf(offset, count, min_t, max_t) for each leaf the ray
+   // enters before max_t. The leaf returns true when it found a hit, and then lowers max_t to it.
+   template <class LeafFn>
+   bool traverse(const ray& r, float min_t, float max_t, LeafFn& leaf) const;
+
+   // walk the tree in any order and call leaf(offset, count, min_t, max_t) for each leaf the ray
+   // enters. The walk stops as soon as a leaf returns true, i.e. it found some hit in [min_t, max_t].
+   template <class LeafFn>
+   bool occluded(const ray& r, float min_t, float max_t, LeafFn& leaf) const;
+
+   // walk the tree once for the rays begin ... end - 1 of a packet (see ray_stream.h). For a node,
+   // first_hit(box, first) returns the first ray from first on that enters box, or end; the rays
+   // before it skip the node and its subtree. leaf(node, first) is called for each leaf some ray
+   // enters. The children of a node are visited front to back along the first ray that enters it,
+   // whose direction is negative along axis a when dir_neg(ray, a).
+   template <class FirstHitFn, class DirNegFn, class LeafFn>
+   void traverse_packet(int begin, int end, const FirstHitFn& first_hit, const DirNegFn& dir_neg,
+      LeafFn& leaf) const;
+
+public:
+   std::vector<bvh_node> nodes;
+   std::vector<int> indices;
+
+   static const int stack_size = 128; // bounds the depth of a tree that can be traversed
+
+private:
+   struct build_entry {
+      aabb box;
+      glm::point3 centroid;
+      int index;
+   };
+
+   int build_recursive(std::vector<build_entry>& prims, int begin, int end, int depth, int max_leaf_size,
+      int leaf_width);
+
+   static const int num_bins = 16;
+   static const int max_depth = 64; // deeper subtrees fall back to median splits
+};
+
+void bvh::build(const std::vector<aabb>& boxes, int max_leaf_size, int leaf_width)
+{
+   clear();
+   if (boxes.empty()) return;
+
+   std::vector<build_entry> prims(boxes.size());
+   for (size_t i = 0; i < boxes.size(); i++)
+   {
+      prims[i].box = boxes[i];
+      prims[i].centroid = boxes[i].centroid();
+      prims[i].index = (int) i;
+   }
+
+   nodes.reserve(2 * boxes.size());
+   build_recursive(prims, 0, (int) prims.size(), 0, max_leaf_size, leaf_width);
+   nodes.shrink_to_fit(); // a binary tree has at most 2n - 1 nodes, usually far fewer
+
+   indices.resize(prims.size());
+   for (size_t i = 0; i < prims.size(); i++)
+   {
+      indices[i] = prims[i].index;
+   }
+}
+
+int bvh::build_recursive(std::vector<build_entry>& prims, int begin, int end, int depth, int max_leaf_size,
+   int leaf_width)
+{
+   int node_index = (int) nodes.size();
+   nodes.push_back(bvh_node());
+
+   aabb box, centroid_box;
+   for (int i = begin; i < end; i++)
+   {
+      box.grow(prims[i].box);
+      centroid_box.grow(prims[i].centroid);
+   }
+   nodes[node_index].box = box;
+
+   int n = end - begin;
+   int axis = centroid_box.longest_axis();
+   float extent = centroid_box.extent()[axis];
+
+   // a single primitive, or primitives sharing one centroid that fit a leaf
+   if (n == 1 || (extent <= 0 && n <= max_leaf_size))
+   {
+      nodes[node_index].offset = begin;
+      nodes[node_index].count = n;
+      nodes[node_index].axis = 0;
+      return node_index;
+   }
+
+   int mid = begin;
+   if (extent > 0 && depth < max_depth)
+   {
+      // bin the centroids along each axis and sweep the split planes between bins. The cost of a split is
+      //    C = C_trav + (SA(left) * N(left) + SA(right) * N(right)) / SA(node)
+      // in units of one primitive test, against N for a leaf, where N counts leaf_width wide tests
+      const float traversal_cost = 0.125f;
+      auto tests = [=](int count) { return float((count + leaf_width - 1) / leaf_width); };
+      float best_cost = infinity;
+      int best_axis = -1;
+      int best_split = -1;
+
+      for (int a = 0; a < 3; a++)
+      {
+         float lo = centroid_box.minimum[a];
+         float width = centroid_box.maximum[a] - lo;
+         if (width <= 0) continue;
+
+         int counts[num_bins] = {0};
+         aabb bounds[num_bins];
+         for (int i = begin; i < end; i++)
+         {
+            int b = std::min(num_bins - 1, (int) (num_bins * (prims[i].centroid[a] - lo) / width));
+            counts[b]++;
+            bounds[b].grow(prims[i].box);
+         }
+
+         // right_area[s] and right_count[s] describe bins s+1 ... num_bins-1
+         float right_area[num_bins - 1];
+         int right_count[num_bins - 1];
+         aabb right;
+         int count = 0;
+         for (int s = num_bins - 1; s > 0; s--)
+         {
+            right.grow(bounds[s]);
+            count += counts[s];
+            right_area[s - 1] = right.surface_area();
+            right_count[s - 1] = count;
+         }
+
+         aabb left;
+         count = 0;
+         for (int s = 0; s < num_bins - 1; s++)
+         {
+            left.grow(bounds[s]);
+            count += counts[s];
+            if (count == 0 || right_count[s] == 0) continue;
+
+            float cost = left.surface_area() * tests(count) + right_area[s] * tests(right_count[s]);
+            if (cost < best_cost)
+            {
+               best_cost = cost;
+               best_axis = a;
+               best_split = s;
+            }
+         }
+      }
+
+      float area = box.surface_area();
+      float split_cost = traversal_cost + (area > 0 ? best_cost / area : 0);
+      if (best_axis >= 0 && n <= max_leaf_size && split_cost >= tests(n))
+      {
+         // testing every primitive is cheaper than splitting
+         nodes[node_index].offset = begin;
+         nodes[node_index].count = n;
+         nodes[node_index].axis = 0;
+         return node_index;
+      }
+
+      if (best_axis >= 0)
+      {
+         float lo = centroid_box.minimum[best_axis];
+         float width = centroid_box.maximum[best_axis] - lo;
+         build_entry* split = std::partition(&prims[begin], &prims[0] + end,
+            [=](const build_entry& e) {
+               int b = std::min(num_bins - 1, (int) (num_bins * (e.centroid[best_axis] - lo) / width));
+               return b <= best_split;
+            });
+         mid = (int) (split - &prims[0]);
+         axis = best_axis;
+      }
+   }
+
+   if (mid == begin || mid == end)
+   {
+      // no useful SAH split (coincident centroids or a very deep subtree): split the list in half
+      mid = begin + n / 2;
+      std::nth_element(&prims[begin], &prims[mid], &prims[0] + end,
+         [=](const build_entry& x, const build_entry& y) {
+            return x.centroid[axis] < y.centroid[axis];
+         });
+   }
+
+   build_recursive(prims, begin, mid, depth + 1, max_leaf_size, leaf_width);
+   int second = build_recursive(prims, mid, end, depth + 1, max_leaf_size, leaf_width);
+
+   nodes[node_index].offset = second;
+   nodes[node_index].count = 0;
+   nodes[node_index].axis = axis;
+   return node_index;
+}
+
+template <class LeafFn>
+bool bvh::traverse(const ray& r, float min_t, float max_t, LeafFn& leaf) const
+{
+   if (nodes.empty()) return false;
+
+   glm::vec3 inv_dir = 1.0f / r.direction();
+   bool dir_neg[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+   int stack[stack_size];
+   int top = 0;
+   int current = 0;
+   bool hit_anything = false;
+
+   while (true)
+   {
+      const bvh_node& node = nodes[current];
+      if (node.box.hit(r, inv_dir, min_t, max_t))
+      {
+         if (node.count > 0)
+         {
+            if (leaf(node.offset, node.count, min_t, max_t))
+            {
+               hit_anything = true;
+            }
+            if (top == 0) break;
+            current = stack[--top];
+         }
+         else if (dir_neg[node.axis])
+         {
+            // the second child lies on the near side
+            stack[top++] = current + 1;
+            current = node.offset;
+         }
+         else
+         {
+            stack[top++] = node.offset;
+            current = current + 1;
+         }
+      }
+      else
+      {
+         if (top == 0) break;
+         current = stack[--top];
+      }
+   }
+
+   return hit_anything;
+}
+
+template <class LeafFn>
+bool bvh::occluded(const ray& r, float min_t, float max_t, LeafFn& leaf) const
+{
+   if (nodes.empty()) return false;
+
+   glm::vec3 inv_dir = 1.0f / r.direction();
+
+   int stack[stack_size];
+   int top = 0;
+   int current = 0;
+
+   while (true)
+   {
+      const bvh_node& node = nodes[current];
+      if (node.box.hit(r, inv_dir, min_t, max_t))
+      {
+         if (node.count > 0)
+         {
+            if (leaf(node.offset, node.count, min_t, max_t)) return true;
+            if (top == 0) break;
+            current = stack[--top];
+         }
+         else
+         {
+            stack[top++] = node.offset;
+            current = current + 1;
+         }
+      }
+      else
+      {
+         if (top == 0) break;
+         current = stack[--top];
+      }
+   }
+
+   return false;
+}
+
+template <class FirstHitFn, class DirNegFn, class LeafFn>
+void bvh::traverse_packet(int begin, int end, const FirstHitFn& first_hit, const DirNegFn& dir_neg,
+   LeafFn& leaf) const
+{
+   if (nodes.empty()) return;
+
+   // each entry keeps the first ray that entered the parent; the rays before it miss the node
+   struct entry {
+      int node;
+      int first;
+   };
+   entry stack[stack_size];
+   int top = 0;
+   int current = 0;
+   int first = begin;
+
+   while (true)
+   {
+      const bvh_node& node = nodes[current];
+      first = first_hit(node.box, first);
+      if (first < end)
+      {
+         if (node.count > 0)
+         {
+            leaf(node, first);
+            if (top == 0) break;
+            --top;
+            current = stack[top].node;
+            first = stack[top].first;
+         }
+         else if (dir_neg(first, node.axis))
+         {
+            // the second child lies on the near side
+            stack[top].node = current + 1;
+            stack[top++].first = first;
+            current = node.offset;
+         }
+         else
+         {
+            stack[top].node = node.offset;
+            stack[top++].first = first;
+            current = current + 1;
+         }
+      }
+      else
+      {
+         if (top == 0) break;
+         --top;
+         current = stack[top].node;
+         first = stack[top].first;
+      }
+   }
+}
+
+#endif
@@ -68,8 +68,6 @@ protected:
   glm::vec3 u,v,w;
   float lens_radius;
 };
-#endif
-
 glm::vec3 random_in_unit_disk() {
     while (true) {
         glm::vec3 p = glm::vec3(random_float(-1,1), random_float(-1,1), 0);
@@ -78,3 +76,4 @@ glm::vec3 random_in_unit_disk() {
     }
 }
 
+#endif
@@ -0,0 +1,335 @@
+// checkpoint.h, periodic snapshots of a render in progress, so that a long render can resume
+// A checkpoint holds the tiles that are done: for each of their pixels the sum and number of its
+// samples, the samples added by this render, and the denoiser features. Tiles are independent,
+// and every sample seeds its own random stream from (pixel, sample, seed), so nothing else is
+// needed: a resumed render skips the saved tiles and renders the others exactly as the first run
+// would have. A checkpoint is written to FILE.tmp, flushed to the disk and renamed over FILE, so a
+// crash of the program or of the system while writing leaves the last one in place.
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include "AGLM.h"
+#include "binary_io.h"
+#include "tile.h"
+#include "hdr_image.h"
+#include "denoise.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// the settings a checkpoint is only valid for
+struct checkpoint_key {
+   int32_t width;
+   int32_t height;
+   int32_t tile_size;
+   int32_t samples_per_pixel;
+   int32_t max_samples;
+   float noise_threshold;
+   uint32_t seed;
+   int32_t denoising;
+   int32_t sampler; // its id (see sampler.h)
+   uint32_t scene;  // see scene_stamp()
+   int32_t max_depth;
+
+   bool operator==(const checkpoint_key& other) const {
+      return width == other.width && height == other.height && tile_size == other.tile_size &&
+         samples_per_pixel == other.samples_per_pixel && max_samples == other.max_samples &&
+         noise_threshold == other.noise_threshold && seed == other.seed && denoising == other.denoising &&
+         sampler == other.sampler && scene == other.scene && max_depth == other.max_depth;
+   }
+};
+
+// a stamp of the scene of a render: a hash (FNV-1a) of the name the program gives its scene and of
+// the contents of the scene file, if any, so that the checkpoint of another program or of an
+// edited scene file does not match
+uint32_t scene_stamp(const std::string& name, const std::string& scene_file)
+{
+   uint32_t hash = 2166136261u;
+   auto add = [&](const char* bytes, size_t n)
+   {
+      for (size_t k = 0; k < n; k++) hash = (hash ^ (unsigned char) bytes[k]) * 16777619u;
+   };
+   add(name.c_str(), name.size() + 1);
+   if (!scene_file.empty())
+   {
+      std::ifstream in(scene_file.c_str(), std::ios::binary);
+      std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      add(bytes.data(), bytes.size());
+   }
+   return hash;
+}
+
+// write the data of a file to the disk, so that it survives a crash of the system
+bool sync_file(const std::string& filename)
+{
+#ifdef _WIN32
+   HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+   if (file == INVALID_HANDLE_VALUE) return false;
+   bool ok = FlushFileBuffers(file) != 0;
+   CloseHandle(file);
+   return ok;
+#else
+   int fd = open(filename.c_str(), O_RDONLY);
+   if (fd < 0) return false;
+   bool ok = fsync(fd) == 0;
+   close(fd);
+   return ok;
+#endif
+}
+
+// replace the file to with the file from, and write the change to the disk: on POSIX systems a
+// rename is only durable once the directory that holds it is synced too
+bool replace_file(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+   return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+   if (rename(from.c_str(), to.c_str()) != 0) return false;
+   size_t slash = to.rfind('/');
+   std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : to.substr(0, slash);
+   int fd = open(directory.c_str(), O_RDONLY);
+   if (fd < 0) return false;
+   bool ok = fsync(fd) == 0;
+   close(fd);
+   return ok;
+#endif
+}
+
+// everything a checkpoint keeps of one pixel; worker processes send their tiles back the same way
+struct pixel_record {
+   glm::color sum;
+   int32_t count;
+   int32_t samples; // taken by this render, for the sample map
+   glm::color color;
+   float variance;
+   glm::color albedo;
+   glm::vec3 normal;
+   float depth;
+};
+
+// append the pixels of tile t, row by row, to records; the features only with denoising
+void append_tile_pixels(const tile& t, const hdr_image& hdr, const std::vector<int>& samples,
+   const feature_buffers& features, bool denoising, std::vector<pixel_record>& records)
+{
+   const size_t width = hdr.width();
+   for (int j = t.y0; j < t.y1; j++)
+   {
+      for (int i = t.x0; i < t.x1; i++)
+      {
+         size_t p = j * width + i;
+         pixel_record pixel = {};
+         pixel.sum = hdr.sum(j, i);
+         pixel.count = hdr.count(j, i);
+         pixel.samples = samples[p];
+         if (denoising)
+         {
+            pixel.color = features.color[p];
+            pixel.variance = features.variance[p];
+            pixel.albedo = features.albedo[p];
+            pixel.normal = features.normal[p];
+            pixel.depth = features.depth[p];
+         }
+         records.push_back(pixel);
+      }
+   }
+}
+
+// the reverse of append_tile_pixels(): set the pixels of tile t from records, and return the
+// record after the last one used
+const pixel_record* restore_tile_pixels(const tile& t, const pixel_record* records, hdr_image& hdr,
+   std::vector<int>& samples, feature_buffers& features, bool denoising)
+{
+   const size_t width = hdr.width();
+   for (int j = t.y0; j < t.y1; j++)
+   {
+      for (int i = t.x0; i < t.x1; i++)
+      {
+         const pixel_record& pixel = *records++;
+         size_t p = j * width + i;
+         hdr.set(j, i, pixel.sum, pixel.count);
+         samples[p] = pixel.samples;
+         if (denoising)
+         {
+            features.color[p] = pixel.color;
+            features.variance[p] = pixel.variance;
+            features.albedo[p] = pixel.albedo;
+            features.normal[p] = pixel.normal;
+            features.depth[p] = pixel.depth;
+         }
+      }
+   }
+   return records;
+}
+
+// the number of pixels of a tile
+inline size_t tile_pixels(const tile& t)
+{
+   return (size_t) (t.x1 - t.x0) * (t.y1 - t.y0);
+}
+
+class render_checkpoint {
+public:
+   // tiles and the buffers are those of the render; features is only used with key.denoising
+   render_checkpoint(const std::string& filename, double interval_seconds, const checkpoint_key& key,
+      const std::vector<tile>& tiles, hdr_image& hdr, std::vector<int>& samples, feature_buffers& features) :
+      filename(filename), interval(interval_seconds), key(key), tiles(tiles), hdr(hdr), samples(samples),
+      features(features), finished(tiles.size(), 0), saving(false), last_save(std::chrono::steady_clock::now()) {}
+
+   // restore the tiles saved in the checkpoint file, and return how many there were. A missing
+   // file, or one written for other settings, restores nothing.
+   int load();
+
+   // whether tile k is done
+   bool done(int k) const { return finished[k] != 0; }
+
+   // mark tile k done once its pixels are final, and write a checkpoint if the interval has passed
+   // since the last one. Safe to call from several threads at once.
+   void tile_done(int k);
+
+   // write the tiles that are done
+   bool save();
+
+private:
+   bool write(const std::vector<char>& done_tiles);
+
+   std::string filename;
+   double interval;
+   checkpoint_key key;
+   const std::vector<tile>& tiles;
+   hdr_image& hdr;
+   std::vector<int>& samples;
+   feature_buffers& features;
+
+   std::mutex lock; // guards finished, saving and last_save
+   std::vector<char> finished;
+   bool saving;
+   std::chrono::steady_clock::time_point last_save;
+};
+
+static const char checkpoint_magic[8] = { 'R', 'T', 'C', 'H', 'E', 'C', 'K', '3' };
+
+void render_checkpoint::tile_done(int k)
+{
+   std::vector<char> done_tiles;
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      finished[k] = 1;
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (saving || std::chrono::duration<double>(now - last_save).count() < interval) return;
+      saving = true;
+      done_tiles = finished;
+   }
+   // the other threads go on rendering while this one writes
+   write(done_tiles);
+   std::lock_guard<std::mutex> guard(lock);
+   saving = false;
+   last_save = std::chrono::steady_clock::now();
+}
+
+bool render_checkpoint::save()
+{
+   std::vector<char> done_tiles;
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      done_tiles = finished;
+   }
+   return write(done_tiles);
+}
+
+bool render_checkpoint::write(const std::vector<char>& done_tiles)
+{
+   // the pixels of the done tiles, in tile order; no thread writes them any more
+   std::vector<pixel_record> pixels;
+   for (size_t k = 0; k < tiles.size(); k++)
+   {
+      if (done_tiles[k]) append_tile_pixels(tiles[k], hdr, samples, features, key.denoising != 0, pixels);
+   }
+
+   std::string temporary = filename + ".tmp";
+   {
+      std::ofstream out(temporary.c_str(), std::ios::binary);
+      binary_writer writer(out);
+      writer.put(checkpoint_magic);
+      writer.put(key);
+      writer.put_array(done_tiles);
+      writer.put_array(pixels);
+      out.close();
+      if (!out)
+      {
+         std::cerr << temporary << ": cannot write checkpoint" << std::endl;
+         return false;
+      }
+   }
+   if (!sync_file(temporary))
+   {
+      std::cerr << temporary << ": cannot write checkpoint to the disk" << std::endl;
+      return false;
+   }
+   if (!replace_file(temporary, filename))
+   {
+      std::cerr << filename << ": cannot replace checkpoint" << std::endl;
+      return false;
+   }
+   return true;
+}
+
+int render_checkpoint::load()
+{
+   std::ifstream in(filename.c_str(), std::ios::binary);
+   if (!in) return 0;
+   std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+   binary_reader reader(bytes.data(), bytes.data() + bytes.size());
+
+   char magic[sizeof(checkpoint_magic)];
+   checkpoint_key saved;
+   std::vector<char> done_tiles;
+   std::vector<pixel_record> pixels;
+   if (!reader.get(magic) || memcmp(magic, checkpoint_magic, sizeof(magic)) != 0 ||
+      !reader.get(saved) || !reader.get_array(done_tiles) || !reader.get_array(pixels))
+   {
+      std::cerr << filename << ": not a checkpoint, or truncated; rendering from scratch" << std::endl;
+      return 0;
+   }
+   bool matches = saved == key && done_tiles.size() == tiles.size();
+   if (matches)
+   {
+      size_t expected = 0;
+      for (size_t k = 0; k < tiles.size(); k++)
+      {
+         if (done_tiles[k]) expected += tile_pixels(tiles[k]);
+      }
+      matches = expected == pixels.size();
+   }
+   if (!matches)
+   {
+      std::cerr << filename << ": saved with other settings; rendering from scratch" << std::endl;
+      return 0;
+   }
+
+   const pixel_record* next = pixels.data();
+   int restored = 0;
+   for (size_t k = 0; k < tiles.size(); k++)
+   {
+      if (!done_tiles[k]) continue;
+      next = restore_tile_pixels(tiles[k], next, hdr, samples, features, key.denoising != 0);
+      finished[k] = 1;
+      restored++;
+   }
+   return restored;
+}
+
+#endif
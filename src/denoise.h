@@ -0,0 +1,166 @@
+// denoise.h, an edge-avoiding a-trous wavelet filter guided by first-hit features
+// After "Edge-Avoiding A-Trous Wavelet Transform for fast Global Illumination Filtering" by
+// Dammertz et al., 2010. Each pass blurs the image with a 5x5 B3 spline kernel whose taps are
+// spread 2^pass pixels apart, so five passes cover 125x125 pixels with 25 taps each. Each tap is
+// weighted by how much its albedo, normal, depth and color look like the center pixel, so the
+// blur stays inside surfaces. As in SVGF (Schied et al., 2017), colors may differ by a few times
+// the noise of the pixel, which the filter tracks through the passes, so pixels without noise are
+// left alone. The filter runs on the lighting alone (the color divided by the albedo), and the
+// albedo is multiplied back afterwards, so textures and material edges stay sharp.
+
+#ifndef DENOISE_H_
+#define DENOISE_H_
+
+#include "AGLM.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// the first surface seen by a camera path. path_tracer::trace() writes it, and render() averages
+// it over the samples of a pixel for the denoiser.
+struct sample_features {
+   sample_features() : albedo(1), normal(0), depth(infinity) {}
+
+   glm::color albedo; // base color of the material; white for the background
+   glm::vec3 normal;  // unit normal at the hit; zero for the background
+   float depth;       // distance to the hit; infinity for the background
+};
+
+// the features of the sample the calling thread traces
+inline sample_features& thread_sample_features()
+{
+   thread_local sample_features features;
+   return features;
+}
+
+// per pixel averages of the samples of a render, in linear color
+struct feature_buffers {
+   feature_buffers() : width(0), height(0) {}
+
+   void resize(int w, int h) {
+      width = w;
+      height = h;
+      size_t n = (size_t) w * h;
+      color.assign(n, glm::color(0));
+      variance.assign(n, 0.0f);
+      albedo.assign(n, glm::color(0));
+      normal.assign(n, glm::vec3(0));
+      depth.assign(n, 0.0f);
+   }
+
+   int width;
+   int height;
+   std::vector<glm::color> color;
+   std::vector<float> variance; // of the mean luminance of the pixel
+   std::vector<glm::color> albedo;
+   std::vector<glm::vec3> normal;
+   std::vector<float> depth; // the farthest hit of the samples, so that edges with the background stay sharp
+};
+
+inline feature_buffers& global_feature_buffers()
+{
+   static feature_buffers buffers;
+   return buffers;
+}
+
+// the weights of the filter, in the units of each feature
+struct denoise_settings {
+   denoise_settings() : sigma_color(4.0f), sigma_normal(0.3f), sigma_depth(0.05f), sigma_albedo(0.1f) {}
+
+   float sigma_color;  // luminance difference, in standard deviations of the pixel noise
+   float sigma_normal; // distance between unit normals
+   float sigma_depth;  // depth difference, relative to the farther depth
+   float sigma_albedo; // albedo difference
+};
+
+// filter buffers.color with the given number of passes, and write the result to result, in linear
+// color. The rows of each pass are filtered by the pool in parallel.
+void denoise(const feature_buffers& buffers, int passes, std::vector<glm::color>& result,
+   thread_pool& pool, const denoise_settings& settings = denoise_settings())
+{
+   const int width = buffers.width;
+   const int height = buffers.height;
+   const size_t n = (size_t) width * height;
+   const float kernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f }; // B3 spline, by |offset|
+
+   // demodulate: filter the lighting, not the textures
+   std::vector<glm::color> light(n), filtered(n);
+   std::vector<float> variance(n), filtered_variance(n);
+   std::vector<float> lum(n);
+   for (size_t p = 0; p < n; p++)
+   {
+      glm::color albedo = glm::max(buffers.albedo[p], glm::color(0.01f));
+      light[p] = buffers.color[p] / albedo;
+      float scale = 1.0f / luminance(albedo);
+      variance[p] = buffers.variance[p] * scale * scale;
+   }
+
+   const float inv_normal = 1.0f / (settings.sigma_normal * settings.sigma_normal);
+   const float inv_depth = 1.0f / settings.sigma_depth;
+   const float inv_albedo = 1.0f / (settings.sigma_albedo * settings.sigma_albedo);
+
+   for (int pass = 0; pass < passes; pass++)
+   {
+      const int step = 1 << pass;
+      for (size_t p = 0; p < n; p++) lum[p] = luminance(light[p]);
+
+      pool.parallel_for(height, [&](int j)
+      {
+         for (int i = 0; i < width; i++)
+         {
+            const size_t p = (size_t) j * width + i;
+            const float l_p = lum[p];
+            // a tiny floor, so that pixels without noise still average equal neighbors
+            const float inv_color = 1.0f / (settings.sigma_color * std::sqrt(variance[p]) + 1e-4f);
+            const glm::color a_p = buffers.albedo[p];
+            const glm::vec3 n_p = buffers.normal[p];
+            const float z_p = buffers.depth[p];
+
+            glm::color sum(0);
+            float variance_sum = 0;
+            float weight_sum = 0;
+            for (int dy = -2; dy <= 2; dy++)
+            {
+               int y = std::min(height - 1, std::max(0, j + dy * step));
+               for (int dx = -2; dx <= 2; dx++)
+               {
+                  int x = std::min(width - 1, std::max(0, i + dx * step));
+                  const size_t q = (size_t) y * width + x;
+
+                  float dl = std::fabs(lum[q] - l_p);
+                  glm::color da = buffers.albedo[q] - a_p;
+                  glm::vec3 dn = buffers.normal[q] - n_p;
+                  float z_q = buffers.depth[q];
+                  // equal depths (both infinite for the background) are no difference, and
+                  // a surface and the background are as different as depths get
+                  float far = std::max(z_q, z_p);
+                  float dz = z_q == z_p ? 0.0f : far == infinity ? 1.0f : std::fabs(z_q - z_p) / far;
+
+                  float w = kernel[std::abs(dx)] * kernel[std::abs(dy)] * std::exp(
+                     -dl * inv_color - glm::dot(da, da) * inv_albedo -
+                     glm::dot(dn, dn) * inv_normal - dz * inv_depth);
+                  sum += w * light[q];
+                  variance_sum += w * w * variance[q];
+                  weight_sum += w;
+               }
+            }
+            // the center tap has weight kernel[0]^2, so weight_sum is never zero
+            filtered[p] = sum / weight_sum;
+            filtered_variance[p] = variance_sum / (weight_sum * weight_sum);
+         }
+      });
+
+      std::swap(light, filtered);
+      std::swap(variance, filtered_variance);
+   }
+
+   // remodulate
+   result.resize(n);
+   for (size_t p = 0; p < n; p++)
+   {
+      result[p] = light[p] * glm::max(buffers.albedo[p], glm::color(0.01f));
+   }
+}
+
+#endif
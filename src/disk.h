@@ -0,0 +1,108 @@
+// disk.h, a flat disk, or an annulus (a disk with a round hole), e.g. the ring of a planet
+// A ray hits the plane of the disk at most once, and the hit counts if its distance to the center
+// is between the inner and the outer radius: one plane test and one squared distance, where a
+// triangle fan costs a test per triangle and only approximates the circle.
+
+#ifndef DISK_H_
+#define DISK_H_
+
+#include "hittable.h"
+#include "AGLM.h"
+
+class disk : public hittable {
+public:
+   disk() : center(0), n(0, 0, 1), inner_radius(0), outer_radius(1), mat_id(-1) {}
+
+   // a disk around center, facing normal, that covers the radii [inner, outer]; inner = 0 gives
+   // a full disk
+   disk(const glm::point3& c, const glm::vec3& normal, float inner, float outer, material_id m) :
+      center(c), n(glm::normalize(normal)), inner_radius(inner), outer_radius(outer), mat_id(m) {
+         assert(glm::length(normal) > 0 && "The normal vector of a disk cannot be 0!");
+         assert(inner >= 0 && outer > inner && "The radii of a disk must satisfy 0 <= inner < outer!");
+      }
+
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override
+   {
+      float t;
+      if (!plane_hit(r, t_min, t_max, t)) return false;
+
+      // save the time when we hit the object; complete_hit() fills the rest
+      rec.t = t;
+      return true;
+   }
+
+   virtual void complete_hit(const ray& r, hit_record& rec) const override
+   {
+      rec.p = r.at(rec.t);
+      rec.mat_id = mat_id;
+      rec.set_face_normal(r, n);
+   }
+
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override
+   {
+      float t;
+      return plane_hit(r, t_min, t_max, t);
+   }
+
+   // lights: points are picked uniformly over the area of the disk
+   virtual material_id light_material() const override { return mat_id; }
+
+   virtual bool sample_surface(const glm::point3& origin, float u1, float u2, hit_record& rec, float& pdf) const override
+   {
+      glm::vec3 t, b;
+      orthonormal_basis(n, t, b);
+      float inner2 = inner_radius * inner_radius;
+      float rho = sqrt(inner2 + u1 * (outer_radius * outer_radius - inner2));
+      float phi = 2.0f * pi * u2;
+      rec.t = 1;
+      rec.p = center + rho * (std::cos(phi) * t + std::sin(phi) * b);
+      rec.mat_id = mat_id;
+      rec.set_face_normal(ray(origin, rec.p - origin), n);
+      pdf = surface_pdf(origin, rec);
+      return pdf > 0;
+   }
+
+   virtual float surface_pdf(const glm::point3& origin, const hit_record& rec) const override
+   {
+      // the density per area, 1 / area, turned into one per solid angle at origin
+      glm::vec3 to_point = rec.p - origin;
+      float distance2 = glm::length2(to_point);
+      float cosine = std::abs(glm::dot(to_point, n)) / sqrt(distance2);
+      if (!(cosine > 0)) return 0;
+      float area = pi * (outer_radius * outer_radius - inner_radius * inner_radius);
+      return distance2 / (cosine * area);
+   }
+
+   virtual bool bounding_box(aabb& output_box) const override
+   {
+      // along each axis, the disk reaches outer_radius times the sine of its angle with the normal
+      glm::vec3 reach = outer_radius * glm::sqrt(glm::max(glm::vec3(1.0f) - n * n, glm::vec3(0.0f)));
+      output_box = aabb(center - reach, center + reach).pad();
+      return true;
+   }
+
+public:
+   glm::point3 center;
+   glm::vec3 n; // unit normal
+   float inner_radius;
+   float outer_radius;
+   material_id mat_id;
+
+private:
+   // the time t in [t_min, t_max] at which r crosses the plane between the two radii
+   bool plane_hit(const ray& r, float t_min, float t_max, float& t) const
+   {
+      RT_COUNT(tests);
+
+      // a ray parallel with the disk misses it, since the disk has no thickness
+      float d = glm::dot(r.direction(), n);
+      if (d == 0) return false;
+      t = glm::dot(center - r.origin(), n) / d;
+      if (!(t >= t_min && t <= t_max)) return false;
+
+      float distance2 = glm::length2(r.at(t) - center);
+      return distance2 <= outer_radius * outer_radius && distance2 >= inner_radius * inner_radius;
+   }
+};
+
+#endif
@@ -0,0 +1,224 @@
+// hdr_image.h, a float framebuffer that accumulates the samples of a render
+// ppm_image keeps 8 bits per channel after clamping and gamma correction, so it can neither hold
+// the radiance of bright pixels nor take more samples later. hdr_image keeps, for every pixel, the
+// sum of its samples in linear float color and their number. It is saved as three PFM files (the
+// raw float format read by HDR tools): NAME.pfm holds the mean radiance for viewers,
+// NAME_samples.pfm the sample counts and NAME_sums.pfm the sums themselves, so that a later render
+// can load them and add samples to the exact sums (a mean times its count is not the sum again).
+
+#ifndef HDR_IMAGE_H_
+#define HDR_IMAGE_H_
+
+#include "AGLM.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class hdr_image {
+public:
+   hdr_image() : w(0), h(0) {}
+   hdr_image(int width, int height) { resize(width, height); }
+
+   // clear to width x height pixels without samples
+   void resize(int width, int height) {
+      w = width;
+      h = height;
+      sums.assign((size_t) w * h, glm::color(0));
+      counts.assign((size_t) w * h, 0);
+   }
+
+   int width() const { return w; }
+   int height() const { return h; }
+
+   // the sum and the number of the samples of the pixel at (row, col)
+   const glm::color& sum(int row, int col) const { return sums[(size_t) row * w + col]; }
+   int count(int row, int col) const { return counts[(size_t) row * w + col]; }
+
+   // replace the samples of a pixel
+   void set(int row, int col, const glm::color& sum, int count) {
+      sums[(size_t) row * w + col] = sum;
+      counts[(size_t) row * w + col] = count;
+   }
+
+   // the mean of the samples of a pixel; black without samples
+   glm::color mean(int row, int col) const {
+      int n = count(row, col);
+      return n == 0 ? glm::color(0) : sum(row, col) / float(n);
+   }
+
+   // write the mean radiance to filename (e.g. image.pfm), and the sample counts and sums next to
+   // it (image_samples.pfm, image_sums.pfm)
+   bool save(const std::string& filename) const;
+
+   // read a render written by save(), replacing the samples of this image. Without a sums file
+   // (e.g. a render of an older version), the sums are rebuilt as mean * count, which is close to
+   // but not exactly the sums the render had.
+   bool load(const std::string& filename);
+
+private:
+   int w;
+   int h;
+   std::vector<glm::color> sums;
+   std::vector<int> counts;
+};
+
+// a file that goes with an image file: image.pfm, "_samples" -> image_samples.pfm
+inline std::string companion_filename(const std::string& filename, const std::string& suffix)
+{
+   size_t dot = filename.rfind('.');
+   if (dot == std::string::npos || filename.find('/', dot) != std::string::npos) dot = filename.size();
+   return filename.substr(0, dot) + suffix + filename.substr(dot);
+}
+
+// the sample count file that goes with an image file: image.pfm -> image_samples.pfm
+inline std::string samples_filename(const std::string& filename)
+{
+   return companion_filename(filename, "_samples");
+}
+
+// the sample sum file that goes with an image file: image.pfm -> image_sums.pfm
+inline std::string sums_filename(const std::string& filename)
+{
+   return companion_filename(filename, "_sums");
+}
+
+inline bool host_is_little_endian()
+{
+   uint16_t one = 1;
+   unsigned char first;
+   memcpy(&first, &one, 1);
+   return first == 1;
+}
+
+// write a PFM file of width x height pixels with 1 (gray) or 3 (rgb) floats each, given row by
+// row from the top. PFM stores rows from the bottom; a negative scale marks little endian data.
+bool save_pfm(const std::string& filename, int width, int height, int channels, const float* data)
+{
+   FILE* file = fopen(filename.c_str(), "wb");
+   if (!file)
+   {
+      fprintf(stderr, "%s: cannot write file\n", filename.c_str());
+      return false;
+   }
+   fprintf(file, "%s\n%d %d\n%s\n", channels == 3 ? "PF" : "Pf", width, height,
+      host_is_little_endian() ? "-1.0" : "1.0");
+   size_t row = (size_t) width * channels;
+   bool ok = true;
+   for (int j = height - 1; j >= 0 && ok; j--)
+   {
+      ok = fwrite(data + j * row, sizeof(float), row, file) == row;
+   }
+   ok = fclose(file) == 0 && ok;
+   if (!ok) fprintf(stderr, "%s: write failed\n", filename.c_str());
+   return ok;
+}
+
+// read a PFM file written by save_pfm() or another program, rows from the top
+bool load_pfm(const std::string& filename, int& width, int& height, int& channels, std::vector<float>& data)
+{
+   FILE* file = fopen(filename.c_str(), "rb");
+   if (!file)
+   {
+      fprintf(stderr, "%s: cannot open\n", filename.c_str());
+      return false;
+   }
+   char type[3] = { 0 };
+   float scale = 0;
+   // the header ends with a single whitespace character after the scale
+   bool ok = fscanf(file, "%2s %d %d %f", type, &width, &height, &scale) == 4 && fgetc(file) != EOF &&
+      (strcmp(type, "PF") == 0 || strcmp(type, "Pf") == 0) && width > 0 && height > 0 && scale != 0;
+   if (ok)
+   {
+      channels = type[1] == 'F' ? 3 : 1;
+      size_t row = (size_t) width * channels;
+      data.resize(row * height);
+      for (int j = height - 1; j >= 0 && ok; j--)
+      {
+         ok = fread(data.data() + j * row, sizeof(float), row, file) == row;
+      }
+      if (ok && (scale < 0) != host_is_little_endian())
+      {
+         for (float& value : data)
+         {
+            unsigned char bytes[4];
+            memcpy(bytes, &value, 4);
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+            memcpy(&value, bytes, 4);
+         }
+      }
+   }
+   fclose(file);
+   if (!ok) fprintf(stderr, "%s: not a PFM file, or truncated\n", filename.c_str());
+   return ok;
+}
+
+bool hdr_image::save(const std::string& filename) const
+{
+   std::vector<float> means((size_t) w * h * 3), samples((size_t) w * h), raw((size_t) w * h * 3);
+   for (int j = 0; j < h; j++)
+   {
+      for (int i = 0; i < w; i++)
+      {
+         size_t p = (size_t) j * w + i;
+         glm::color c = mean(j, i);
+         means[3 * p] = c.r;
+         means[3 * p + 1] = c.g;
+         means[3 * p + 2] = c.b;
+         samples[p] = (float) counts[p];
+         raw[3 * p] = sums[p].r;
+         raw[3 * p + 1] = sums[p].g;
+         raw[3 * p + 2] = sums[p].b;
+      }
+   }
+   return save_pfm(filename, w, h, 3, means.data()) &&
+      save_pfm(samples_filename(filename), w, h, 1, samples.data()) &&
+      save_pfm(sums_filename(filename), w, h, 3, raw.data());
+}
+
+bool hdr_image::load(const std::string& filename)
+{
+   int width, height, channels, samples_width, samples_height, samples_channels;
+   std::vector<float> means, samples;
+   if (!load_pfm(filename, width, height, channels, means) ||
+      !load_pfm(samples_filename(filename), samples_width, samples_height, samples_channels, samples))
+   {
+      return false;
+   }
+   if (channels != 3 || samples_channels != 1 || samples_width != width || samples_height != height)
+   {
+      fprintf(stderr, "%s: the image and its sample counts do not match\n", filename.c_str());
+      return false;
+   }
+
+   // the exact sums, if the render wrote them
+   std::vector<float> raw;
+   bool exact = false;
+   FILE* file = fopen(sums_filename(filename).c_str(), "rb");
+   if (file)
+   {
+      fclose(file);
+      int sums_width, sums_height, sums_channels;
+      if (!load_pfm(sums_filename(filename), sums_width, sums_height, sums_channels, raw) ||
+         sums_channels != 3 || sums_width != width || sums_height != height)
+      {
+         fprintf(stderr, "%s: the image and its sums do not match\n", filename.c_str());
+         return false;
+      }
+      exact = true;
+   }
+
+   resize(width, height);
+   for (size_t p = 0; p < counts.size(); p++)
+   {
+      counts[p] = (int) samples[p];
+      if (exact) sums[p] = glm::color(raw[3 * p], raw[3 * p + 1], raw[3 * p + 2]);
+      else sums[p] = glm::color(means[3 * p], means[3 * p + 1], means[3 * p + 2]) * float(counts[p]);
+   }
+   return true;
+}
+
+#endif
@@ -5,16 +5,24 @@
 #define HITTABLE_H
 
 #include "ray.h"
+#include "aabb.h"
+#include "instrument.h"
 #include <sstream>
 
 class material;
+class hittable;
+
+// index of a material in the material_table of the scene (see material_table.h)
+typedef int material_id;
 
 struct hit_record {
    glm::point3 p; // the hit position
    glm::vec3 normal; // the normal at the hit position
    float t = -1.0f; // the time t along the ray at which we hit the object
    bool front_face = false; // whether this is a front or back facing hit point
-   std::shared_ptr<material> mat_ptr = 0; // save material of hit object
+   material_id mat_id = -1; // save material of hit object (an index, so that copies touch no reference count)
+   int part = -1; // the part of a compound object that was hit (e.g. the triangle of a mesh)
+   const hittable* object = nullptr; // the object of the scene that was hit, set by hittable_list::hit()
 
    inline void set_face_normal(const ray& r, const glm::vec3& outward_normal) {
       front_face = glm::dot(r.direction(), outward_normal) < 0;
@@ -46,7 +54,42 @@ struct hit_record {
 
 class hittable {
 public:
-   virtual bool hit(const ray& r, hit_record& rec) const = 0;
+   // find the closest hit with a time in [t_min, t_max]. Only rec.t (and rec.part) are set; the rest
+   // of the record is left to complete_hit(), so that hits replaced by closer ones cost no normals.
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const = 0;
+
+   // fill the position, normal and material of a hit found by intersect()
+   virtual void complete_hit(const ray& r, hit_record& rec) const = 0;
+
+   // intersect() and complete_hit() in one call
+   bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const {
+      if (!intersect(r, t_min, t_max, rec)) return false;
+      complete_hit(r, rec);
+      return true;
+   }
+
+   // whether the ray hits the object at some time in [t_min, t_max]. Used by shadow and visibility
+   // rays: it may stop at any hit, and it neither fills a hit record nor looks at the material.
+   virtual bool occluded(const ray& r, float t_min, float t_max) const = 0;
+
+   // compute a box enclosing the object; returns false for unbounded objects (e.g. planes)
+   virtual bool bounding_box(aabb& output_box) const = 0;
+
+   // Light sampling (see integrator.h). Objects that can pick points on their surface return their
+   // material here; the others return -1, and when they emit light, paths only find it by chance.
+   virtual material_id light_material() const { return -1; }
+
+   // pick a point of the surface seen from origin with the uniforms u1, u2, and fill rec.p,
+   // rec.normal, rec.front_face (for the ray from origin) and rec.mat_id. pdf is the density of
+   // the direction toward the point, per unit solid angle at origin. False if no point was picked.
+   virtual bool sample_surface(const glm::point3& origin, float u1, float u2, hit_record& rec, float& pdf) const {
+      return false;
+   }
+
+   // the density with which sample_surface() picks the direction of rec, a hit on the surface seen
+   // from origin
+   virtual float surface_pdf(const glm::point3& origin, const hit_record& rec) const { return 0; }
+
    virtual ~hittable() {}
 };
 
@@ -4,49 +4,209 @@
 #define HITTABLE_LIST_H
 
 #include "hittable.h"
+#include "material_table.h"
+#include "bvh.h"
+#include "typed_objects.h"
+#include "sphere.h"
+#include "plane.h"
+#include "triangle.h"
+#include "line.h"
 
 #include <memory>
 #include <vector>
 #include <limits>
+#include <utility>
 
 using std::shared_ptr;
 using std::make_shared;
 
+// the classes of objects that hittable_list calls without virtual calls (see typed_objects.h)
+typedef typed_objects<sphere, plane, triangle, line> scene_objects;
+
 class hittable_list {
 public:
-   hittable_list() {}
-   hittable_list(shared_ptr<hittable> object) { add(object); }
+   hittable_list() : accelerated(false) {}
+   hittable_list(shared_ptr<hittable> object) : accelerated(false) { add(object); }
+
+   void clear() { objects.clear(); clear_bvh(); }
+   void add(shared_ptr<hittable> object) { objects.push_back(object); clear_bvh(); }
+
+   // build a bounding volume hierarchy over the objects with a bounding box. Unbounded objects
+   // (planes) are kept aside and tested by every ray. Adding objects afterwards drops the hierarchy
+   // and falls back to testing every object, so call this once the scene is complete.
+   void build_bvh();
+
+   // use a hierarchy built earlier over the same objects (e.g. read back from a compiled scene).
+   // tree.indices refers to the objects with a bounding box, counted in the order of objects.
+   void set_bvh(bvh tree);
 
-   void clear() { objects.clear(); }
-   void add(shared_ptr<hittable> object) { objects.push_back(object); }
+   void clear_bvh() {
+      accel.clear(); bounded.clear(); unbounded.clear();
+      bounded_copies.clear(); bounded_refs.clear(); unbounded_copies.clear();
+      accelerated = false;
+   }
 
    virtual bool hit(const ray& r, float min_t, float max_t, hit_record& rec) const;
 
+   // whether any object blocks the ray in [min_t, max_t]; stops at the first hit found
+   bool occluded(const ray& r, float min_t, float max_t) const;
+
 public:
    std::vector<shared_ptr<hittable>> objects;
+   material_table materials; // the objects refer to these by material_id
+
+   // filled by build_bvh()
+   bvh accel;
+   std::vector<shared_ptr<hittable>> bounded; // objects in the leaf order of accel
+   std::vector<shared_ptr<hittable>> unbounded; // objects without a bounding box
+   scene_objects bounded_copies; // copies of the objects of bounded, called through bounded_refs
+   std::vector<scene_objects::ref> bounded_refs; // in the order of bounded
+   scene_objects unbounded_copies; // copies of the objects of unbounded, tested class by class
+   bool accelerated;
 };
 
-bool hittable_list::hit(const ray& r, float min_t, float max_t, hit_record& rec) const 
+void hittable_list::build_bvh()
+{
+   std::vector<aabb> boxes;
+   for (const auto& object : objects)
+   {
+      aabb box;
+      if (object->bounding_box(box))
+      {
+         boxes.push_back(box);
+      }
+   }
+
+   bvh tree;
+   tree.build(boxes);
+   set_bvh(std::move(tree));
+}
+
+void hittable_list::set_bvh(bvh tree)
+{
+   clear_bvh();
+
+   std::vector<shared_ptr<hittable>> candidates;
+   for (const auto& object : objects)
+   {
+      aabb box;
+      if (object->bounding_box(box))
+      {
+         candidates.push_back(object);
+      }
+      else
+      {
+         unbounded.push_back(object);
+      }
+   }
+
+   accel = std::move(tree);
+   bounded.reserve(candidates.size());
+   for (int index : accel.indices)
+   {
+      bounded.push_back(candidates[index]);
+   }
+
+   // the objects are copied here, so changes to them afterwards need set_bvh() again, as the
+   // hierarchy does
+   for (const auto& object : bounded)
+   {
+      bounded_refs.push_back(bounded_copies.add(object.get()));
+   }
+   for (const auto& object : unbounded)
+   {
+      unbounded_copies.add(object.get());
+   }
+   accelerated = true;
+}
+
+bool hittable_list::hit(const ray& r, float min_t, float max_t, hit_record& rec) const
 {
+   RT_COUNT(rays);
+
+   // find the closest hit first, and fill the hit record for it alone
    hit_record temp_rec;
-   bool hit_anything = false;
    float closest_so_far = max_t;
 
-   for (const auto& object : objects) 
+   if (accelerated)
    {
-      if (object->hit(r, temp_rec)) 
+      const scene_objects* closest_copies = 0;
+      scene_objects::ref closest = {};
+      auto leaf = [&](int offset, int count, float leaf_min_t, float& leaf_max_t) -> bool
       {
-         if (temp_rec.t >= min_t && temp_rec.t <= closest_so_far) 
+         bool hit_leaf = false;
+         for (int i = offset; i < offset + count; i++)
          {
-            hit_anything = true;
-            closest_so_far = std::min(closest_so_far, temp_rec.t);
-            rec = temp_rec;
+            if (bounded_copies.intersect(bounded_refs[i], r, leaf_min_t, leaf_max_t, temp_rec))
+            {
+               hit_leaf = true;
+               leaf_max_t = temp_rec.t;
+               rec = temp_rec;
+               closest_copies = &bounded_copies;
+               closest = bounded_refs[i];
+            }
          }
+         return hit_leaf;
+      };
+
+      if (accel.traverse(r, min_t, closest_so_far, leaf))
+      {
+         closest_so_far = rec.t;
+      }
+
+      if (unbounded_copies.intersect_all(r, min_t, closest_so_far, rec, closest))
+      {
+         closest_copies = &unbounded_copies;
+      }
+
+      if (!closest_copies) return false;
+      closest_copies->complete_hit(closest, r, rec);
+      rec.object = closest.object;
+      return true;
+   }
+
+   const hittable* closest = 0;
+   for (const auto& object : objects)
+   {
+      if (object->intersect(r, min_t, closest_so_far, temp_rec))
+      {
+         closest_so_far = temp_rec.t;
+         rec = temp_rec;
+         closest = object.get();
       }
    }
 
-   return hit_anything;
+   if (!closest) return false;
+   closest->complete_hit(r, rec);
+   rec.object = closest;
+   return true;
 }
 
-#endif
+bool hittable_list::occluded(const ray& r, float min_t, float max_t) const
+{
+   RT_COUNT(rays);
+
+   if (accelerated)
+   {
+      auto leaf = [&](int offset, int count, float leaf_min_t, float leaf_max_t) -> bool
+      {
+         for (int i = offset; i < offset + count; i++)
+         {
+            if (bounded_copies.occluded(bounded_refs[i], r, leaf_min_t, leaf_max_t)) return true;
+         }
+         return false;
+      };
+
+      if (accel.occluded(r, min_t, max_t, leaf)) return true;
 
+      return unbounded_copies.occluded_any(r, min_t, max_t);
+   }
+
+   for (const auto& object : objects)
+   {
+      if (object->occluded(r, min_t, max_t)) return true;
+   }
+   return false;
+}
+
+#endif
@@ -0,0 +1,91 @@
+// instance.h, shared geometry placed in the scene by a transform
+// An instance refers to an object (e.g. a triangle_mesh) in its own object space and holds the
+// 4x4 transform that places it in the world, with its inverse. Rays are taken into object space by
+// the inverse, traced there, and the hit is brought back by the transform, so a thousand copies of
+// a mesh cost a thousand transforms and one mesh. Ray directions are not normalized in object
+// space, so hit times are the same in both spaces.
+
+#ifndef INSTANCE_H_
+#define INSTANCE_H_
+
+#include "AGLM.h"
+#include "hittable.h"
+#include <memory>
+
+class instance : public hittable {
+public:
+   instance() : mat_id(-1), bounded(false) { set_transform(glm::mat4(1.0f)); }
+
+   // place object by transform. A material m >= 0 replaces the materials of the object, so that
+   // copies of one mesh can differ in material.
+   instance(std::shared_ptr<hittable> object, const glm::mat4& transform, material_id m = -1) :
+      object(object), mat_id(m) {
+      set_transform(transform);
+   }
+
+   void set_transform(const glm::mat4& m);
+
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override {
+      return object->intersect(to_object(r), t_min, t_max, rec);
+   }
+
+   virtual void complete_hit(const ray& r, hit_record& rec) const override;
+
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override {
+      return object->occluded(to_object(r), t_min, t_max);
+   }
+
+   virtual bool bounding_box(aabb& output_box) const override {
+      output_box = box;
+      return bounded;
+   }
+
+   // the ray in object space
+   ray to_object(const ray& r) const {
+      return ray(to_object_linear * r.orig + to_object_offset, to_object_linear * r.dir);
+   }
+
+public:
+   std::shared_ptr<hittable> object;
+   glm::mat4 transform;     // object space to world space
+   glm::mat4 inverse;       // world space to object space
+   glm::mat3 normal_matrix; // takes normals to world space: the inverse transpose of the linear part
+   glm::mat3 to_object_linear; // inverse, split for to_object()
+   glm::vec3 to_object_offset;
+   material_id mat_id;
+   aabb box;                // the transformed box of the object
+   bool bounded;
+};
+
+void instance::set_transform(const glm::mat4& m)
+{
+   transform = m;
+   inverse = glm::inverse(m);
+   to_object_linear = glm::mat3(inverse);
+   to_object_offset = glm::vec3(inverse[3]);
+   normal_matrix = glm::transpose(to_object_linear);
+
+   // the box around the eight transformed corners of the object's box
+   aabb local;
+   bounded = object && object->bounding_box(local);
+   box = aabb();
+   if (!bounded) return;
+   for (int corner = 0; corner < 8; corner++)
+   {
+      glm::point3 p((corner & 1) ? local.maximum.x : local.minimum.x,
+         (corner & 2) ? local.maximum.y : local.minimum.y, (corner & 4) ? local.maximum.z : local.minimum.z);
+      box.grow(glm::vec3(m * glm::vec4(p, 1.0f)));
+   }
+}
+
+void instance::complete_hit(const ray& r, hit_record& rec) const
+{
+   object->complete_hit(to_object(r), rec);
+   rec.p = r.at(rec.t);
+   // the object faced the normal against the object space ray; the transform keeps the sign of
+   // dot(direction, normal), so front_face still holds
+   rec.normal = glm::normalize(normal_matrix * rec.normal);
+   if (mat_id >= 0) rec.mat_id = mat_id;
+}
+
+#endif
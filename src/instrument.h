@@ -0,0 +1,78 @@
+// instrument.h, optional per-pixel counters of the render cost
+// Build with RT_INSTRUMENT defined (cmake -DRT_INSTRUMENT=ON) to count, for every pixel, the rays
+// cast into the world (camera, bounce and shadow rays), the intersection tests of primitives (each
+// mesh triangle is one test, and so is each plane or line that triangle::hit() builds), the path
+// bounces and the wall time. save_render_stats() (render.h) then writes them next to the beauty
+// image, with a false color heatmap of each. Without RT_INSTRUMENT, RT_COUNT() expands to nothing,
+// render() does not time pixels and save_render_stats() does nothing, so the counters cost nothing.
+
+#ifndef INSTRUMENT_H_
+#define INSTRUMENT_H_
+
+#include <cstdint>
+
+#ifdef RT_INSTRUMENT
+#include <vector>
+#endif
+
+// the counters of one pixel
+struct pixel_stats {
+   pixel_stats() : rays(0), tests(0), bounces(0), nanoseconds(0) {}
+
+   uint32_t rays;        // rays cast into the world
+   uint32_t tests;       // ray-primitive intersection tests
+   uint32_t bounces;     // path segments traced
+   uint64_t nanoseconds; // wall time spent on the pixel
+};
+
+#ifdef RT_INSTRUMENT
+
+// add one to a counter of the pixel the calling thread renders, e.g. RT_COUNT(tests)
+#define RT_COUNT(counter) (thread_pixel_stats().counter++)
+
+// add n to a counter, e.g. RT_ADD(tests, count) for a leaf whose primitives are tested at once
+#define RT_ADD(counter, n) (thread_pixel_stats().counter += (n))
+
+// the counters of the pixel the calling thread renders. render() clears them before each pixel
+// and stores them after it; counts made outside render() (tools, tests) are never read.
+inline pixel_stats& thread_pixel_stats()
+{
+   thread_local pixel_stats stats;
+   return stats;
+}
+
+// the counters of every pixel of the last render
+class render_stats {
+public:
+   render_stats() : width(0), height(0) {}
+
+   void resize(int w, int h) {
+      width = w;
+      height = h;
+      pixels.assign((size_t) w * h, pixel_stats());
+   }
+
+   // row j, column i, as in ppm_image
+   pixel_stats& at(int j, int i) { return pixels[(size_t) j * width + i]; }
+   const pixel_stats& at(int j, int i) const { return pixels[(size_t) j * width + i]; }
+
+public:
+   int width;
+   int height;
+   std::vector<pixel_stats> pixels;
+};
+
+inline render_stats& global_render_stats()
+{
+   static render_stats stats;
+   return stats;
+}
+
+#else
+
+#define RT_COUNT(counter) ((void) 0)
+#define RT_ADD(counter, n) ((void) 0)
+
+#endif
+
+#endif
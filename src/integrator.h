@@ -0,0 +1,484 @@
+// integrator.h, an iterative path tracer with Russian roulette
+// Replaces the recursive ray_color() of the ray tracers: instead of one stack frame per bounce, the
+// loop keeps the product of the attenuations so far (the throughput). After a few bounces, a path
+// survives each bounce with a probability that follows its throughput, and survivors are weighted
+// by one over that probability, so dim paths stop early without biasing the image
+// (see pbrt-v3, section 13.7).
+//
+// Surfaces made of an emitting material (e.g. diffuse_light) are lights. At every hit on a material
+// that samples lights (lambertian), the tracer also picks a point on a light and, unless a shadow
+// ray finds it blocked, adds the light it sends (next-event estimation). Light reaching the same
+// hit by the scattered ray is then counted twice over, so both estimates are weighted by the power
+// heuristic of multiple importance sampling (Veach 1997, chapter 9): a small light is found by its
+// sample, a large one as often by the scattered ray, and neither leaves fireflies. Only spheres and
+// disks can be sampled; other emitting objects are found by scattered rays alone.
+//
+// A hit is shaded by shade(), which switches on the kind of its material and runs the code of that
+// material class with no virtual call. trace_stream() traces many paths a bounce at a time, and
+// shades the hits of a bounce sorted by material, so each material runs over a batch of hits.
+
+#ifndef INTEGRATOR_H_
+#define INTEGRATOR_H_
+
+#include "AGLM.h"
+#include "ray.h"
+#include "material.h"
+#include "hittable_list.h"
+#include "denoise.h"
+#include "ray_stream.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// the color of rays that leave the scene
+typedef glm::color (*background_fn)(const ray& r);
+
+// a path being traced: the ray it follows next, and what it has gathered so far
+struct path_state {
+   path_state() : throughput(1.0f), result(0.0f), bounce(0), sampled(false), scattered_pdf(0) {}
+   explicit path_state(const ray& r) : r(r), throughput(1.0f), result(0.0f), bounce(0), sampled(false),
+      scattered_pdf(0) {}
+
+   ray r;
+   glm::color throughput; // the product of the attenuations so far
+   glm::color result;
+   int bounce;            // segments traced
+   // whether the last hit sampled the lights, and the density of the direction it scattered in
+   bool sampled;
+   float scattered_pdf;
+};
+
+// the paths and segments one thread traced for a path_tracer. Each thread adds to its own counts
+// with plain loads and stores, so no cache line goes from thread to thread on every path, and
+// average_path_length() adds them up once the threads are done.
+struct path_counts {
+   path_counts() : paths(0), segments(0), owner(std::this_thread::get_id()) {}
+
+   std::atomic<long long> paths;
+   std::atomic<long long> segments;
+   std::thread::id owner; // the thread that adds to them
+   char padding[104]; // keeps the counts of two threads off the same cache line
+};
+
+class path_tracer {
+public:
+   // paths end after max_depth segments; Russian roulette starts after rr_depth bounces
+   // The lights are the objects of w that can be sampled and emit; add none to w afterwards.
+   path_tracer(const hittable_list& w, background_fn bg, int max_depth = 10, int rr_depth = 3);
+
+   // the color seen along r; safe to call from several threads at once.
+   // The first hit of the path is left in thread_sample_features() for the denoiser.
+   glm::color trace(const ray& r) const;
+
+   // the same, for a path whose first hit was found already (e.g. by hit_stream()): hit tells
+   // whether r hits anything, and rec is that hit
+   glm::color trace(const ray& r, bool hit, const hit_record& rec) const;
+
+   // trace the paths of the samples together, a bounce at a time: the camera rays find their
+   // hits with hit_stream(), and the hits of each bounce are shaded sorted by material, so that
+   // the paths running the same scatter() follow each other. Each path draws from the random
+   // stream saved in its sample, so every sample gets the color that trace() gives it.
+   void trace_stream(std::vector<stream_sample>& samples) const;
+
+   // shade the hit rec of the path: add the light it gives off and the light sampled from it,
+   // and scatter the path. Returns false when the path ends there.
+   bool shade(path_state& path, const hit_record& rec) const;
+
+   // average number of segments (ray casts) per path traced so far; call it when no thread traces
+   double average_path_length() const;
+
+   void reset_stats();
+
+public:
+   const hittable_list& world;
+   background_fn background;
+   int max_depth;
+   int rr_depth;
+   bool sample_lights; // next-event estimation; without it, paths only find lights by chance
+   std::vector<const hittable*> lights;
+   std::vector<material_kind> kinds; // of each material of world, by material_id
+
+private:
+   // shade() for a material whose class M is known; M::scatter() and the others inline
+   template <class M>
+   bool shade_as(path_state& path, const hit_record& rec, const M& m) const;
+
+   // shade the hits of the paths from first to last - 1 of the ordered list, whose materials
+   // are all of class M (see trace_stream())
+   template <class M>
+   void shade_batch(const int* first, const int* last, std::vector<path_state>& paths,
+      std::vector<stream_sample>& samples, const ray_stream& stream, std::vector<char>& alive) const;
+
+   // the light sent toward the hit rec of r by a point picked on a light, weighted for MIS
+   template <class M>
+   glm::color sample_light(const ray& r, const hit_record& rec, const M& m) const;
+
+   // what the denoiser keeps of the first hit of a path
+   sample_features first_hit_features(const ray& r, bool hit, const hit_record& rec) const;
+
+   // add to the counts of the calling thread
+   void count_paths(long long paths, long long segments) const;
+
+   long long id; // tells tracers apart in the counts of a thread
+   mutable std::mutex counts_lock; // guards counts
+   mutable std::deque<path_counts> counts; // one per thread that traced, at fixed addresses
+};
+
+// the weight of an estimate drawn with density a, when another one draws with density b
+inline float power_heuristic(float a, float b)
+{
+   float a2 = a * a, b2 = b * b;
+   return a2 + b2 > 0 ? a2 / (a2 + b2) : 0.0f;
+}
+
+path_tracer::path_tracer(const hittable_list& w, background_fn bg, int max_depth, int rr_depth) :
+   world(w), background(bg), max_depth(max_depth), rr_depth(rr_depth), sample_lights(true)
+{
+   static std::atomic<long long> next_id(0);
+   id = next_id++;
+
+   for (const auto& object : world.objects)
+   {
+      material_id m = object->light_material();
+      if (m >= 0 && world.materials[m].emits()) lights.push_back(object.get());
+   }
+   for (int m = 0; m < world.materials.size(); m++)
+   {
+      kinds.push_back(world.materials[m].kind());
+   }
+}
+
+void path_tracer::count_paths(long long paths, long long segments) const
+{
+   // the counts of this thread for the tracer it last traced for, found without a lock while it
+   // keeps tracing for the same one; otherwise looked up among the counts of this tracer
+   thread_local long long cached_id = -1;
+   thread_local path_counts* cached = 0;
+   if (cached_id != id)
+   {
+      std::lock_guard<std::mutex> guard(counts_lock);
+      std::thread::id self = std::this_thread::get_id();
+      cached = 0;
+      for (path_counts& c : counts)
+      {
+         if (c.owner == self) cached = &c;
+      }
+      if (!cached)
+      {
+         counts.emplace_back();
+         cached = &counts.back();
+      }
+      cached_id = id;
+   }
+   path_counts* mine = cached;
+   mine->paths.store(mine->paths.load(std::memory_order_relaxed) + paths, std::memory_order_relaxed);
+   mine->segments.store(mine->segments.load(std::memory_order_relaxed) + segments, std::memory_order_relaxed);
+}
+
+double path_tracer::average_path_length() const
+{
+   std::lock_guard<std::mutex> guard(counts_lock);
+   long long paths = 0, segments = 0;
+   for (const path_counts& c : counts)
+   {
+      paths += c.paths.load(std::memory_order_relaxed);
+      segments += c.segments.load(std::memory_order_relaxed);
+   }
+   return paths == 0 ? 0.0 : segments / double(paths);
+}
+
+void path_tracer::reset_stats()
+{
+   std::lock_guard<std::mutex> guard(counts_lock);
+   for (path_counts& c : counts)
+   {
+      c.paths.store(0, std::memory_order_relaxed);
+      c.segments.store(0, std::memory_order_relaxed);
+   }
+}
+
+template <class M>
+glm::color path_tracer::sample_light(const ray& r, const hit_record& rec, const M& m) const
+{
+   // pick a point, and the light to put it on; the point takes the dimensions next to those of
+   // the scattered direction, so a sampler spreads the two pairs evenly together (see sampler.h)
+   float u[3];
+   random_floats(u, 3);
+   int n = (int) lights.size();
+   const hittable* light = lights[std::min(int(u[2] * n), n - 1)];
+   hit_record light_rec;
+   float pdf;
+   if (!light->sample_surface(rec.p, u[0], u[1], light_rec, pdf) || !(pdf > 0)) return glm::color(0);
+   pdf /= n;
+
+   glm::vec3 to_light = light_rec.p - rec.p;
+   float distance = glm::length(to_light);
+   glm::vec3 wi = to_light / distance;
+   glm::color f = m.eval(r, rec, wi);
+   glm::color emitted = world.materials[light_rec.mat_id].emitted(light_rec);
+   if (f == glm::color(0) || emitted == glm::color(0)) return glm::color(0);
+
+   // stop the shadow ray short of the light itself
+   if (world.occluded(ray(rec.p, wi), 0.001f, distance * 0.999f)) return glm::color(0);
+   float weight = power_heuristic(pdf, m.scatter_pdf(r, rec, wi));
+   return f * emitted * (weight / pdf);
+}
+
+sample_features path_tracer::first_hit_features(const ray& r, bool hit, const hit_record& rec) const
+{
+   sample_features features;
+   if (hit)
+   {
+      features.albedo = world.materials[rec.mat_id].base_color(rec);
+      features.normal = normalize(rec.normal);
+      features.depth = rec.t * glm::length(r.direction());
+   }
+   return features;
+}
+
+template <class M>
+bool path_tracer::shade_as(path_state& path, const hit_record& rec, const M& m) const
+{
+   const ray& r = path.r;
+   glm::color emitted = m.emitted(rec);
+   if (emitted != glm::color(0))
+   {
+      // the last hit may have sampled this light too
+      float weight = 1.0f;
+      if (path.sampled)
+      {
+         float light_pdf = rec.object->surface_pdf(r.origin(), rec) / lights.size();
+         weight = power_heuristic(path.scattered_pdf, light_pdf);
+      }
+      path.result += path.throughput * emitted * weight;
+   }
+
+   ray scattered;
+   glm::color attenuation;
+   if (!m.scatter(r, rec, world, attenuation, scattered))
+   {
+      // the material colors the path without bouncing (e.g. phong)
+      path.result += path.throughput * attenuation;
+      return false;
+   }
+
+   path.sampled = sample_lights && !lights.empty() && m.samples_lights();
+   if (path.sampled)
+   {
+      path.result += path.throughput * sample_light(r, rec, m);
+      path.scattered_pdf = m.scatter_pdf(r, rec, normalize(scattered.direction()));
+   }
+   path.throughput *= attenuation;
+
+   if (path.bounce >= rr_depth)
+   {
+      glm::color& throughput = path.throughput;
+      float survival = std::min(0.95f, std::max(throughput.r, std::max(throughput.g, throughput.b)));
+      if (random_float() >= survival)
+      {
+         return false;
+      }
+      throughput /= survival;
+   }
+   path.r = scattered;
+   return true;
+}
+
+bool path_tracer::shade(path_state& path, const hit_record& rec) const
+{
+   const material& m = world.materials[rec.mat_id];
+   switch (kinds[rec.mat_id])
+   {
+   case material_lambertian: return shade_as(path, rec, static_cast<const lambertian&>(m));
+   case material_light: return shade_as(path, rec, static_cast<const diffuse_light&>(m));
+   case material_phong: return shade_as(path, rec, static_cast<const phong&>(m));
+   case material_metal: return shade_as(path, rec, static_cast<const metal&>(m));
+   case material_dielectric: return shade_as(path, rec, static_cast<const dielectric&>(m));
+   default: return shade_as(path, rec, m);
+   }
+}
+
+glm::color path_tracer::trace(const ray& r) const
+{
+   hit_record rec;
+   bool hit = world.hit(r, 0.001f, infinity, rec);
+   return trace(r, hit, rec);
+}
+
+glm::color path_tracer::trace(const ray& r, bool first_hit, const hit_record& first_rec) const
+{
+   path_state path(r);
+   while (path.bounce < max_depth)
+   {
+      // draw the random numbers of this bounce from their own stream
+      thread_rng().start_bounce(path.bounce);
+      path.bounce++;
+      RT_COUNT(bounces);
+
+      // the first hit is given; intersection draws no random numbers, so finding it before
+      // start_bounce(0) changes nothing
+      hit_record rec;
+      bool hit;
+      if (path.bounce == 1)
+      {
+         rec = first_rec;
+         hit = first_hit;
+         thread_sample_features() = first_hit_features(path.r, hit, rec);
+      }
+      else
+      {
+         hit = world.hit(path.r, 0.001f, infinity, rec);
+      }
+      if (!hit)
+      {
+         path.result += path.throughput * background(path.r);
+         break;
+      }
+      if (!shade(path, rec)) break;
+   }
+
+   count_paths(1, path.bounce);
+   return path.result;
+}
+
+template <class M>
+void path_tracer::shade_batch(const int* first, const int* last, std::vector<path_state>& paths,
+   std::vector<stream_sample>& samples, const ray_stream& stream, std::vector<char>& alive) const
+{
+   for (const int* k = first; k != last; k++)
+   {
+      stream_sample& sample = samples[*k];
+      thread_rng() = sample.state;
+#ifdef RT_INSTRUMENT
+      thread_pixel_stats() = sample.stats;
+#endif
+      const hit_record& rec = stream.hits[*k];
+      alive[*k] = shade_as(paths[*k], rec, static_cast<const M&>(world.materials[rec.mat_id]));
+      sample.state = thread_rng();
+#ifdef RT_INSTRUMENT
+      sample.stats = thread_pixel_stats();
+#endif
+   }
+}
+
+void path_tracer::trace_stream(std::vector<stream_sample>& samples) const
+{
+   // kept from call to call, so that their arrays are allocated once per thread
+   thread_local ray_stream stream;
+   thread_local std::vector<path_state> paths;
+   thread_local std::vector<char> alive;
+   thread_local std::vector<int> active, order;
+
+   int n = (int) samples.size();
+   stream.resize(n);
+   paths.resize(n);
+   alive.assign(n, 1);
+   active.clear();
+   for (int k = 0; k < n; k++)
+   {
+      stream.set(k, samples[k].r, 0.001f, infinity);
+      paths[k] = path_state(samples[k].r);
+      samples[k].color = glm::color(0);
+      samples[k].features = sample_features();
+      samples[k].stats = pixel_stats();
+      if (max_depth > 0) active.push_back(k);
+   }
+
+   // the camera rays walk the bvh together; the walk is split evenly among the samples
+#ifdef RT_INSTRUMENT
+   thread_pixel_stats() = pixel_stats();
+#endif
+   hit_stream(world, stream);
+#ifdef RT_INSTRUMENT
+   pixel_stats shared = thread_pixel_stats();
+   for (int k = 0; k < n; k++)
+   {
+      samples[k].stats.rays = shared.rays / n;
+      samples[k].stats.tests = shared.tests / n;
+   }
+#endif
+
+   long long segments = 0;
+   int counts[material_kinds];
+   while (!active.empty())
+   {
+      // find the hits of this bounce: the camera rays have theirs, the others are traced alone.
+      // Finding hits draws no random numbers, so the stream of a sample is only moved on.
+      for (int& count : counts) count = 0;
+      for (int k : active)
+      {
+         stream_sample& sample = samples[k];
+         path_state& path = paths[k];
+#ifdef RT_INSTRUMENT
+         thread_pixel_stats() = sample.stats;
+#endif
+         sample.state.start_bounce(path.bounce);
+         path.bounce++;
+         RT_COUNT(bounces);
+         if (path.bounce == 1)
+         {
+            sample.features = first_hit_features(path.r, stream.hit(k), stream.hits[k]);
+         }
+         else
+         {
+            stream.closest[k] = world.hit(path.r, 0.001f, infinity, stream.hits[k]) ? stream.hits[k].object : 0;
+         }
+#ifdef RT_INSTRUMENT
+         sample.stats = thread_pixel_stats();
+#endif
+         if (stream.hit(k))
+         {
+            counts[kinds[stream.hits[k].mat_id]]++;
+         }
+         else
+         {
+            path.result += path.throughput * background(path.r);
+            alive[k] = 0;
+         }
+      }
+
+      // bin the hits by the kind of their material (a counting sort, which keeps their order),
+      // and shade each bin in a loop of its own
+      int starts[material_kinds + 1] = {0};
+      for (int kind = 0; kind < material_kinds; kind++) starts[kind + 1] = starts[kind] + counts[kind];
+      order.resize(starts[material_kinds]);
+      int next[material_kinds];
+      std::copy(starts, starts + material_kinds, next);
+      for (int k : active)
+      {
+         if (stream.hit(k)) order[next[kinds[stream.hits[k].mat_id]]++] = k;
+      }
+      const int* bins = order.data();
+      shade_batch<material>(bins + starts[material_other], bins + starts[material_other + 1], paths, samples, stream, alive);
+      shade_batch<lambertian>(bins + starts[material_lambertian], bins + starts[material_lambertian + 1], paths, samples,
+         stream, alive);
+      shade_batch<diffuse_light>(bins + starts[material_light], bins + starts[material_light + 1], paths, samples,
+         stream, alive);
+      shade_batch<phong>(bins + starts[material_phong], bins + starts[material_phong + 1], paths, samples, stream, alive);
+      shade_batch<metal>(bins + starts[material_metal], bins + starts[material_metal + 1], paths, samples, stream, alive);
+      shade_batch<dielectric>(bins + starts[material_dielectric], bins + starts[material_dielectric + 1], paths,
+         samples, stream, alive);
+
+      // the paths that end here are done
+      size_t kept = 0;
+      for (int k : active)
+      {
+         if (alive[k] && paths[k].bounce < max_depth)
+         {
+            active[kept++] = k;
+            continue;
+         }
+         samples[k].color = paths[k].result;
+         segments += paths[k].bounce;
+      }
+      active.resize(kept);
+   }
+
+   count_paths(n, segments);
+}
+
+#endif
@@ -6,8 +6,19 @@
 #include "box.h"
 #include "plane.h"
 #include "triangle.h"
+#include "triangle_mesh.h"
+#include "sphere_set.h"
+#include "simd.h"
+#include "mesh_loader.h"
+#include "scene_file.h"
 #include "line.h"
 #include "hittable.h"
+#include "hittable_list.h"
+#include "render.h"
+#include "integrator.h"
+#include "sampler.h"
+#include <cstdio>
+#include <fstream>
 
 using namespace glm;
 using namespace std;
@@ -39,7 +50,7 @@ void check(bool val, const std::string& message, const hit_record& hit, const ra
 
 void test_sphere(const sphere& s, const ray& r, bool hits, const hit_record& desired) {
    hit_record hit;
-   bool result = s.hit(r, hit);
+   bool result = s.hit(r, 0.0f, infinity, hit);
 
    check(result == hits, "error: ray should/shouldn't hit", hit, r);
    if (hits) {
@@ -52,7 +63,7 @@ void test_sphere(const sphere& s, const ray& r, bool hits, const hit_record& des
 
 void test_plane(const plane& p, const ray& r, bool hits, const hit_record& desired) {
    hit_record hit;
-   bool result = p.hit(r, hit);
+   bool result = p.hit(r, 0.0f, infinity, hit);
 
    check(result == hits, "error: ray should/shouldn't hit", hit, r);
    if (hits) {
@@ -65,7 +76,7 @@ void test_plane(const plane& p, const ray& r, bool hits, const hit_record& desir
 
 void test_triangle(const triangle& T, const ray& r, bool hits, const hit_record& desired) {
    hit_record hit;
-   bool result = T.hit(r, hit);
+   bool result = T.hit(r, 0.0f, infinity, hit);
 
    check(result == hits, "error: ray should/shouldn't hit", hit, r);
    if (hits) {
@@ -78,7 +89,7 @@ void test_triangle(const triangle& T, const ray& r, bool hits, const hit_record&
 
 void test_line(const line& l, const ray& r, bool hits, const hit_record& desired) {
    hit_record hit;
-   bool result = l.hit(r, hit);
+   bool result = l.hit(r, 0.0f, infinity, hit);
 
    check(result == hits, "error: ray should/shouldn't hit", hit, r);
    if (hits) {
@@ -89,9 +100,999 @@ void test_line(const line& l, const ray& r, bool hits, const hit_record& desired
    }
 }
 
+void test_bounding_box(const hittable& h, bool bounded, const aabb& desired) {
+   aabb box;
+   bool result = h.bounding_box(box);
+
+   assert(result == bounded && "error: object should/shouldn't be bounded");
+   if (bounded) {
+      assert(vecEquals(box.min(), desired.min()) && "error: box minimum incorrect");
+      assert(vecEquals(box.max(), desired.max()) && "error: box maximum incorrect");
+   }
+}
+
+// the bvh must find the same closest hits as testing every object
+void test_bvh(hittable_list& world, int num_rays) {
+   for (int i = 0; i < num_rays; i++) {
+      ray r(5.0f * random_unit_cube(), random_unit_sphere());
+
+      hit_record expected, hit;
+      world.clear_bvh();
+      bool expected_result = world.hit(r, 0.001f, infinity, expected);
+      world.build_bvh();
+      bool result = world.hit(r, 0.001f, infinity, hit);
+
+      check(result == expected_result, "error: bvh should/shouldn't hit", hit, r);
+      if (expected_result) {
+         check(equals(hit.t, expected.t), "error: bvh hit time incorrect", hit, r);
+      }
+   }
+}
+
+// hits outside [t_min, t_max] are rejected, and a sphere falls back to its far side
+void test_interval() {
+   material_id empty = -1;
+   sphere s(point3(0), 2.0f, empty);
+   plane p(point3(0), vec3(0,0,1), empty);
+   triangle T(point3(-1,-1,0), point3(1,-1,0), point3(0,1,0), empty);
+   ray r(point3(0, 0, 3), vec3(0, 0, -1)); // enters the sphere at t = 1, crosses z = 0 at t = 3, leaves at t = 5
+
+   hit_record hit;
+   check(s.hit(r, 0.0f, infinity, hit) && equals(hit.t, 1.0f), "error: sphere should be hit at its near side", hit, r);
+   check(s.hit(r, 2.0f, infinity, hit) && equals(hit.t, 5.0f) && !hit.front_face, "error: sphere should be hit at its far side", hit, r);
+   check(!s.hit(r, 0.0f, 0.5f, hit), "error: sphere is beyond t_max", hit, r);
+   check(!s.hit(r, 5.5f, infinity, hit), "error: sphere is before t_min", hit, r);
+   check(p.hit(r, 0.0f, 3.0f, hit) && equals(hit.t, 3.0f), "error: plane should be hit at t_max", hit, r);
+   check(!p.hit(r, 0.0f, 2.9f, hit), "error: plane is beyond t_max", hit, r);
+   check(!p.hit(r, 3.1f, infinity, hit), "error: plane is before t_min", hit, r);
+   check(T.hit(r, 2.9f, 3.1f, hit) && equals(hit.t, 3.0f), "error: triangle should be hit", hit, r);
+   check(!T.hit(r, 0.0f, 2.9f, hit), "error: triangle is beyond t_max", hit, r);
+}
+
+// an oriented box: hits on its faces from outside and inside, its bounds, and occlusion
+void test_box(int num_rays) {
+   material_id empty = -1;
+   // 2 x 4 x 6, turned 45 degrees about z
+   vec3 u = normalize(vec3(1, 1, 0)), v = normalize(vec3(-1, 1, 0)), w(0, 0, 1);
+   box b(point3(1, 2, 3), u, v, w, u, 2.0f * v, 3.0f * w, empty);
+
+   hit_record hit;
+   ray down(point3(1, 2, 10), vec3(0, 0, -1)); // enters the top face at t = 4, leaves the bottom at t = 10
+   check(b.hit(down, 0.0f, infinity, hit) && equals(hit.t, 4.0f) && hit.front_face &&
+      vecEquals(hit.normal, vec3(0, 0, 1)), "error: box should be hit on its top face", hit, down);
+   check(b.hit(down, 5.0f, infinity, hit) && equals(hit.t, 10.0f) && !hit.front_face,
+      "error: box should be hit at its far side", hit, down);
+   check(!b.hit(down, 0.0f, 3.5f, hit) && !b.occluded(down, 0.0f, 3.5f), "error: box is beyond t_max", hit, down);
+   ray along(point3(1, 2, 3) - 5.0f * u, u); // enters the face of u at t = 4
+   check(b.hit(along, 0.0f, infinity, hit) && equals(hit.t, 4.0f) && vecEquals(hit.normal, -u),
+      "error: box should be hit on the face of its first axis", hit, along);
+   ray past(point3(1, 2, 3) + 1.5f * u - 5.0f * v, v); // misses the box beside its face
+   check(!b.hit(past, 0.0f, infinity, hit), "error: ray beside the box should miss", hit, past);
+
+   // the bounds hold every hit, and occlusion agrees with hits
+   aabb bounds;
+   assert(b.bounding_box(bounds) && "error: a box is bounded");
+   for (int i = 0; i < num_rays; i++) {
+      ray r(point3(1, 2, 3) + 8.0f * random_unit_cube(), random_unit_sphere());
+      bool result = b.hit(r, 0.001f, infinity, hit);
+      check(b.occluded(r, 0.001f, infinity) == result, "error: box occluded should/shouldn't hit", hit, r);
+      if (!result) continue;
+      for (int a = 0; a < 3; a++) {
+         assert(hit.p[a] >= bounds.minimum[a] - 1e-3f && hit.p[a] <= bounds.maximum[a] + 1e-3f &&
+            "error: box hit outside its bounds");
+      }
+      // the hit lies on the face the normal belongs to
+      vec3 n = hit.normal;
+      float half = std::fabs(dot(n, u)) + 2.0f * std::fabs(dot(n, v)) + 3.0f * std::fabs(dot(n, w));
+      check(std::fabs(std::fabs(dot(hit.p - b.c, n)) - half) < 1e-3f, "error: box hit off the face of its normal", hit, r);
+   }
+}
+
+// occluded() must agree with the closest hit: nothing blocks the ray before it, and it blocks the ray
+void test_occluded(hittable_list& world, int num_rays) {
+   for (int accelerated = 0; accelerated < 2; accelerated++) {
+      if (accelerated) world.build_bvh();
+      else world.clear_bvh();
+
+      for (int i = 0; i < num_rays; i++) {
+         ray r(5.0f * random_unit_cube(), random_unit_sphere());
+
+         hit_record hit;
+         bool result = world.hit(r, 0.001f, infinity, hit);
+         check(world.occluded(r, 0.001f, infinity) == result, "error: occluded should/shouldn't hit", hit, r);
+         if (result) {
+            check(!world.occluded(r, 0.001f, 0.999f * hit.t), "error: occluded before the closest hit", hit, r);
+            check(world.occluded(r, 0.001f, 1.001f * hit.t), "error: not occluded at the closest hit", hit, r);
+         }
+      }
+   }
+}
+
+// objects refer to the materials of their scene by index
+void test_material_table() {
+   hittable_list world;
+   shared_ptr<material> red = make_shared<lambertian>(color(1,0,0));
+   material_id first = world.materials.add(red);
+   material_id second = world.materials.add(make_shared<metal>(color(1), 0.0f));
+   assert(first == 0 && second == 1 && "error: material ids should follow the order of addition");
+   assert(world.materials.add(red) == first && "error: a material added twice should keep its id");
+   assert(&world.materials[first] == red.get() && "error: wrong material for id");
+
+   world.add(make_shared<sphere>(point3(0), 1.0f, second));
+   hit_record rec;
+   assert(world.hit(ray(point3(0,0,3), vec3(0,0,-1)), 0.001f, infinity, rec) && rec.mat_id == second &&
+      "error: hit record should carry the material id");
+}
+
+// a mesh must find the same closest hit as the same triangles added one by one
+void test_triangle_mesh(int num_triangles, int num_rays) {
+   material_id empty = -1;
+   hittable_list triangles;
+   triangle_mesh mesh(empty);
+   for (int i = 0; i < num_triangles; i++) {
+      point3 a = 4.0f * random_unit_cube();
+      point3 b = a + 0.5f * random_unit_sphere();
+      point3 c = a + 0.5f * random_unit_sphere();
+      triangles.add(make_shared<triangle>(a, b, c, empty));
+      mesh.add_triangle(a, b, c);
+   }
+   mesh.build();
+   assert(mesh.num_triangles() == num_triangles && "error: mesh lost triangles");
+
+   for (int i = 0; i < num_rays; i++) {
+      ray r(5.0f * random_unit_cube(), random_unit_sphere());
+
+      hit_record expected, hit;
+      bool expected_result = triangles.hit(r, 0.001f, infinity, expected);
+      bool result = mesh.hit(r, 0.001f, infinity, hit);
+
+      check(result == expected_result, "error: mesh should/shouldn't hit", hit, r);
+      if (expected_result) {
+         check(equals(hit.t, expected.t), "error: mesh hit time incorrect", hit, r);
+         check(vecEquals(hit.normal, expected.normal), "error: mesh normal incorrect", hit, r);
+      }
+   }
+}
+
+// every kernel of simd.h the CPU runs against the scalar ones, on leaves of random sizes: the same
+// nearest primitive and the same time, bit for bit; and a sphere_set against sphere objects
+void test_simd_kernels(int num_prims, int num_rays) {
+   soa_array spheres, tris;
+   spheres.resize(num_prims, sphere_components);
+   tris.resize(num_prims, triangle_components);
+   hittable_list objects;
+   sphere_set set;
+   for (int i = 0; i < num_prims; i++) {
+      point3 c = 4.0f * random_unit_cube();
+      float radius = random_float(0.05f, 0.5f);
+      spheres[sphere_cx][i] = c.x;
+      spheres[sphere_cy][i] = c.y;
+      spheres[sphere_cz][i] = c.z;
+      spheres[sphere_r2][i] = radius * radius;
+      objects.add(make_shared<sphere>(c, radius, i));
+      set.add(c, radius, i);
+
+      vec3 e1 = 0.5f * random_unit_sphere(), e2 = 0.5f * random_unit_sphere();
+      for (int axis = 0; axis < 3; axis++) {
+         tris[triangle_v0x + axis][i] = c[axis];
+         tris[triangle_e1x + axis][i] = e1[axis];
+         tris[triangle_e2x + axis][i] = e2[axis];
+      }
+   }
+   objects.build_bvh();
+   set.build();
+   assert(set.size() == num_prims && "error: sphere set lost spheres");
+
+   const simd_kernels& scalar = kernels(simd_scalar);
+   for (int level = simd_scalar; level <= detected_simd_level(); level++) {
+      const simd_kernels& k = kernels((simd_level) level);
+      for (int i = 0; i < num_rays; i++) {
+         int count = 1 + (int) (random_float() * 20);
+         int first = (int) (random_float() * (num_prims - count));
+         float t_max = random_float() < 0.5f ? infinity : random_float(1.0f, 8.0f);
+
+         // aim near a primitive of the leaf, so that most rays hit something; the direction is not
+         // of unit length
+         int target = first + (int) (random_float() * count);
+         point3 aim = point3(spheres[sphere_cx][target], spheres[sphere_cy][target], spheres[sphere_cz][target]) +
+            0.3f * random_unit_cube();
+         point3 origin = 5.0f * random_unit_cube();
+         ray r(origin, (aim - origin) * random_float(0.5f, 2.0f));
+
+         float expected_t = t_max, t = t_max;
+         int expected = scalar.nearest_sphere(spheres, first, count, r, 0.001f, expected_t);
+         int nearest = k.nearest_sphere(spheres, first, count, r, 0.001f, t);
+         assert(nearest == expected && t == expected_t && "error: sphere kernels disagree");
+
+         expected_t = t = t_max;
+         expected = scalar.nearest_triangle(tris, first, count, r, 0.001f, expected_t);
+         nearest = k.nearest_triangle(tris, first, count, r, 0.001f, t);
+         assert(nearest == expected && t == expected_t && "error: triangle kernels disagree");
+      }
+   }
+
+   for (int i = 0; i < num_rays; i++) {
+      ray r(5.0f * random_unit_cube(), random_unit_sphere());
+      hit_record expected, hit;
+      bool expected_result = objects.hit(r, 0.001f, infinity, expected);
+      bool result = set.hit(r, 0.001f, infinity, hit);
+      check(result == expected_result, "error: sphere set should/shouldn't hit", hit, r);
+      check(set.occluded(r, 0.001f, infinity) == expected_result, "error: sphere set occlusion incorrect", hit, r);
+      if (expected_result) {
+         check(equals(hit.t, expected.t), "error: sphere set hit time incorrect", hit, r);
+         check(vecEquals(hit.normal, expected.normal), "error: sphere set normal incorrect", hit, r);
+         check(hit.mat_id == expected.mat_id, "error: sphere set material incorrect", hit, r);
+      }
+   }
+}
+
+void write_file(const std::string& filename, const std::string& contents) {
+   std::ofstream file(filename.c_str(), std::ios::binary);
+   file.write(contents.data(), contents.size());
+}
+
+// append a value to a binary ply body, in little or big endian order
+template <class T>
+void put_binary(std::string& out, T value, bool big_endian) {
+   char bytes[sizeof(T)];
+   memcpy(bytes, &value, sizeof(T));
+   uint16_t one = 1;
+   if (big_endian == (*(const char*) &one == 1)) std::reverse(bytes, bytes + sizeof(T));
+   out.append(bytes, sizeof(T));
+}
+
+// a square (as a quad, split in two) and a triangle, in every supported file flavor
+void test_load_mesh() {
+   // the quad 0 1 2 3 and the triangle 1 4 2
+   vector<point3> vertices = { point3(0,0,0), point3(1,0,0), point3(1,1,0), point3(0,1,0), point3(2,0.5f,-1.25e-1f) };
+   vector<int> indices = { 0,1,2, 0,2,3, 1,4,2 };
+
+   std::string obj =
+      "# comment\n"
+      "o square\n"
+      "v 0 0 0\n"
+      "v 1.0 0 0\r\n"
+      "v\t1 1 0 1.0\n"
+      "v 0 1e0 -0\n"
+      "vn 0 0 1\n"
+      "vt 0.5 0.5\n"
+      "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+      "v 2 .5 -1.25E-1\n"
+      "usemtl gray\n"
+      "f -4//1 -1//1 -3//1 # relative indices\n";
+   std::string ply_header =
+      "ply\n"
+      "format %s 1.0\n"
+      "comment made by hand\n"
+      "element vertex 5\n"
+      "property float x\n"
+      "property float y\n"
+      "property float z\n"
+      "property uchar red\n"
+      "element face 2\n"
+      "property list uchar int vertex_indices\n"
+      "property int flags\n"
+      "end_header\n";
+
+   for (int flavor = 0; flavor < 4; flavor++) {
+      std::string filename = flavor == 0 ? "test_mesh.obj" : "test_mesh.ply";
+      if (flavor == 0) {
+         write_file(filename, obj);
+      }
+      else {
+         const char* formats[] = { "ascii", "binary_little_endian", "binary_big_endian" };
+         char header[512];
+         snprintf(header, sizeof(header), ply_header.c_str(), formats[flavor - 1]);
+         std::string ply = header;
+         bool big = flavor == 3;
+         for (const point3& v : vertices) {
+            if (flavor == 1) ply += std::to_string(v.x) + " " + std::to_string(v.y) + " " + std::to_string(v.z) + " 255\n";
+            else { put_binary(ply, v.x, big); put_binary(ply, v.y, big); put_binary(ply, v.z, big); put_binary(ply, (uint8_t) 255, big); }
+         }
+         if (flavor == 1) ply += "4 0 1 2 3 7\n3 1 4 2 7\n";
+         else {
+            put_binary(ply, (uint8_t) 4, big);
+            for (int i : { 0, 1, 2, 3 }) put_binary(ply, i, big);
+            put_binary(ply, 7, big);
+            put_binary(ply, (uint8_t) 3, big);
+            for (int i : { 1, 4, 2 }) put_binary(ply, i, big);
+            put_binary(ply, 7, big);
+         }
+         write_file(filename, ply);
+      }
+
+      // meshes are appended to, so load after an existing triangle
+      triangle_mesh mesh;
+      mesh.add_triangle(point3(0), point3(1,0,0), point3(0,1,0));
+      assert(load_mesh(filename, mesh) && "error: mesh should load");
+      assert(mesh.vertices.size() == 3 + vertices.size() && "error: wrong number of vertices");
+      assert(mesh.indices.size() == 3 + indices.size() && "error: wrong number of indices");
+      for (size_t i = 0; i < vertices.size(); i++) {
+         assert(vecEquals(mesh.vertices[3 + i], vertices[i]) && "error: wrong vertex");
+      }
+      for (size_t i = 0; i < indices.size(); i++) {
+         assert(mesh.indices[3 + i] == 3 + indices[i] && "error: wrong index");
+      }
+      remove(filename.c_str());
+   }
+
+   // many chunks parsed in parallel must give the same mesh as one thread
+   std::string big;
+   for (int i = 0; i < 40000; i++) {
+      big += "v " + std::to_string(i) + " " + std::to_string(0.5f * i) + " -1.5\n";
+      if (i >= 2) big += i % 2 ? "f -3 -2 -1\n" : "f " + std::to_string(i - 1) + " " + std::to_string(i) + " " + std::to_string(i + 1) + "\n";
+   }
+   write_file("test_mesh.obj", big);
+   triangle_mesh serial, parallel;
+   assert(load_obj("test_mesh.obj", serial, 1) && load_obj("test_mesh.obj", parallel, 4) && "error: mesh should load");
+   assert(serial.num_triangles() == 39998 && "error: wrong number of triangles");
+   assert(serial.vertices == parallel.vertices && serial.indices == parallel.indices && "error: parallel load differs");
+
+   // errors leave the mesh unchanged
+   write_file("test_mesh.obj", "v 0 0 0\nv 1 0 0\nf 1 2 3\n");
+   triangle_mesh bad;
+   assert(!load_obj("test_mesh.obj", bad) && bad.vertices.empty() && "error: index out of range should fail");
+   // an index too big for an int must not wrap around to a vertex that exists
+   write_file("test_mesh.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4294967299\n");
+   assert(!load_obj("test_mesh.obj", bad) && bad.vertices.empty() && "error: huge index should fail");
+   remove("test_mesh.obj");
+   assert(!load_mesh("no_such_mesh.ply", bad) && "error: missing file should fail");
+
+   // a vertex count the data cannot hold fails before anything is allocated for it
+   write_file("test_mesh.ply", "ply\nformat binary_little_endian 1.0\nelement vertex 4000000000000000\n"
+      "property float x\nproperty float y\nproperty float z\nend_header\n0123456789ab");
+   assert(!load_mesh("test_mesh.ply", bad) && bad.vertices.empty() && "error: huge vertex count should fail");
+   remove("test_mesh.ply");
+}
+
+// a text scene, its compiled form and the cached load must give the same world
+void test_scene_file() {
+   write_file("test_scene_mesh.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n");
+   write_file("test_scene.scene",
+      "# every statement\n"
+      "camera lookat 0 0 5  0 0 0  0 1 0  60 0.1\n"
+      "material gray lambertian 0.5 0.5 0.5\n"
+      "material red metal 1 0 0 0.3   # comment\n"
+      "material glass dielectric 1.5\n"
+      "material shiny phong 0 0 5\n"
+      "material wall phong 0.2 0.2 0.4  1 1 1  0.01 0.01 0.01  0 5 0  0 0 5  0.45 0.45 0.1 20 noshadows\n"
+      "\n"
+      "sphere 0 0 0  1  gray\n"
+      "plane 0 -2 0  0 1 0  wall\n"
+      "push\n"
+      "translate 3 0 0\n"
+      "scale 2\n"
+      "sphere 0 0 0  0.5  red\n"
+      "triangle -1 -1 1  1 -1 1  0 1 1  glass\n"
+      "pop\n"
+      "line -3 0 0  -3 1 0  shiny\n"
+      "rotate 0 90 0\n"
+      "circle 0 0 -3  1  90 0 0  gray\n"
+      "mesh test_scene_mesh.obj red\n"
+      "disk 0 3 0  0 1 0  0.5 1  gray\n");
+
+   hittable_list parsed;
+   scene_camera cam;
+   std::vector<std::string> sources;
+   assert(parse_scene("test_scene.scene", parsed, cam, 1, &sources) && "error: scene should parse");
+   assert(parsed.objects.size() == 8 && parsed.materials.size() == 5 && "error: wrong number of objects or materials");
+   assert(parsed.accelerated && "error: parsed scene should have a bvh");
+   assert(cam.defined && cam.look_at && equals(cam.vfov, 60.0f) && equals(cam.aperture, 0.1f) &&
+      equals(cam.focus_dist, 5.0f) && "error: wrong camera");
+   assert(sources.size() == 2 && "error: the scene and its mesh are its sources");
+
+   // transforms: the small sphere is moved to x = 3 and scaled to radius 1
+   const sphere* moved = dynamic_cast<const sphere*>(parsed.objects[2].get());
+   assert(moved && vecEquals(moved->center, point3(3,0,0)) && equals(moved->radius, 1.0f) && "error: sphere not transformed");
+   const triangle* T = dynamic_cast<const triangle*>(parsed.objects[3].get());
+   assert(T && vecEquals(T->a, point3(1,-2,2)) && "error: triangle not transformed");
+   hit_record rec;
+   assert(parsed.hit(ray(point3(0,0,5), vec3(0,0,-1)), 0.001f, infinity, rec) && equals(rec.t, 4.0f) &&
+      rec.mat_id == 0 && "error: parsed scene hit incorrect");
+   assert(parsed.hit(ray(point3(3,-2,5), vec3(0,0,-1)), 0.001f, infinity, rec) && equals(rec.t, 3.0f) &&
+      rec.mat_id == 2 && "error: transformed triangle should be hit");
+
+   // the compiled scene traces like the parsed one
+   assert(save_compiled_scene("test_scene.bin", parsed, cam, sources) && "error: scene should compile");
+   assert(compiled_scene_current("test_scene.bin") && "error: compiled scene should be current");
+   hittable_list loaded;
+   scene_camera loaded_cam;
+   assert(load_compiled_scene("test_scene.bin", loaded, loaded_cam) && "error: compiled scene should load");
+   assert(loaded.objects.size() == parsed.objects.size() && loaded.materials.size() == parsed.materials.size() &&
+      loaded.accelerated && "error: compiled scene differs");
+   assert(loaded_cam.look_at && vecEquals(loaded_cam.position, cam.position) && equals(loaded_cam.aperture, cam.aperture) &&
+      "error: compiled camera differs");
+   const phong* wall = dynamic_cast<const phong*>(&loaded.materials[4]);
+   assert(wall && !wall->shadows && vecEquals(wall->diffuseColor, color(0.2f,0.2f,0.4f)) && "error: compiled phong differs");
+   for (int i = 0; i < 2000; i++) {
+      ray r(5.0f * random_unit_cube(), random_unit_sphere());
+      hit_record expected, hit;
+      bool expected_result = parsed.hit(r, 0.001f, infinity, expected);
+      bool result = loaded.hit(r, 0.001f, infinity, hit);
+      check(result == expected_result, "error: compiled scene should/shouldn't hit", hit, r);
+      if (expected_result) {
+         check(hit.t == expected.t && hit.mat_id == expected.mat_id && vecEquals(hit.normal, expected.normal),
+            "error: compiled scene hit differs", hit, r);
+      }
+      check(loaded.occluded(r, 0.001f, infinity) == expected_result, "error: compiled scene occlusion differs", hit, r);
+   }
+
+   // load_scene() writes the compiled copy, and a changed scene makes it stale
+   remove("test_scene.scene.bin");
+   hittable_list cached;
+   assert(load_scene("test_scene.scene", cached, cam) && compiled_scene_current("test_scene.scene.bin") &&
+      "error: load_scene should write a compiled copy");
+   assert(load_scene("test_scene.scene.bin", cached, cam) && cached.objects.size() == 8 && "error: compiled copy should load");
+   write_file("test_scene.scene", "sphere 0 0 0 1 gray\n");
+   assert(!compiled_scene_current("test_scene.scene.bin") && "error: compiled copy should be stale");
+
+   // errors leave the world unchanged
+   assert(!load_scene("test_scene.scene", cached, cam) && cached.objects.size() == 8 && "error: unknown material should fail");
+   write_file("test_scene.scene", "material gray lambertian 0.5 0.5\n");
+   assert(!parse_scene("test_scene.scene", cached, cam) && "error: missing value should fail");
+   write_file("test_scene.scene", "pop\n");
+   assert(!parse_scene("test_scene.scene", cached, cam) && "error: pop without push should fail");
+   write_file("test_scene.bin", "RTSCENE\nbroken");
+   assert(!load_compiled_scene("test_scene.bin", cached, cam) && cached.objects.size() == 8 && "error: bad compiled scene should fail");
+
+   remove("test_scene.scene");
+   remove("test_scene.scene.bin");
+   remove("test_scene.bin");
+   remove("test_scene_mesh.obj");
+}
+
+// a (pixel, sample) stream must replay exactly, and the batch API must match single draws
+void test_rng() {
+   rng a, b;
+   a.seed(42, 3);
+   b.seed(42, 3);
+   float batch[8];
+   b.fill(batch, 8);
+   for (int i = 0; i < 8; i++) {
+      float u = a.next_float();
+      assert(u == batch[i] && "error: batch and single draws differ");
+      assert(u >= 0.0f && u < 1.0f && "error: uniform out of range");
+   }
+
+   a.seed(42, 3);
+   a.start_bounce(1);
+   b.seed(42, 4);
+   b.start_bounce(1);
+   assert(a.next_uint() != b.next_uint() && "error: samples should have distinct streams");
+}
+
+// the noise estimate of adaptive sampling: none for equal samples, and shrinking with more samples
+void test_pixel_variance() {
+   pixel_variance flat;
+   for (int i = 0; i < 4; i++) flat.add(color(0.5f));
+   assert(flat.noise() == 0 && "error: equal samples should have no noise");
+
+   pixel_variance one;
+   one.add(color(0.5f));
+   assert(one.noise() == infinity && "error: one sample cannot estimate the noise");
+
+   pixel_variance few, many;
+   for (int i = 0; i < 64; i++) {
+      color c((i % 2) ? 1.0f : 0.0f);
+      if (i < 4) few.add(c);
+      many.add(c);
+   }
+   assert(near_zero(many.mean - 0.5f) && "error: wrong mean");
+   assert(many.noise() < few.noise() && "error: noise should shrink with more samples");
+
+   // with the spread of noisy neighbors as a prior, agreeing samples are not converged at once,
+   // and the prior fades as they go on agreeing
+   pixel_variance black, blacker;
+   for (int i = 0; i < 64; i++) {
+      if (i < 4) black.add(color(0));
+      blacker.add(color(0));
+   }
+   float prior = few.spread();
+   assert(black.noise() == 0 && black.noise(prior, 2) > 0.01f && "error: a prior should keep agreeing samples noisy");
+   assert(blacker.noise(prior, 2) < black.noise(prior, 2) && "error: a prior should fade with more samples");
+}
+
+// the denoiser must smooth noise within a surface without blurring across an albedo edge
+void test_denoise() {
+   const int size = 32;
+   feature_buffers buffers;
+   buffers.resize(size, size);
+   for (int j = 0; j < size; j++) {
+      for (int i = 0; i < size; i++) {
+         size_t p = (size_t) j * size + i;
+         float noise = ((i * 7 + j * 13) % 5 - 2) * 0.05f;
+         buffers.albedo[p] = i < size / 2 ? color(0.8f) : color(0.2f, 0.4f, 0.8f);
+         buffers.color[p] = buffers.albedo[p] * (0.5f + noise);
+         buffers.variance[p] = 0.01f;
+         buffers.normal[p] = vec3(0, 0, 1);
+         buffers.depth[p] = 2;
+      }
+   }
+
+   thread_pool pool(1);
+   std::vector<color> result;
+   denoise(buffers, 3, result, pool);
+   float error_before = 0, error_after = 0;
+   for (size_t p = 0; p < result.size(); p++) {
+      color expected = buffers.albedo[p] * 0.5f;
+      error_before += glm::length2(buffers.color[p] - expected);
+      error_after += glm::length2(result[p] - expected);
+      // blurring across the edge would move pixels by about 0.2
+      assert(glm::length(result[p] - expected) < 0.05f && "error: denoise should keep the edge");
+   }
+   assert(error_after < 0.25f * error_before && "error: denoise should reduce the noise");
+}
+
+// the samples of an hdr_image must survive a save and load, and keep adding up
+void test_hdr_image() {
+   assert(samples_filename("out/basic.pfm") == "out/basic_samples.pfm" && "error: wrong samples file");
+   assert(samples_filename("out.d/basic") == "out.d/basic_samples" && "error: wrong samples file");
+   assert(sums_filename("out/basic.pfm") == "out/basic_sums.pfm" && "error: wrong sums file");
+
+   hdr_image image(3, 2);
+   image.set(0, 0, color(1.5f, 20.0f, 0.25f), 4);
+   image.set(1, 2, color(0.1f, 0.2f, 0.3f), 1);
+   assert(image.save("test_hdr.pfm") && "error: cannot save hdr image");
+
+   hdr_image loaded;
+   assert(loaded.load("test_hdr.pfm") && "error: cannot load hdr image");
+   assert(loaded.width() == 3 && loaded.height() == 2 && "error: wrong hdr size");
+   for (int j = 0; j < 2; j++) {
+      for (int i = 0; i < 3; i++) {
+         assert(loaded.count(j, i) == image.count(j, i) && "error: wrong sample count");
+         assert(loaded.mean(j, i) == image.mean(j, i) && "error: hdr values should not change");
+      }
+   }
+
+   // a float beyond 8 bits and 1.0 keeps its value
+   assert(loaded.mean(0, 0).g == 5.0f && "error: wrong hdr value");
+
+   // the sums come back exactly, even where mean * count does not give them again
+   image.set(0, 1, color(0.7f, 1.3f, 2.9f), 3);
+   assert(image.save("test_hdr.pfm") && "error: cannot save hdr image");
+   assert(loaded.load("test_hdr.pfm") && "error: cannot load hdr image");
+   for (int j = 0; j < 2; j++) {
+      for (int i = 0; i < 3; i++) {
+         assert(loaded.sum(j, i) == image.sum(j, i) && "error: hdr sums should not change");
+      }
+   }
+
+   // without its sums, a render still loads from its means
+   remove("test_hdr_sums.pfm");
+   assert(loaded.load("test_hdr.pfm") && "error: cannot load hdr image without sums");
+   assert(loaded.sum(0, 0) == image.sum(0, 0) && loaded.count(0, 1) == 3 && "error: wrong hdr values");
+   remove("test_hdr.pfm");
+   remove("test_hdr_samples.pfm");
+}
+
+void test_checkpoint() {
+   std::vector<tile> tiles = make_tiles(5, 3, 2);
+   assert(tiles.size() == 6 && "error: wrong number of tiles");
+   checkpoint_key key = { 5, 3, 2, 4, 0, 0.01f, 7, 0 };
+
+   hdr_image hdr(5, 3);
+   std::vector<int> samples(15, 0);
+   feature_buffers features;
+   render_checkpoint saved("test_checkpoint.bin", 0, key, tiles, hdr, samples, features);
+   hdr.set(0, 0, color(1, 2, 3), 4);
+   hdr.set(2, 4, color(0.5f), 4);
+   hdr.set(2, 0, color(9), 4); // in a tile that is not done
+   samples[0] = 4;
+   saved.tile_done(0);
+   saved.tile_done(5);
+   assert(saved.save() && "error: cannot save checkpoint");
+
+   hdr_image restored(5, 3);
+   std::vector<int> restored_samples(15, 0);
+   render_checkpoint loaded("test_checkpoint.bin", 0, key, tiles, restored, restored_samples, features);
+   assert(loaded.load() == 2 && "error: wrong number of restored tiles");
+   assert(loaded.done(0) && loaded.done(5) && !loaded.done(4) && "error: wrong restored tiles");
+   assert(restored.sum(0, 0) == color(1, 2, 3) && restored.count(0, 0) == 4 && "error: wrong restored pixel");
+   assert(restored.sum(2, 4) == color(0.5f) && restored_samples[0] == 4 && "error: wrong restored pixel");
+   assert(restored.count(2, 0) == 0 && "error: pixels of unfinished tiles should not be restored");
+
+   // a checkpoint of other settings restores nothing
+   key.seed = 8;
+   render_checkpoint other("test_checkpoint.bin", 0, key, tiles, restored, restored_samples, features);
+   assert(other.load() == 0 && !other.done(0) && "error: checkpoint of other settings restored");
+
+   // nor does a checkpoint of another scene, or of the same scene file after an edit
+   key.seed = 7;
+   key.scene = 1;
+   render_checkpoint moved("test_checkpoint.bin", 0, key, tiles, restored, restored_samples, features);
+   assert(moved.load() == 0 && "error: checkpoint of another scene restored");
+   std::ofstream("test_scene.txt") << "sphere 0 0 -1 0.5\n";
+   uint32_t stamp = scene_stamp("basicblur", "test_scene.txt");
+   assert(stamp == scene_stamp("basicblur", "test_scene.txt") && "error: scene stamp should not change");
+   assert(stamp != scene_stamp("materials", "test_scene.txt") && "error: programs should have other stamps");
+   std::ofstream("test_scene.txt") << "sphere 0 0 -1 0.25\n";
+   assert(stamp != scene_stamp("basicblur", "test_scene.txt") && "error: edited scene should have another stamp");
+   remove("test_scene.txt");
+   remove("test_checkpoint.bin");
+}
+
+void test_process_pool() {
+#ifdef RT_PROCESSES
+   std::vector<int> items;
+   for (int k = 0; k < 20; k++) items.push_back(k);
+   remove("test_worker_died");
+
+   // the first worker to get item 7 dies, and the item goes to another
+   std::vector<int> squares(20, -1);
+   {
+      process_pool workers(3, [](int k, std::string& result) {
+         if (k == 7 && !std::ifstream("test_worker_died")) {
+            std::ofstream("test_worker_died") << "died";
+            _exit(1);
+         }
+         result = std::to_string(k * k);
+      });
+      std::vector<int> left = workers.run(items, [&](int k, const std::string& result) {
+         squares[k] = std::stoi(result);
+         return true;
+      });
+      assert(left.empty() && "error: items left with workers alive");
+      assert(workers.size() == 2 && "error: the dead worker should be gone");
+   }
+   for (int k = 0; k < 20; k++) {
+      assert(squares[k] == k * k && "error: wrong or missing result");
+   }
+   remove("test_worker_died");
+
+   // every worker dies on item 3, which is left over
+   process_pool workers(2, [](int k, std::string& result) {
+      if (k == 3) _exit(1);
+      result = "ok";
+   });
+   int finished = 0;
+   std::vector<int> left = workers.run(items, [&](int k, const std::string& result) {
+      finished++;
+      return result == "ok";
+   });
+   assert(workers.size() == 0 && "error: workers should have died");
+   assert(std::find(left.begin(), left.end(), 3) != left.end() && "error: item 3 should be left");
+   assert(finished + (int) left.size() == 20 && "error: items lost");
+#endif
+}
+
+void test_instance(int num_rays) {
+   // a unit sphere scaled by 2, rotated and moved traces like the sphere it becomes
+   shared_ptr<sphere> unit = make_shared<sphere>(point3(0), 1.0f, 0);
+   instance placed(unit, placement(point3(1, 2, -3), 2.0f, vec3(0.3f, -1.2f, 0.7f)), 5);
+   sphere expected_sphere(point3(1, 2, -3), 2.0f, 5);
+   aabb box;
+   assert(placed.bounding_box(box) && box.hit(ray(point3(1, 2, 10), vec3(0, 0, -1)), 0, infinity) &&
+      "error: instance box");
+   for (int i = 0; i < num_rays; i++) {
+      // from outside, aimed inside the sphere
+      point3 origin = point3(1, 2, -3) + (2.5f + 5.0f * random_float()) * normalize(random_unit_sphere());
+      point3 target = point3(1, 2, -3) + 1.9f * random_unit_sphere();
+      ray r(origin, target - origin);
+      hit_record hit, expected;
+      bool result = placed.hit(r, 0.001f, infinity, hit);
+      bool expected_result = expected_sphere.hit(r, 0.001f, infinity, expected);
+      check(result && expected_result, "error: instance should hit", hit, r);
+      check(std::fabs(hit.t - expected.t) < 1e-3f * expected.t && distance(hit.p, expected.p) < 1e-3f &&
+         distance(hit.normal, expected.normal) < 1e-3f && hit.front_face == expected.front_face &&
+         hit.mat_id == 5, "error: instance hit differs", hit, r);
+      check(placed.occluded(r, 0.001f, infinity), "error: instance should occlude", hit, r);
+   }
+   hit_record miss;
+   assert(!placed.hit(ray(point3(1, 5, -3), vec3(1, 0, 0)), 0.001f, infinity, miss) &&
+      !placed.occluded(ray(point3(1, 5, -3), vec3(1, 0, 0)), 0.001f, infinity) && "error: instance should miss");
+
+   // a shared ring placed by an instance, against the ring circle() bakes into a mesh
+   vec3 angles(-0.45f * M_PI, 0, 0.1f * M_PI);
+   triangle_mesh baked(1);
+   circle(point3(0, 0, -12), 4.0f, angles, baked);
+   baked.build();
+   shared_ptr<triangle_mesh> ring = unit_circle(0);
+   instance copy(ring, placement(point3(0, 0, -12), 4.0f, angles), 1);
+   for (int i = 0; i < num_rays; i++) {
+      ray r(point3(0, 0, 0), point3(0, 0, -12) + 3.0f * random_unit_cube() - point3(0));
+      hit_record hit, expected;
+      bool result = copy.hit(r, 0.001f, infinity, hit);
+      bool expected_result = baked.hit(r, 0.001f, infinity, expected);
+      if (result != expected_result) continue; // grazing the rim
+      if (result) {
+         check(std::fabs(hit.t - expected.t) < 1e-3f * expected.t && distance(hit.normal, expected.normal) < 1e-3f &&
+            hit.mat_id == 1, "error: instanced ring hit differs", hit, r);
+      }
+   }
+
+   // instances of a plane are unbounded
+   instance floor(make_shared<plane>(point3(0), vec3(0, 1, 0), 0), placement(point3(0, -1, 0), 1.0f, vec3(0)));
+   assert(!floor.bounding_box(box) && "error: instance of a plane should be unbounded");
+   hit_record hit;
+   assert(floor.hit(ray(point3(0, 1, 0), vec3(0, -1, 0)), 0.001f, infinity, hit) && equals(hit.t, 2.0f) &&
+      vecEquals(hit.normal, vec3(0, 1, 0)) && "error: instanced plane hit");
+}
+
+void test_disk() {
+   // an annulus in the plane y = 1, with radii 1 and 2
+   disk ring(point3(0, 1, 0), vec3(0, 2, 0), 1.0f, 2.0f, 3);
+   hit_record hit;
+   assert(ring.hit(ray(point3(1.5f, 5, 0), vec3(0, -2, 0)), 0.001f, infinity, hit) && equals(hit.t, 2.0f) &&
+      vecEquals(hit.p, point3(1.5f, 1, 0)) && vecEquals(hit.normal, vec3(0, 1, 0)) && hit.front_face &&
+      hit.mat_id == 3 && "error: disk should be hit");
+   assert(ring.hit(ray(point3(0, -1, -1.5f), vec3(0, 1, 0)), 0.001f, infinity, hit) &&
+      vecEquals(hit.normal, vec3(0, -1, 0)) && !hit.front_face && "error: disk should be hit from below");
+   assert(!ring.hit(ray(point3(0.5f, 5, 0), vec3(0, -1, 0)), 0.001f, infinity, hit) && "error: ray through the hole");
+   assert(!ring.hit(ray(point3(2.5f, 5, 0), vec3(0, -1, 0)), 0.001f, infinity, hit) && "error: ray outside the disk");
+   assert(!ring.hit(ray(point3(1.5f, 5, 0), vec3(0, 1, 0)), 0.001f, infinity, hit) && "error: disk behind the ray");
+   assert(!ring.hit(ray(point3(-5, 1, 0), vec3(1, 0, 0)), 0.001f, infinity, hit) && "error: ray in the plane");
+   assert(!ring.hit(ray(point3(1.5f, 5, 0), vec3(0, -1, 0)), 0.001f, 3.0f, hit) && "error: disk beyond t_max");
+
+   // against a fine triangle fan of the same annulus, on random rays, and for occlusion
+   disk tilted(point3(1, 2, -3), vec3(1, 2, 3), 0.5f, 2.0f, 0);
+   vec3 u = normalize(cross(tilted.n, vec3(1, 0, 0)));
+   vec3 v = cross(tilted.n, u);
+   aabb box;
+   assert(tilted.bounding_box(box) && "error: a disk is bounded");
+   for (int i = 0; i < 2000; i++) {
+      float angle = 2.0f * float(M_PI) * random_float();
+      float radius = 0.5f + 1.5f * random_float();
+      point3 target = tilted.center + radius * (std::cos(angle) * u + std::sin(angle) * v);
+      point3 origin = 6.0f * random_unit_sphere();
+      ray r(origin, target - origin);
+      bool result = tilted.hit(r, 0.001f, infinity, hit);
+      check(result && std::fabs(hit.t - 1.0f) < 1e-3f && distance(hit.p, target) < 1e-3f, "error: disk should be hit", hit, r);
+      check(tilted.occluded(r, 0.001f, infinity), "error: disk should occlude", hit, r);
+      for (int a = 0; a < 3; a++) {
+         check(target[a] >= box.minimum[a] && target[a] <= box.maximum[a], "error: disk outside its box", hit, r);
+      }
+      // inside the hole
+      point3 hole = tilted.center + 0.49f * random_float() * (std::cos(angle) * u + std::sin(angle) * v);
+      ray through(origin, hole - origin);
+      check(!tilted.hit(through, 0.001f, infinity, hit) && !tilted.occluded(through, 0.001f, infinity),
+         "error: ray through the hole should miss", hit, through);
+   }
+}
+
+color black_background(const ray& r) { return color(0); }
+
+// lights: sampled directions must land on the light with the right density, and light sampling
+// must give the same direct light as scattered rays alone, with far less noise
+void test_lights() {
+   // the average of 1 / pdf is the solid angle of the light
+   sphere bulb(point3(0, 2, 0), 0.5f, 0);
+   disk panel(point3(0, 2, 0), vec3(0, -1, 0), 0.0f, 1.0f, 0);
+   point3 origin(0);
+   float sphere_angle = 0, disk_angle = 0;
+   hit_record light_rec;
+   float pdf;
+   const int n = 4000;
+   for (int i = 0; i < n; i++) {
+      float u1 = (i + 0.5f) / n, u2 = random_float();
+      assert(bulb.sample_surface(origin, u1, u2, light_rec, pdf) && light_rec.front_face &&
+         std::fabs(distance(light_rec.p, bulb.center) - 0.5f) < 1e-3f &&
+         equals(pdf, bulb.surface_pdf(origin, light_rec)) && "error: bad sphere light sample");
+      sphere_angle += 1.0f / pdf;
+      assert(panel.sample_surface(origin, u1, u2, light_rec, pdf) && light_rec.front_face &&
+         equals(light_rec.p.y, 2.0f) && length(light_rec.p - panel.center) <= 1.0f + eps &&
+         equals(pdf, panel.surface_pdf(origin, light_rec)) && "error: bad disk light sample");
+      disk_angle += 1.0f / pdf;
+   }
+   assert(std::fabs(sphere_angle / n - 2.0f * float(M_PI) * (1.0f - std::sqrt(1.0f - 0.25f / 4.0f))) < 1e-3f &&
+      "error: wrong solid angle of a sphere light");
+   assert(std::fabs(disk_angle / n - 2.0f * float(M_PI) * (1.0f - 2.0f / std::sqrt(5.0f))) < 1e-2f &&
+      "error: wrong solid angle of a disk light");
+   assert(!bulb.sample_surface(bulb.center, 0.5f, 0.5f, light_rec, pdf) && "error: no cone from inside a sphere");
+
+   // a gray floor under a small light: the floor below the light reflects
+   // albedo / pi * pi * L * sin^2 = 0.5 * 4 * (0.5 / 2)^2 = 0.125
+   hittable_list world;
+   material_id gray = world.materials.add(make_shared<lambertian>(color(0.5f)));
+   material_id lamp = world.materials.add(make_shared<diffuse_light>(color(4.0f)));
+   world.add(make_shared<plane>(point3(0), vec3(0, 1, 0), gray));
+   world.add(make_shared<sphere>(point3(0, 2, 0), 0.5f, lamp));
+   world.build_bvh();
+   path_tracer tracer(world, black_background, 2);
+   assert(tracer.lights.size() == 1 && "error: the sphere should be a light");
+
+   ray seen(point3(0, 2, 3), vec3(0, 0, -1));
+   thread_rng().seed(0, 0);
+   assert(vecEquals(tracer.trace(seen), color(4.0f)) && "error: a light seen directly should give its radiance");
+
+   ray floor(point3(3, 3, 0), vec3(-1, -1, 0));
+   auto estimate = [&](int samples, float& variance) {
+      double sum = 0, sum2 = 0;
+      for (int i = 0; i < samples; i++) {
+         thread_rng().seed(1, i);
+         double value = tracer.trace(floor).g;
+         sum += value;
+         sum2 += value * value;
+      }
+      double mean = sum / samples;
+      variance = float(sum2 / samples - mean * mean);
+      return float(mean);
+   };
+   float sampled_variance, scattered_variance;
+   float sampled = estimate(256, sampled_variance);
+   tracer.sample_lights = false;
+   float scattered = estimate(40000, scattered_variance);
+   assert(std::fabs(sampled - 0.125f) < 0.125f * 0.03f && "error: wrong direct light with light sampling");
+   assert(std::fabs(scattered - 0.125f) < 0.125f * 0.05f && "error: wrong direct light without light sampling");
+   assert(sampled_variance * 20 < scattered_variance && "error: light sampling should cut the noise");
+}
+
+// samplers: every dimension of the first 16 samples of a pixel has one sample per sixteenth,
+// the first pairs of dimensions of sobol one per cell of a 4x4 grid, and the blue noise mask
+// has every value once, with neighbors farther apart than random
+void test_samplers() {
+   for (int id = 1; id < 4; id++) {
+      unique_ptr<sampler> samples = make_sampler(id, 5, 64, 16);
+      for (uint32_t pixel = 100; pixel < 104; pixel++) {
+         for (uint32_t d = 0; d < camera_dimensions + 2 * bounce_dimensions; d++) {
+            vector<int> strata(16, 0), cells(16, 0);
+            for (uint32_t k = 0; k < 16; k++) {
+               float u = samples->get(pixel, k, d);
+               assert(u >= 0.0f && u < 1.0f && "error: sample out of range");
+               strata[int(u * 16)]++;
+               float v = samples->get(pixel, k, d + 1);
+               cells[int(u * 4) * 4 + int(v * 4)]++;
+            }
+            // blue noise shifts the values of every dimension, which breaks the strata at the wrap
+            bool shifted = id == 3;
+            for (int k = 0; k < 16; k++) {
+               assert((shifted || strata[k] == 1) && "error: a dimension should be stratified");
+               assert((id != 2 || d % 2 != 0 || cells[k] == 1) && "error: sobol pairs should be stratified");
+            }
+         }
+      }
+   }
+   assert(sampler_id("sobol") == 2 && sampler_id("halton") == -1 && !make_sampler(0, 0, 1, 1) &&
+      "error: wrong sampler names");
+
+   // the byte tables give the points of the direction numbers, and a quad the values of get()
+   assert(sobol(0, 2) == 0 && sobol(1, 3) == 0x80000000u && sobol(3, 1) == 0x40000000u &&
+      sobol(0xffffffffu, 0) == 0xffffffffu && sobol(0x100, 2) == 0x68800000u && "error: wrong sobol point");
+   for (int id = 1; id < 4; id++) {
+      unique_ptr<sampler> samples = make_sampler(id, 5, 64, 16);
+      for (uint32_t k = 0; k < 40; k += 3) {
+         float quad[4];
+         samples->get_quad(samples->pixel_key(321), k, 8, quad);
+         for (uint32_t d = 0; d < 4; d++) {
+            assert(quad[d] == samples->get(321, k, 8 + d) && "error: a quad should match get()");
+         }
+      }
+   }
+
+   // a generator let go of its sampler goes on with the random numbers of its own stream
+   {
+      unique_ptr<sampler> samples = make_sampler(2, 5, 64, 16);
+      rng with, without;
+      with.seed(7, 3, 5, samples.get());
+      without.seed(7, 3, 5);
+      assert(with.next_float() == samples->get(7, 3, 0) && "error: the first number should come from the sampler");
+      without.next_float();
+      with.release_source();
+      for (int k = 0; k < 8; k++) assert(with.next_float() == without.next_float() && "error: released stream should go on");
+   }
+
+   const vector<float>& mask = blue_noise_mask();
+   vector<float> sorted = mask;
+   sort(sorted.begin(), sorted.end());
+   int n = blue_noise_size * blue_noise_size;
+   for (int k = 0; k < n; k++) assert(equals(sorted[k], (k + 0.5f) / n) && "error: mask values should be distinct");
+   double difference = 0;
+   for (int y = 0; y < blue_noise_size; y++) {
+      for (int x = 0; x < blue_noise_size; x++) {
+         difference += std::fabs(mask[y * blue_noise_size + x] - mask[y * blue_noise_size + (x + 1) % blue_noise_size]);
+      }
+   }
+   // random neighbors differ by 1/3 on average
+   assert(difference / n > 0.38 && "error: mask neighbors should be far apart");
+
+   // the closed form helpers
+   for (int i = 0; i < 1000; i++) {
+      assert(std::fabs(length(random_unit_vector()) - 1.0f) < 1e-5f && "error: not a unit vector");
+      vec3 p = random_unit_disk();
+      assert(length(p) <= 1.0f + 1e-5f && p.z == 0 && "error: not in the unit disk");
+   }
+}
+
+void test_ray_stream(int num_rays) {
+   // spheres, triangles and a floor of every kind of material, with a light
+   hittable_list world;
+   material_id mats[5] = {
+      world.materials.add(make_shared<lambertian>(color(0.6f, 0.3f, 0.2f))),
+      world.materials.add(make_shared<metal>(color(0.8f), 0.2f)),
+      world.materials.add(make_shared<diffuse_light>(color(3.0f))),
+      world.materials.add(make_shared<dielectric>(1.5f)),
+      world.materials.add(make_shared<phong>(point3(0, 0, 9)))
+   };
+   for (int i = 0; i < 60; i++) {
+      point3 c = 4.0f * random_unit_cube();
+      material_id m = mats[i % 5];
+      if (i % 2 == 0) world.add(make_shared<sphere>(c, random_float(0.1f, 0.8f), m));
+      else world.add(make_shared<triangle>(c, c + random_unit_sphere(), c + random_unit_sphere(), m));
+   }
+   world.add(make_shared<plane>(point3(0, -4, 0), vec3(0, 1, 0), mats[0]));
+   world.build_bvh();
+
+   // rays from one eye through a window, as a camera makes them, and a few wild ones
+   ray_stream stream;
+   stream.resize(num_rays);
+   for (int k = 0; k < num_rays; k++) {
+      point3 eye(0, 0, 9);
+      vec3 dir = k % 10 == 9 ? random_unit_sphere() : point3(2.0f * random_unit_cube()) - eye;
+      stream.set(k, ray(eye, dir), 0.001f, k % 7 == 6 ? 9.0f : infinity);
+   }
+   hit_stream(world, stream);
+   for (int k = 0; k < num_rays; k++) {
+      hit_record expected;
+      bool expected_result = world.hit(stream.rays[k], 0.001f, k % 7 == 6 ? 9.0f : infinity, expected);
+      check(stream.hit(k) == expected_result, "error: ray stream should/shouldn't hit", stream.hits[k], stream.rays[k]);
+      if (expected_result) {
+         const hit_record& hit = stream.hits[k];
+         assert(hit.t == expected.t && hit.object == expected.object && hit.mat_id == expected.mat_id &&
+            vecEquals(hit.normal, expected.normal) && "error: ray stream hit differs");
+      }
+   }
+
+   // traced in a stream, shaded sorted by material, every sample gets the color of trace()
+   path_tracer tracer(world, black_background, 6);
+   material_kind kinds[5] = { material_lambertian, material_metal, material_light, material_dielectric, material_phong };
+   for (int i = 0; i < 5; i++) assert(tracer.kinds[mats[i]] == kinds[i] && "error: wrong material kind");
+   vector<stream_sample> samples(num_rays);
+   vector<color> expected(num_rays);
+   for (int k = 0; k < num_rays; k++) {
+      thread_rng().seed(k, 3, 7);
+      samples[k].r = stream.rays[k];
+      samples[k].state = thread_rng();
+      expected[k] = tracer.trace(samples[k].r);
+   }
+   tracer.trace_stream(samples);
+   for (int k = 0; k < num_rays; k++) {
+      assert(samples[k].color == expected[k] && "error: a streamed path should match trace()");
+   }
+}
+
+// a class derived from one that hittable_list stores by class, so it must be called virtually
+class glowing_sphere : public sphere {
+public:
+   glowing_sphere(const point3& c, float r, material_id m) : sphere(c, r, m) {}
+};
+
+// objects stored by class: the same hits, objects and blockers as the virtual calls of a list
+// without bvh, for the classes of scene_objects and for others
+void test_typed_objects(int num_rays) {
+   hittable_list world;
+   for (int i = 0; i < 40; i++) {
+      point3 c = 4.0f * random_unit_cube();
+      if (i % 4 == 0) world.add(make_shared<sphere>(c, random_float(0.1f, 0.8f), i));
+      else if (i % 4 == 1) world.add(make_shared<triangle>(c, c + random_unit_sphere(), c + random_unit_sphere(), i));
+      else if (i % 4 == 2) world.add(make_shared<glowing_sphere>(c, random_float(0.1f, 0.8f), i));
+      else world.add(make_shared<disk>(c, random_unit_vector(), 0.2f, 0.6f, i));
+   }
+   world.add(make_shared<plane>(point3(0, -4, 0), vec3(0, 1, 0), 40));
+   world.add(make_shared<plane>(point3(0, 0, -5), vec3(0, 0, 1), 41));
+
+   world.build_bvh();
+   assert(world.bounded_copies.count<0>() == 10 && world.bounded_copies.count<2>() == 10 &&
+      world.unbounded_copies.count<1>() == 2 && world.bounded_copies.count<1>() == 0 &&
+      "error: objects stored under the wrong class");
+
+   for (int i = 0; i < num_rays; i++) {
+      ray r(5.0f * random_unit_cube(), random_unit_sphere());
+      hit_record expected, hit;
+      world.clear_bvh();
+      bool expected_result = world.hit(r, 0.001f, infinity, expected);
+      bool expected_blocked = world.occluded(r, 0.001f, 3.0f);
+      world.build_bvh();
+      check(world.hit(r, 0.001f, infinity, hit) == expected_result, "error: typed objects should/shouldn't hit", hit, r);
+      if (expected_result) {
+         assert(hit.t == expected.t && hit.object == expected.object && hit.mat_id == expected.mat_id &&
+            vecEquals(hit.normal, expected.normal) && "error: typed objects hit differs");
+      }
+      assert(world.occluded(r, 0.001f, 3.0f) == expected_blocked && "error: typed objects occlusion differs");
+   }
+}
+
 int main(int argc, char** argv)
 {
-   shared_ptr<material> empty = 0; 
+   material_id empty = -1; 
    hit_record none = hit_record{ point3(0), point3(0), -1.0f, false, empty};
 
    sphere s(point3(0), 2.0f, empty);
@@ -319,4 +1320,57 @@ int main(int argc, char** argv)
                false,
                none
             );
+
+   // t intervals
+   test_interval();
+
+   // bounding boxes
+   test_bounding_box(s, true, aabb(point3(-2), point3(2)));
+   test_bounding_box(p, false, aabb());
+   test_bounding_box(T, true, aabb(point3(0,0,-1), point3(0,1,1)));
+   test_bounding_box(l, true, aabb(point3(0), point3(1,0,0)));
+
+   // bvh against the linear scan, over spheres and triangles scattered in a box
+   hittable_list world;
+   for (int i = 0; i < 200; i++) {
+      point3 c = 4.0f * random_unit_cube();
+      if (i % 2 == 0) {
+         world.add(make_shared<sphere>(c, 0.05f + 0.45f * random_float(), empty));
+      }
+      else {
+         world.add(make_shared<triangle>(c, c + 0.5f * random_unit_sphere(), c + 0.5f * random_unit_sphere(), empty));
+      }
+   }
+   world.add(make_shared<plane>(point3(0,-4,0), vec3(0,1,0), empty));
+   test_bvh(world, 2000);
+
+   // occlusion queries over the same objects and a mesh
+   shared_ptr<triangle_mesh> mesh = make_shared<triangle_mesh>(empty);
+   for (int i = 0; i < 100; i++) {
+      point3 c = 4.0f * random_unit_cube();
+      mesh->add_triangle(c, c + 0.5f * random_unit_sphere(), c + 0.5f * random_unit_sphere());
+   }
+   mesh->build();
+   world.add(mesh);
+   test_occluded(world, 2000);
+
+   test_material_table();
+   test_triangle_mesh(200, 2000);
+   test_load_mesh();
+   test_scene_file();
+
+   test_rng();
+   test_pixel_variance();
+   test_denoise();
+   test_hdr_image();
+   test_checkpoint();
+   test_process_pool();
+   test_instance(2000);
+   test_disk();
+   test_lights();
+   test_samplers();
+   test_simd_kernels(200, 2000);
+   test_ray_stream(500);
+   test_typed_objects(2000);
+   test_box(2000);
 }
@@ -7,9 +7,9 @@
 
 class line : public hittable {
 public:
-   line() : a(0), b(0,1,0), normal(-1,0,0), mat_ptr(0) {}
+   line() : a(0), b(0,1,0), normal(-1,0,0), mat_id(-1) {}
    line(const glm::point3& v0, const glm::point3& v1,
-      std::shared_ptr<material> m) : a(v0), b(v1), mat_ptr(m) {
+      material_id m) : a(v0), b(v1), mat_id(m) {
           // make sure the line is not degenerated as a point
           assert(a != b && "The endpoints of a line cannot be the same!");
           // let the normal be the cross product with (0,1,0) so that it always points left (i.e. towards the hyperspace containing negative x axis)
@@ -26,16 +26,31 @@ public:
           }
       };
 
-   virtual bool hit(const ray& r, hit_record& rec) const override;
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override;
+   virtual void complete_hit(const ray& r, hit_record& rec) const override;
+
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override {
+      // a segment has no area, so this only happens for rays in its plane; reuse intersect()
+      hit_record rec;
+      return intersect(r, t_min, t_max, rec);
+   }
+
+   virtual bool bounding_box(aabb& output_box) const override {
+      output_box = aabb(glm::min(a, b), glm::max(a, b));
+      output_box.pad();
+      return true;
+   }
 
 public:
    glm::point3 a;
    glm::point3 b;
    glm::vec3 normal;
-   std::shared_ptr<material> mat_ptr;
+   material_id mat_id;
 };
 
-bool line::hit(const ray& r, hit_record& rec) const {
+bool line::intersect(const ray& r, float t_min, float t_max, hit_record& rec) const {
+    RT_COUNT(tests);
+
     // annotations beside the variables are consistent with the notations done on a scratch paper
     // find the plane containing r.orgin(), a and b
     glm::vec3 v1 = b - a; // r
@@ -105,20 +120,31 @@ bool line::hit(const ray& r, hit_record& rec) const {
         }
     }
     
+    // the line is hit outside the interval
+    if (t < t_min || t > t_max)
+    {
+        return false;
+    }
+
+    // save the time when we hit the object; complete_hit() fills the rest
+    rec.t = t;
+    return true;
+}
+
+void line::complete_hit(const ray& r, hit_record& rec) const {
     // save relevant data in hit record
-    rec.t = t; // save the time when we hit the object
-    rec.p = r.at(t); // ray.origin + t * ray.direction
-    rec.mat_ptr = mat_ptr; 
+    rec.p = r.at(rec.t); // ray.origin + t * ray.direction
+    rec.mat_id = mat_id; 
 
-    // save normal
+    // save normal, from the plane containing r.origin(), a and b as in intersect()
+    glm::vec3 v1 = b - a; // r
+    glm::vec3 n = glm::cross(r.origin() - a, v1); // (q-p) * r
     glm::vec3 outward_normal = normalize(normal); // compute unit length normal
-    if (t == 0)
+    if (rec.t == 0)
     {
         n = glm::cross(r.origin() + r.direction() * 42.0f, v1);
     }
     rec.set_line_face_normal(r, outward_normal, n, v1);
-
-    return true;
 }
 
 #endif
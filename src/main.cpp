@@ -3,6 +3,7 @@
 
 #include "AGL.h"
 #include "ppm_image.h"
+#include "render_settings.h"
 #include <cmath>
 #include <iostream>
 
@@ -56,6 +57,9 @@ int main(int argc, char** argv)
 {
     GLFWwindow* window;
 
+    // e.g. --threads 8
+    parse_render_settings(argc, argv);
+
     if (!glfwInit())
     {
         return -1;
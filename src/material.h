@@ -5,19 +5,53 @@
 #include "AGLM.h"
 #include "ray.h"
 #include "hittable.h"
+#include "hittable_list.h"
+
+// the material classes below, so that code that knows the class of a material can call it
+// without a virtual call (see path_tracer::shade()); other classes are material_other
+enum material_kind {
+   material_other, material_lambertian, material_light, material_phong, material_metal, material_dielectric,
+   material_kinds
+};
 
 class material {
 public:
-  virtual bool scatter(const ray& r_in, const hit_record& rec, 
+  // world is the scene, for materials that trace rays of their own (e.g. shadow rays)
+  virtual bool scatter(const ray& r_in, const hit_record& rec, const hittable_list& world,
      glm::color& attenuation, ray& scattered) const = 0;
+
+  // the color of the surface, without lighting; it guides the denoiser (see denoise.h)
+  virtual glm::color base_color(const hit_record& rec) const { return glm::color(1); }
+
+  // the radiance the surface gives off at rec, back along the ray that hit it
+  virtual glm::color emitted(const hit_record& rec) const { return glm::color(0); }
+
+  // whether emitted() is ever above 0; objects made of such materials are lights
+  virtual bool emits() const { return false; }
+
+  // Materials that return true here let the path tracer aim shadow rays at the lights from their
+  // hits (next-event estimation, see integrator.h); they must then give eval() and scatter_pdf().
+  virtual bool samples_lights() const { return false; }
+
+  // the BSDF for light arriving from the unit direction wi and leaving along -r_in.direction(),
+  // times the cosine of wi with the normal
+  virtual glm::color eval(const ray& r_in, const hit_record& rec, const glm::vec3& wi) const { return glm::color(0); }
+
+  // the density with which scatter() picks the unit direction wi, per unit solid angle
+  virtual float scatter_pdf(const ray& r_in, const hit_record& rec, const glm::vec3& wi) const { return 0; }
+
+  virtual material_kind kind() const { return material_other; }
+
   virtual ~material() {}
 };
 
-class lambertian : public material {
+class lambertian final : public material {
 public:
   lambertian(const glm::color& a) : albedo(a) {}
 
-  virtual bool scatter(const ray& r_in, const hit_record& rec, 
+  virtual material_kind kind() const override { return material_lambertian; }
+
+  virtual bool scatter(const ray& r_in, const hit_record& rec, const hittable_list& world,
      glm::color& attenuation, ray& scattered) const override 
   {
      glm::vec3 unitn = normalize(rec.normal);
@@ -31,11 +65,55 @@ public:
      return true; //bounce!
   }
 
+  virtual glm::color base_color(const hit_record& rec) const override { return albedo; }
+
+  // scatter() picks normal + a random unit vector, whose density is cos / pi
+  virtual bool samples_lights() const override { return true; }
+
+  virtual glm::color eval(const ray& r_in, const hit_record& rec, const glm::vec3& wi) const override
+  {
+     // the BSDF albedo / pi times the cosine, which is the density of scatter()
+     return albedo * scatter_pdf(r_in, rec, wi);
+  }
+
+  virtual float scatter_pdf(const ray& r_in, const hit_record& rec, const glm::vec3& wi) const override
+  {
+     return std::max(0.0f, glm::dot(normalize(rec.normal), wi)) / pi;
+  }
+
 public:
   glm::color albedo;
 };
 
-class phong : public material {
+// a surface that gives off light on its front side (e.g. the outside of a sphere) and reflects none
+class diffuse_light final : public material {
+public:
+  diffuse_light(const glm::color& e) : emit(e) {}
+
+  virtual material_kind kind() const override { return material_light; }
+
+  virtual bool scatter(const ray& r_in, const hit_record& rec, const hittable_list& world,
+     glm::color& attenuation, ray& scattered) const override
+  {
+     attenuation = glm::color(0);
+     return false;
+  }
+
+  virtual glm::color emitted(const hit_record& rec) const override
+  {
+     return rec.front_face ? emit : glm::color(0);
+  }
+
+  virtual bool emits() const override { return emit != glm::color(0); }
+
+  // lights saturate, so the denoiser keeps their edges
+  virtual glm::color base_color(const hit_record& rec) const override { return glm::min(emit, glm::color(1)); }
+
+public:
+  glm::color emit; // the radiance given off
+};
+
+class phong final : public material {
 public:
   phong(const glm::vec3& view) :
      diffuseColor(0,0,1), 
@@ -43,7 +121,7 @@ public:
      ambientColor(.01f, .01f, .01f),
      lightPos(5,5,0),
      viewPos(view), 
-     kd(0.45), ks(0.45), ka(0.1), shininess(10.0) 
+     kd(0.45), ks(0.45), ka(0.1), shininess(10.0), shadows(true) 
   {}
 
   phong(const glm::color& idiffuseColor, 
@@ -51,34 +129,49 @@ public:
         const glm::color& iambientColor,
         const glm::point3& ilightPos, 
         const glm::point3& iviewPos, 
-        float ikd, float iks, float ika, float ishininess) : 
+        float ikd, float iks, float ika, float ishininess,
+        bool ishadows = true) : 
      diffuseColor(idiffuseColor), 
      specColor(ispecColor),
      ambientColor(iambientColor),
      lightPos(ilightPos),
-     viewPos(iviewPos), kd(ikd), ks(iks), ka(ika), shininess(ishininess) 
+     viewPos(iviewPos), kd(ikd), ks(iks), ka(ika), shininess(ishininess),
+     shadows(ishadows) 
   {}
 
-  virtual bool scatter(const ray& r_in, const hit_record& rec, 
+  virtual material_kind kind() const override { return material_phong; }
+
+  virtual bool scatter(const ray& r_in, const hit_record& rec, const hittable_list& world,
      glm::color& attenuation, ray& scattered) const override 
   {
      // ambient
      glm::color ambient = ka * ambientColor;
 
+     // shadow: only the ambient light reaches points that cannot see the light
+     glm::vec3 toLight = lightPos - rec.p;
+     float lightDist = glm::length(toLight);
+     glm::vec3 lightDir = toLight / lightDist;
+     if (shadows && world.occluded(ray(rec.p, lightDir), 0.001f, lightDist))
+     {
+        attenuation = ambient;
+        return false;
+     }
+
      // diffuse
      glm::vec3 unitn = normalize(rec.normal);
-     glm::vec3 lightDir = normalize(lightPos - rec.p);
-     glm::color diffuse = kd * fmax(0.f, glm::dot(unitn, lightDir)) * diffuseColor;
+     glm::color diffuse = kd * std::max(0.f, glm::dot(unitn, lightDir)) * diffuseColor;
 
      // specular
      glm::vec3 reflection = normalize(2 * glm::dot(lightDir, unitn) * unitn - lightDir);
      glm::vec3 unitv = normalize(viewPos - rec.p);
-     glm::color spec = ks * specColor * float(pow(fmax(0.f, glm::dot(unitv, reflection)), shininess));
+     glm::color spec = ks * specColor * float(pow(std::max(0.f, glm::dot(unitv, reflection)), shininess));
 
      attenuation = ambient + diffuse + spec;
      return false;
   }
 
+  virtual glm::color base_color(const hit_record& rec) const override { return diffuseColor; }
+
 public:
   glm::color diffuseColor;
   glm::color specColor;
@@ -89,13 +182,16 @@ public:
   float ks;
   float ka; 
   float shininess;
+  bool shadows; // test a shadow ray toward lightPos
 };
 
-class metal : public material {
+class metal final : public material {
 public:
    metal(const glm::color& a, float f) : albedo(a), fuzz(glm::clamp(f,0.0f,1.0f)) {}
 
-   virtual bool scatter(const ray& r_in, const hit_record& rec, 
+   virtual material_kind kind() const override { return material_metal; }
+
+   virtual bool scatter(const ray& r_in, const hit_record& rec, const hittable_list& world,
       glm::color& attenuation, ray& scattered) const override 
    {
       glm::vec3 unitn = normalize(rec.normal);
@@ -105,16 +201,20 @@ public:
       return (glm::dot(scatter_direction, unitn) > 0); //bounce!
    }
 
+   virtual glm::color base_color(const hit_record& rec) const override { return albedo; }
+
 public:
    glm::color albedo;
    float fuzz;
 };
 
-class dielectric : public material {
+class dielectric final : public material {
 public:
   dielectric(float index_of_refraction) : ir(index_of_refraction) {}
 
-  virtual bool scatter(const ray& r_in, const hit_record& rec, 
+  virtual material_kind kind() const override { return material_dielectric; }
+
+  virtual bool scatter(const ray& r_in, const hit_record& rec, const hittable_list& world,
      glm::color& attenuation, ray& scattered) const override 
    {
       attenuation = glm::color(1.0, 1.0, 1.0);
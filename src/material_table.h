@@ -0,0 +1,35 @@
+// material_table.h, the materials of a scene
+
+#ifndef MATERIAL_TABLE_H_
+#define MATERIAL_TABLE_H_
+
+#include "hittable.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// the materials of a scene. Objects and hit records refer to a material by its index in the
+// table, so that copying a hit record does not touch a reference count.
+class material_table {
+public:
+   // add a material and return its id; adding the same material again returns the same id
+   material_id add(std::shared_ptr<material> m) {
+      auto found = ids.find(m.get());
+      if (found != ids.end()) return found->second;
+      material_id id = (material_id) materials.size();
+      materials.push_back(m);
+      ids[m.get()] = id;
+      return id;
+   }
+
+   const material& operator[](material_id id) const { return *materials[id]; }
+
+   int size() const { return (int) materials.size(); }
+   void clear() { materials.clear(); ids.clear(); }
+
+private:
+   std::vector<std::shared_ptr<material>> materials;
+   std::unordered_map<const material*, material_id> ids; // the id of each material, to find it again
+};
+
+#endif
@@ -0,0 +1,782 @@
+// mesh_loader.h, loads .obj and .ply files into a triangle_mesh
+// The file is memory mapped and parsed in place: numbers are read straight from the mapped bytes,
+// so no line is ever copied into a string. Large .obj files can be parsed by several threads,
+// each taking a range of lines. Polygons with more than three corners are split into fans.
+
+#ifndef MESH_LOADER_H_
+#define MESH_LOADER_H_
+
+#include "AGLM.h"
+#include "triangle_mesh.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// a read-only view of a whole file, mapped into memory
+class mapped_file {
+public:
+   mapped_file() : bytes(0), length(0) {}
+   ~mapped_file() { close(); }
+
+   bool open(const std::string& filename);
+   void close();
+
+   const char* begin() const { return bytes; }
+   const char* end() const { return bytes + length; }
+   size_t size() const { return length; }
+
+private:
+   mapped_file(const mapped_file&);
+   mapped_file& operator=(const mapped_file&);
+
+   const char* bytes;
+   size_t length;
+};
+
+// append the triangles of a file to mesh; call mesh.build() once every file is loaded.
+// On error, print the reason and return false, leaving mesh unchanged.
+bool load_mesh(const std::string& filename, triangle_mesh& mesh, int num_threads = 1);
+
+// Wavefront .obj: v and f lines (f a b c, a/t/n, a//n and negative indices); everything else is
+// ignored. num_threads <= 0 uses every hardware thread.
+bool load_obj(const std::string& filename, triangle_mesh& mesh, int num_threads = 1);
+
+// Stanford .ply, binary (either byte order) or ascii: the x, y, z properties of the vertex element
+// and the vertex_indices (or vertex_index) list of the face element; other data is skipped
+bool load_ply(const std::string& filename, triangle_mesh& mesh);
+
+#ifdef _WIN32
+
+bool mapped_file::open(const std::string& filename)
+{
+   close();
+   HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+   if (file == INVALID_HANDLE_VALUE) return false;
+
+   LARGE_INTEGER file_size;
+   if (!GetFileSizeEx(file, &file_size))
+   {
+      CloseHandle(file);
+      return false;
+   }
+   length = (size_t) file_size.QuadPart;
+   if (length == 0)
+   {
+      CloseHandle(file);
+      return true;
+   }
+
+   HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+   CloseHandle(file);
+   if (mapping == 0) return false;
+   bytes = (const char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   CloseHandle(mapping); // the view keeps the mapping alive
+   if (bytes == 0) length = 0;
+   return bytes != 0;
+}
+
+void mapped_file::close()
+{
+   if (bytes) UnmapViewOfFile(bytes);
+   bytes = 0;
+   length = 0;
+}
+
+#else
+
+bool mapped_file::open(const std::string& filename)
+{
+   close();
+   int fd = ::open(filename.c_str(), O_RDONLY);
+   if (fd < 0) return false;
+
+   struct stat info;
+   if (fstat(fd, &info) != 0)
+   {
+      ::close(fd);
+      return false;
+   }
+   length = (size_t) info.st_size;
+   if (length == 0)
+   {
+      ::close(fd);
+      return true;
+   }
+
+   void* view = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+   ::close(fd); // the mapping keeps the file open
+   if (view == MAP_FAILED)
+   {
+      length = 0;
+      return false;
+   }
+   madvise(view, length, MADV_SEQUENTIAL);
+   bytes = (const char*) view;
+   return true;
+}
+
+void mapped_file::close()
+{
+   if (bytes) munmap((void*) bytes, length);
+   bytes = 0;
+   length = 0;
+}
+
+#endif
+
+//
+// number parsing on unterminated text
+//
+
+inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char* skip_blanks(const char* p, const char* end)
+{
+   while (p < end && is_blank(*p)) p++;
+   return p;
+}
+
+inline const char* skip_line(const char* p, const char* end)
+{
+   const char* eol = (const char*) memchr(p, '\n', end - p);
+   return eol ? eol + 1 : end;
+}
+
+// read an integer such as -12; return the position after it, or 0 if there is none
+const char* parse_int(const char* p, const char* end, long long& value)
+{
+   bool negative = false;
+   if (p < end && (*p == '-' || *p == '+'))
+   {
+      negative = *p == '-';
+      p++;
+   }
+   if (p == end || *p < '0' || *p > '9') return 0;
+
+   long long n = 0;
+   while (p < end && *p >= '0' && *p <= '9')
+   {
+      n = n * 10 + (*p - '0');
+      p++;
+   }
+   value = negative ? -n : n;
+   return p;
+}
+
+// read a decimal number such as -1.25e-3; return the position after it, or 0 if there is none.
+// The first 19 significant digits are kept, which is more than a float or double can hold.
+const char* parse_float(const char* p, const char* end, double& value)
+{
+   static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+      1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+   bool negative = false;
+   if (p < end && (*p == '-' || *p == '+'))
+   {
+      negative = *p == '-';
+      p++;
+   }
+
+   uint64_t mantissa = 0;
+   int digits = 0;
+   int exponent = 0;
+   bool any = false;
+   while (p < end && *p >= '0' && *p <= '9')
+   {
+      if (digits < 19)
+      {
+         mantissa = mantissa * 10 + (*p - '0');
+         if (mantissa != 0) digits++;
+      }
+      else
+      {
+         exponent++;
+      }
+      any = true;
+      p++;
+   }
+   if (p < end && *p == '.')
+   {
+      p++;
+      while (p < end && *p >= '0' && *p <= '9')
+      {
+         if (digits < 19)
+         {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0) digits++;
+            exponent--;
+         }
+         any = true;
+         p++;
+      }
+   }
+   if (!any) return 0;
+
+   if (p < end && (*p == 'e' || *p == 'E'))
+   {
+      long long e;
+      const char* q = parse_int(p + 1, end, e);
+      if (q)
+      {
+         exponent += (int) std::max(-1000LL, std::min(1000LL, e));
+         p = q;
+      }
+   }
+
+   double result = (double) mantissa;
+   if (exponent < 0)
+   {
+      result = -exponent <= 22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+   }
+   else if (exponent > 0)
+   {
+      result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+   }
+   value = negative ? -result : result;
+   return p;
+}
+
+//
+// obj
+//
+
+// the vertices and faces found in a range of lines of an .obj file
+struct obj_chunk {
+   obj_chunk() : line(0), error(0) {}
+
+   std::vector<glm::point3> vertices;
+   std::vector<int> indices;  // three per triangle; the vertices before the chunk are not counted yet
+   std::vector<int> relative; // the entries of indices given relative to the chunk (negative in the file)
+   long long line;            // number of lines parsed
+   const char* error;         // set with the line number on the first error
+};
+
+// the vertex index of one corner of an f line; returns the position after it, or 0 on error
+const char* parse_obj_corner(const char* p, const char* end, int num_vertices, int& index, bool& relative)
+{
+   long long i;
+   p = parse_int(p, end, i);
+   if (!p || i == 0) return 0;
+
+   // skip the texture and normal indices
+   while (p < end && (*p == '/' || (*p >= '0' && *p <= '9') || *p == '-')) p++;
+
+   // a negative index may point into an earlier chunk, so only its bound is known here;
+   // load_obj checks the rest once the vertices of every chunk are counted
+   long long resolved = i > 0 ? i - 1 : num_vertices + i;
+   if (resolved >= INT32_MAX || resolved < -INT32_MAX) return 0;
+   relative = i < 0;
+   index = (int) resolved;
+   return p;
+}
+
+void parse_obj(const char* p, const char* end, obj_chunk& chunk)
+{
+   std::vector<int> corners;
+   std::vector<char> relative;
+
+   while (p < end)
+   {
+      chunk.line++;
+      p = skip_blanks(p, end);
+      const char* next = skip_line(p, end);
+
+      if (next - p >= 2 && p[0] == 'v' && is_blank(p[1]))
+      {
+         double xyz[3];
+         const char* q = p + 1;
+         for (int k = 0; k < 3 && q; k++)
+         {
+            q = parse_float(skip_blanks(q, end), end, xyz[k]);
+         }
+         if (!q)
+         {
+            chunk.error = "bad vertex";
+            return;
+         }
+         chunk.vertices.push_back(glm::point3(xyz[0], xyz[1], xyz[2]));
+      }
+      else if (next - p >= 2 && p[0] == 'f' && is_blank(p[1]))
+      {
+         corners.clear();
+         relative.clear();
+         const char* q = skip_blanks(p + 1, end);
+         while (q < end && *q != '\n' && *q != '#')
+         {
+            int index;
+            bool rel;
+            q = parse_obj_corner(q, end, (int) chunk.vertices.size(), index, rel);
+            if (!q)
+            {
+               chunk.error = "bad face";
+               return;
+            }
+            corners.push_back(index);
+            relative.push_back(rel);
+            q = skip_blanks(q, end);
+         }
+         if (corners.size() < 3)
+         {
+            chunk.error = "face with less than three vertices";
+            return;
+         }
+
+         // split the polygon into a fan around its first corner
+         for (size_t k = 1; k + 1 < corners.size(); k++)
+         {
+            size_t fan[3] = { 0, k, k + 1 };
+            for (int c = 0; c < 3; c++)
+            {
+               if (relative[fan[c]]) chunk.relative.push_back((int) chunk.indices.size());
+               chunk.indices.push_back(corners[fan[c]]);
+            }
+         }
+      }
+      p = next;
+   }
+}
+
+bool load_obj(const std::string& filename, triangle_mesh& mesh, int num_threads)
+{
+   mapped_file file;
+   if (!file.open(filename))
+   {
+      std::cerr << filename << ": cannot open" << std::endl;
+      return false;
+   }
+
+   // split the file into chunks of whole lines, a few per thread so that they balance
+   if (num_threads <= 0) num_threads = thread_pool::default_size();
+   const size_t min_chunk_size = 1 << 20;
+   size_t num_chunks = std::min(file.size() / min_chunk_size + 1, (size_t) (num_threads == 1 ? 1 : 4 * num_threads));
+
+   std::vector<const char*> starts(num_chunks + 1);
+   starts[0] = file.begin();
+   starts[num_chunks] = file.end();
+   for (size_t i = 1; i < num_chunks; i++)
+   {
+      const char* p = file.begin() + file.size() * i / num_chunks;
+      starts[i] = std::max(starts[i - 1], p == file.begin() ? p : skip_line(p - 1, file.end()));
+   }
+
+   std::vector<obj_chunk> chunks(num_chunks);
+   if (num_chunks == 1)
+   {
+      parse_obj(starts[0], starts[1], chunks[0]);
+   }
+   else
+   {
+      thread_pool pool(num_threads);
+      pool.parallel_for((int) num_chunks, [&](int i)
+      {
+         parse_obj(starts[i], starts[i + 1], chunks[i]);
+      });
+   }
+
+   // count the vertices before each chunk
+   size_t base = mesh.vertices.size();
+   std::vector<size_t> first_vertex(num_chunks + 1, 0);
+   size_t num_indices = 0;
+   long long line = 0;
+   for (size_t i = 0; i < num_chunks; i++)
+   {
+      if (chunks[i].error)
+      {
+         std::cerr << filename << ":" << line + chunks[i].line << ": " << chunks[i].error << std::endl;
+         return false;
+      }
+      line += chunks[i].line;
+      first_vertex[i + 1] = first_vertex[i] + chunks[i].vertices.size();
+      num_indices += chunks[i].indices.size();
+   }
+   size_t num_vertices = first_vertex[num_chunks];
+   if (base + num_vertices > (size_t) INT32_MAX)
+   {
+      std::cerr << filename << ": too many vertices" << std::endl;
+      return false;
+   }
+
+   // resolve the relative indices and check every index
+   for (size_t i = 0; i < num_chunks; i++)
+   {
+      std::vector<int>& indices = chunks[i].indices;
+      for (size_t k = 0; k < chunks[i].relative.size(); k++)
+      {
+         indices[chunks[i].relative[k]] += (int) first_vertex[i];
+      }
+      for (size_t k = 0; k < indices.size(); k++)
+      {
+         if (indices[k] < 0 || (size_t) indices[k] >= num_vertices)
+         {
+            std::cerr << filename << ": vertex index out of range" << std::endl;
+            return false;
+         }
+      }
+   }
+
+   mesh.vertices.reserve(base + num_vertices);
+   mesh.indices.reserve(mesh.indices.size() + num_indices);
+   for (size_t i = 0; i < num_chunks; i++)
+   {
+      mesh.vertices.insert(mesh.vertices.end(), chunks[i].vertices.begin(), chunks[i].vertices.end());
+      for (size_t k = 0; k < chunks[i].indices.size(); k++)
+      {
+         mesh.indices.push_back(chunks[i].indices[k] + (int) base);
+      }
+   }
+   return true;
+}
+
+//
+// ply
+//
+
+struct ply_property {
+   std::string name;
+   int type;       // bytes of the value: 1, 2, 4 or 8, negative for float and double
+   bool is_signed;
+   bool is_list;
+   int count_type; // type of the list length
+   bool count_signed;
+};
+
+struct ply_element {
+   std::string name;
+   long long count;
+   std::vector<ply_property> properties;
+};
+
+// the size and signedness of a ply type name; false if unknown
+bool ply_type(const std::string& name, int& type, bool& is_signed)
+{
+   static const char* names[] = { "char", "int8", "uchar", "uint8", "short", "int16", "ushort", "uint16",
+      "int", "int32", "uint", "uint32", "float", "float32", "double", "float64" };
+   static const int types[] = { 1, 1, 1, 1, 2, 2, 2, 2, 4, 4, 4, 4, -4, -4, -8, -8 };
+   static const bool signs[] = { true, true, false, false, true, true, false, false,
+      true, true, false, false, true, true, true, true };
+   for (int i = 0; i < 16; i++)
+   {
+      if (name == names[i])
+      {
+         type = types[i];
+         is_signed = signs[i];
+         return true;
+      }
+   }
+   return false;
+}
+
+// reads the values of a ply body, in binary or as ascii text
+class ply_reader {
+public:
+   ply_reader(const char* begin, const char* end, bool ascii, bool swap) :
+      failed(false), p(begin), end(end), ascii(ascii), swap(swap) {}
+
+   double read(int type, bool is_signed) {
+      if (ascii) return read_text();
+      int bytes = type < 0 ? -type : type;
+      if (end - p < bytes)
+      {
+         failed = true;
+         p = end;
+         return 0;
+      }
+      unsigned char raw[8];
+      memcpy(raw, p, bytes);
+      p += bytes;
+      if (swap)
+      {
+         for (int i = 0; i < bytes / 2; i++) std::swap(raw[i], raw[bytes - 1 - i]);
+      }
+      switch (type)
+      {
+      case 1: { int8_t v; memcpy(&v, raw, 1); return is_signed ? (double) v : (double) (uint8_t) v; }
+      case 2: { int16_t v; memcpy(&v, raw, 2); return is_signed ? (double) v : (double) (uint16_t) v; }
+      case 4: { int32_t v; memcpy(&v, raw, 4); return is_signed ? (double) v : (double) (uint32_t) v; }
+      case -4: { float v; memcpy(&v, raw, 4); return v; }
+      default: { double v; memcpy(&v, raw, 8); return v; }
+      }
+   }
+
+   bool fixed_size() const { return !ascii; }
+   const char* position() const { return p; }
+   void advance(size_t bytes) { p += bytes; }
+   size_t remaining() const { return end - p; }
+
+public:
+   bool failed;
+
+private:
+   double read_text() {
+      while (p < end && (is_blank(*p) || *p == '\n')) p++;
+      double v = 0;
+      const char* q = parse_float(p, end, v);
+      if (!q)
+      {
+         failed = true;
+         p = end;
+         return 0;
+      }
+      p = q;
+      return v;
+   }
+
+   const char* p;
+   const char* end;
+   bool ascii;
+   bool swap;
+};
+
+bool load_ply(const std::string& filename, triangle_mesh& mesh)
+{
+   mapped_file file;
+   if (!file.open(filename))
+   {
+      std::cerr << filename << ": cannot open" << std::endl;
+      return false;
+   }
+
+   // the header is a few lines of text, ending with end_header
+   const char* p = file.begin();
+   const char* end = file.end();
+   if (file.size() < 4 || strncmp(p, "ply", 3) != 0)
+   {
+      std::cerr << filename << ": not a ply file" << std::endl;
+      return false;
+   }
+   p = skip_line(p, end);
+
+   std::string format;
+   std::vector<ply_element> elements;
+   bool header_done = false;
+   while (p < end && !header_done)
+   {
+      const char* next = skip_line(p, end);
+      std::vector<std::string> words;
+      const char* q = p;
+      while (true)
+      {
+         q = skip_blanks(q, next);
+         if (q == next || *q == '\n') break;
+         const char* w = q;
+         while (q < next && !is_blank(*q) && *q != '\n') q++;
+         words.push_back(std::string(w, q));
+      }
+      p = next;
+      if (words.empty() || words[0] == "comment" || words[0] == "obj_info") continue;
+
+      bool ok = true;
+      if (words[0] == "end_header")
+      {
+         header_done = true;
+      }
+      else if (words[0] == "format" && words.size() >= 2)
+      {
+         format = words[1];
+      }
+      else if (words[0] == "element" && words.size() == 3)
+      {
+         ply_element element;
+         element.name = words[1];
+         element.count = atoll(words[2].c_str());
+         ok = element.count >= 0;
+         elements.push_back(element);
+      }
+      else if (words[0] == "property" && !elements.empty())
+      {
+         ply_property property;
+         property.is_list = words.size() == 5 && words[1] == "list";
+         property.count_type = 0;
+         property.count_signed = false;
+         if (property.is_list)
+         {
+            ok = ply_type(words[2], property.count_type, property.count_signed) &&
+               ply_type(words[3], property.type, property.is_signed) && property.count_type > 0;
+            property.name = words[4];
+         }
+         else
+         {
+            ok = words.size() == 3 && ply_type(words[1], property.type, property.is_signed);
+            property.name = words[2];
+         }
+         elements.back().properties.push_back(property);
+      }
+      else
+      {
+         ok = false;
+      }
+      if (!ok)
+      {
+         std::cerr << filename << ": bad ply header" << std::endl;
+         return false;
+      }
+   }
+
+   uint16_t one = 1;
+   bool little_endian_host = *(const unsigned char*) &one == 1;
+   bool ascii = format == "ascii";
+   if (!header_done || (!ascii && format != "binary_little_endian" && format != "binary_big_endian"))
+   {
+      std::cerr << filename << ": unsupported ply format" << std::endl;
+      return false;
+   }
+   bool swap = !ascii && (format == "binary_little_endian") != little_endian_host;
+   ply_reader reader(p, end, ascii, swap);
+
+   size_t base = mesh.vertices.size();
+   std::vector<glm::point3> vertices;
+   std::vector<int> indices;
+   std::vector<int> corners;
+   for (const ply_element& element : elements)
+   {
+      bool is_vertex = element.name == "vertex";
+      bool is_face = element.name == "face";
+
+      // the slots of x, y, z, and the size of an element if it has no lists
+      int xyz[3] = { -1, -1, -1 };
+      int face_list = -1;
+      int stride = 0;
+      for (size_t k = 0; k < element.properties.size(); k++)
+      {
+         const ply_property& property = element.properties[k];
+         if (property.name == "x") xyz[0] = (int) k;
+         if (property.name == "y") xyz[1] = (int) k;
+         if (property.name == "z") xyz[2] = (int) k;
+         if (property.is_list && (property.name == "vertex_indices" || property.name == "vertex_index")) face_list = (int) k;
+         stride = property.is_list || stride < 0 ? -1 : stride + std::abs(property.type);
+      }
+      if (is_vertex && (xyz[0] < 0 || xyz[1] < 0 || xyz[2] < 0))
+      {
+         std::cerr << filename << ": vertices without x, y, z" << std::endl;
+         return false;
+      }
+
+      // skip elements of no interest in one step when their size is known
+      if (!is_vertex && !(is_face && face_list >= 0) && stride >= 0 && reader.fixed_size())
+      {
+         if ((double) stride * element.count > (double) reader.remaining())
+         {
+            reader.failed = true;
+            break;
+         }
+         reader.advance((size_t) stride * element.count);
+         continue;
+      }
+
+      if (is_vertex)
+      {
+         // the fewest bytes a vertex can take: its values, and the counts of its lists, in binary;
+         // a digit and a blank per value in ascii. A count the data cannot hold fails here, before
+         // the reserve.
+         double smallest = 0;
+         for (const ply_property& property : element.properties)
+         {
+            smallest += !reader.fixed_size() ? 2 : property.is_list ? property.count_type : std::abs(property.type);
+         }
+         if (smallest * element.count > (double) reader.remaining())
+         {
+            reader.failed = true;
+            break;
+         }
+         vertices.reserve((size_t) element.count);
+      }
+      for (long long i = 0; i < element.count && !reader.failed; i++)
+      {
+         double values[3] = { 0, 0, 0 };
+         for (size_t k = 0; k < element.properties.size(); k++)
+         {
+            const ply_property& property = element.properties[k];
+            if (!property.is_list)
+            {
+               double v = reader.read(property.type, property.is_signed);
+               for (int c = 0; c < 3; c++)
+               {
+                  if (xyz[c] == (int) k) values[c] = v;
+               }
+               continue;
+            }
+
+            long long count = (long long) reader.read(property.count_type, property.count_signed);
+            if (count < 0 || (reader.fixed_size() && (double) count * std::abs(property.type) > (double) reader.remaining()))
+            {
+               reader.failed = true;
+               break;
+            }
+            if (is_face && face_list == (int) k)
+            {
+               corners.clear();
+               for (long long c = 0; c < count; c++)
+               {
+                  corners.push_back((int) reader.read(property.type, property.is_signed));
+               }
+               // split the polygon into a fan around its first corner
+               for (size_t c = 1; c + 1 < corners.size(); c++)
+               {
+                  indices.push_back(corners[0]);
+                  indices.push_back(corners[c]);
+                  indices.push_back(corners[c + 1]);
+               }
+            }
+            else
+            {
+               for (long long c = 0; c < count; c++) reader.read(property.type, property.is_signed);
+            }
+         }
+         if (is_vertex)
+         {
+            vertices.push_back(glm::point3(values[0], values[1], values[2]));
+         }
+      }
+      if (reader.failed) break;
+   }
+   if (reader.failed)
+   {
+      std::cerr << filename << ": ply data ends early or is malformed" << std::endl;
+      return false;
+   }
+
+   for (size_t k = 0; k < indices.size(); k++)
+   {
+      if (indices[k] < 0 || (size_t) indices[k] >= vertices.size())
+      {
+         std::cerr << filename << ": vertex index out of range" << std::endl;
+         return false;
+      }
+      indices[k] += (int) base;
+   }
+   mesh.vertices.insert(mesh.vertices.end(), vertices.begin(), vertices.end());
+   mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+   return true;
+}
+
+bool load_mesh(const std::string& filename, triangle_mesh& mesh, int num_threads)
+{
+   size_t dot = filename.find_last_of('.');
+   std::string extension = dot == std::string::npos ? "" : filename.substr(dot + 1);
+   for (size_t i = 0; i < extension.size(); i++) extension[i] = (char) tolower(extension[i]);
+
+   if (extension == "obj") return load_obj(filename, mesh, num_threads);
+   if (extension == "ply") return load_ply(filename, mesh);
+
+   std::cerr << filename << ": unknown mesh format (expected .obj or .ply)" << std::endl;
+   return false;
+}
+
+#endif
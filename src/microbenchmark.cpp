@@ -0,0 +1,363 @@
+// microbenchmark.cpp, time per ray of each primitive's hit(), of hittable_list::hit() and of each
+// material's scatter(), over fixed sets of pre-generated rays, and the render time of the basic,
+// materials and raytracer scenes at a fixed seed. The results are printed as JSON, so that runs
+// can be stored and compared:
+//    microbenchmark > before.json
+// Each kernel runs over its whole ray set several times (--repeats) and reports the best and the
+// median time per ray, and the fraction of rays that hit (or, for scatter(), that scattered).
+// Scenes report the render time and a checksum of the image, which changes only when the
+// rendered pixels do.
+// usage: microbenchmark [width height] [--rays N] [--repeats N] [--threads N] [--seed N]
+
+#include "AGLM.h"
+#include "ray.h"
+#include "sphere.h"
+#include "plane.h"
+#include "triangle.h"
+#include "line.h"
+#include "triangle_mesh.h"
+#include "camera.h"
+#include "material.h"
+#include "hittable_list.h"
+#include "scenes.h"
+#include "render.h"
+#include "render_settings.h"
+#include "integrator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+typedef chrono::steady_clock benchmark_clock;
+
+struct kernel_result
+{
+   string name;
+   size_t rays;
+   double best_ns;   // per ray, fastest repeat
+   double median_ns; // per ray, median repeat
+   double hit_rate;
+};
+
+struct scene_result
+{
+   string name;
+   double best_seconds;
+   double median_seconds;
+   double ns_per_ray; // per path segment, in the fastest repeat
+   double average_path_length;
+   unsigned long long checksum; // sum of the image bytes
+};
+
+// run kernel(i) for i = 0 ... n - 1, repeats times. kernel returns whether ray i hit.
+template <class KernelFn>
+kernel_result time_kernel(const string& name, size_t n, int repeats, const KernelFn& kernel)
+{
+   vector<double> ns(repeats);
+   size_t hits = 0;
+   for (int k = 0; k < repeats; k++)
+   {
+      hits = 0;
+      benchmark_clock::time_point start = benchmark_clock::now();
+      for (size_t i = 0; i < n; i++)
+      {
+         if (kernel(i)) hits++;
+      }
+      double seconds = chrono::duration<double>(benchmark_clock::now() - start).count();
+      ns[k] = 1e9 * seconds / std::max(n, (size_t) 1);
+   }
+   sort(ns.begin(), ns.end());
+
+   kernel_result result = { name, n, ns[0], ns[repeats / 2], hits / double(std::max(n, (size_t) 1)) };
+   return result;
+}
+
+// rays from random points in a cube of half size extent, toward random points of the box [lo, hi]
+vector<ray> rays_toward(size_t n, float extent, const point3& lo, const point3& hi)
+{
+   vector<ray> rays(n);
+   for (size_t i = 0; i < n; i++)
+   {
+      point3 origin = extent * random_unit_cube();
+      point3 target = lo + (hi - lo) * (0.5f * random_unit_cube() + vec3(0.5f));
+      rays[i] = ray(origin, target - origin);
+   }
+   return rays;
+}
+
+// one jittered camera ray per pixel
+vector<ray> camera_rays(const camera& cam, int width, int height, size_t n)
+{
+   vector<ray> rays(n);
+   for (size_t k = 0; k < n; k++)
+   {
+      int i = (int) (k % width);
+      int j = (int) (k / width % height);
+      float u = float(i + random_float()) / (width - 1);
+      float v = float(height - j - 1 - random_float()) / (height - 1);
+      rays[k] = cam.get_ray(u, v);
+   }
+   return rays;
+}
+
+// diffuse bounce rays leaving the first hit of each ray, repeated to n rays
+vector<ray> bounce_rays(const vector<ray>& primary, const hittable_list& world, size_t n)
+{
+   vector<ray> rays;
+   rays.reserve(n);
+   for (size_t k = 0; rays.size() < n && k < 4 * n; k++)
+   {
+      hit_record rec;
+      if (world.hit(primary[k % primary.size()], 0.001f, infinity, rec))
+      {
+         rays.push_back(ray(rec.p, random_hemisphere(rec.normal)));
+      }
+   }
+   return rays;
+}
+
+// the background of the Space Station scene, as in basic.cpp
+color space_background(const ray& r)
+{
+   return color(1.0f/255.0f, 5.0f/255.0f, 14.0f/255.0f);
+}
+
+// the sky of the materials and raytracer scenes
+color sky_background(const ray& r)
+{
+   vec3 unit_direction = normalize(r.direction());
+   auto t = 0.5f * (unit_direction.y + 1.0f);
+   return (1.0f - t) * color(1, 1, 1) + t * color(0.5f, 0.7f, 1.0f);
+}
+
+// render a scene repeats times with the settings of the ray tracers: 10 samples and 10 bounces
+scene_result time_scene(const string& name, const hittable_list& world, const camera& cam,
+   background_fn background, int width, int height, int repeats)
+{
+   agl::ppm_image image(width, height);
+   path_tracer tracer(world, background, 10);
+   int samples_per_pixel = 10;
+
+   vector<double> seconds(repeats);
+   double path_length = 0;
+   for (int k = 0; k < repeats; k++)
+   {
+      tracer.reset_stats();
+      benchmark_clock::time_point start = benchmark_clock::now();
+      render(image, cam, samples_per_pixel, [&](const ray& r) { return tracer.trace(r); },
+         [&](vector<stream_sample>& samples) { tracer.trace_stream(samples); });
+      seconds[k] = chrono::duration<double>(benchmark_clock::now() - start).count();
+      path_length = tracer.average_path_length();
+   }
+   sort(seconds.begin(), seconds.end());
+
+   unsigned long long checksum = 0;
+   const unsigned char* bytes = image.data();
+   for (int i = 0; i < 3 * width * height; i++)
+   {
+      checksum += bytes[i];
+   }
+
+   double segments = path_length * width * height * samples_per_pixel;
+   scene_result result = { name, seconds[0], seconds[repeats / 2], 1e9 * seconds[0] / std::max(segments, 1.0),
+      path_length, checksum };
+   return result;
+}
+
+int main(int argc, char** argv)
+{
+   bool sized = argc > 2 && argv[1][0] != '-';
+   int width = sized ? atoi(argv[1]) : 320;
+   int height = sized ? atoi(argv[2]) : 240;
+   size_t num_rays = 1000000;
+   int repeats = 5;
+   for (int i = 1; i + 1 < argc; i++)
+   {
+      if (strcmp(argv[i], "--rays") == 0) num_rays = (size_t) std::max(1, atoi(argv[++i]));
+      else if (strcmp(argv[i], "--repeats") == 0) repeats = std::max(1, atoi(argv[++i]));
+   }
+   parse_render_settings(argc, argv);
+   const render_settings& settings = global_render_settings();
+   int num_threads = settings.num_threads > 0 ? settings.num_threads : thread_pool::default_size();
+   float aspect = width / float(height);
+
+   // the ray sets depend on the seed alone
+   thread_rng().seed(0, 0, settings.seed);
+   vector<kernel_result> kernels;
+   material_id empty = -1;
+
+   {
+      sphere s(point3(0), 1.0f, empty);
+      vector<ray> rays = rays_toward(num_rays, 4.0f, point3(-1.5f), point3(1.5f));
+      kernels.push_back(time_kernel("sphere::hit", rays.size(), repeats, [&](size_t i) {
+         hit_record rec;
+         return s.hit(rays[i], 0.001f, infinity, rec);
+      }));
+   }
+
+   {
+      plane p(point3(0), vec3(0, 1, 0), empty);
+      vector<ray> rays = rays_toward(num_rays, 4.0f, point3(-4.0f), point3(4.0f));
+      kernels.push_back(time_kernel("plane::hit", rays.size(), repeats, [&](size_t i) {
+         hit_record rec;
+         return p.hit(rays[i], 0.001f, infinity, rec);
+      }));
+   }
+
+   {
+      triangle T(point3(-1, -1, 0), point3(1, -1, 0), point3(0, 1, 0), empty);
+      vector<ray> rays = rays_toward(num_rays, 4.0f, point3(-1.5f, -1.5f, 0), point3(1.5f, 1.5f, 0));
+      kernels.push_back(time_kernel("triangle::hit", rays.size(), repeats, [&](size_t i) {
+         hit_record rec;
+         return T.hit(rays[i], 0.001f, infinity, rec);
+      }));
+   }
+
+   {
+      // a segment is only hit by rays in a plane through it, so aim rays along the z = 0 plane
+      line l(point3(-1, 0, 0), point3(1, 0, 0), empty);
+      vector<ray> rays = rays_toward(num_rays, 4.0f, point3(-2, 0, 0), point3(2, 0, 0));
+      for (ray& r : rays)
+      {
+         r.orig.z = 0;
+         r.dir.z = 0;
+      }
+      kernels.push_back(time_kernel("line::hit", rays.size(), repeats, [&](size_t i) {
+         hit_record rec;
+         return l.hit(rays[i], 0.001f, infinity, rec);
+      }));
+   }
+
+   {
+      // a wavy grid of 100 x 50 squares, each split in two
+      triangle_mesh mesh(empty);
+      for (int j = 0; j <= 50; j++)
+      {
+         for (int i = 0; i <= 100; i++)
+         {
+            float x = i / 100.0f, z = j / 50.0f;
+            mesh.add_vertex(point3(8 * x - 4, 0.5f * sin(12 * x) * cos(9 * z), 4 * z - 2));
+         }
+      }
+      for (int j = 0; j < 50; j++)
+      {
+         for (int i = 0; i < 100; i++)
+         {
+            int k = j * 101 + i;
+            mesh.add_triangle(k, k + 1, k + 102);
+            mesh.add_triangle(k, k + 102, k + 101);
+         }
+      }
+      mesh.build();
+      vector<ray> rays = rays_toward(num_rays, 5.0f, point3(-5, -1, -3), point3(5, 1, 3));
+      kernels.push_back(time_kernel("triangle_mesh::hit (10k triangles)", rays.size(), repeats, [&](size_t i) {
+         hit_record rec;
+         return mesh.hit(rays[i], 0.001f, infinity, rec);
+      }));
+   }
+
+   {
+      hittable_list world;
+      space_station(world, point3(0));
+      world.build_bvh();
+      vector<ray> primary = camera_rays(space_station_camera(aspect), width, height, num_rays);
+      vector<ray> secondary = bounce_rays(primary, world, num_rays);
+      kernels.push_back(time_kernel("hittable_list::hit (space station, primary)", primary.size(), repeats, [&](size_t i) {
+         hit_record rec;
+         return world.hit(primary[i], 0.001f, infinity, rec);
+      }));
+      kernels.push_back(time_kernel("hittable_list::hit (space station, secondary)", secondary.size(), repeats, [&](size_t i) {
+         hit_record rec;
+         return world.hit(secondary[i], 0.001f, infinity, rec);
+      }));
+      kernels.push_back(time_kernel("hittable_list::occluded (space station, secondary)", secondary.size(), repeats, [&](size_t i) {
+         return world.occluded(secondary[i], 0.001f, infinity);
+      }));
+   }
+
+   {
+      // the hits of camera rays on the materials scene, shaded with each material in turn
+      hittable_list world;
+      materials_scene(world, point3(0, 0, 6));
+      world.build_bvh();
+      vector<ray> primary = camera_rays(materials_camera(aspect), width, height, num_rays);
+      vector<ray> rays;
+      vector<hit_record> hits;
+      for (const ray& r : primary)
+      {
+         hit_record rec;
+         if (world.hit(r, 0.001f, infinity, rec))
+         {
+            rays.push_back(r);
+            hits.push_back(rec);
+         }
+      }
+
+      shared_ptr<material> shaders[] = {
+         make_shared<lambertian>(color(0.5f)),
+         make_shared<metal>(color(1, 0, 0), 0.3f),
+         make_shared<dielectric>(1.5f),
+         make_shared<phong>(point3(0, 0, 6))
+      };
+      const char* names[] = { "lambertian::scatter", "metal::scatter", "dielectric::scatter", "phong::scatter (shadow ray)" };
+      for (int m = 0; m < 4; m++)
+      {
+         const material& shader = *shaders[m];
+         kernels.push_back(time_kernel(names[m], rays.size(), repeats, [&](size_t i) {
+            color attenuation;
+            ray scattered;
+            return shader.scatter(rays[i], hits[i], world, attenuation, scattered);
+         }));
+      }
+   }
+
+   vector<scene_result> scenes;
+   {
+      hittable_list world;
+      space_station(world, point3(0));
+      world.build_bvh();
+      scenes.push_back(time_scene("basic", world, space_station_camera(aspect), space_background, width, height, repeats));
+   }
+   {
+      hittable_list world;
+      materials_scene(world, point3(0, 0, 6));
+      world.build_bvh();
+      scenes.push_back(time_scene("materials", world, materials_camera(aspect), sky_background, width, height, repeats));
+   }
+   {
+      hittable_list world;
+      raytracer_scene(world);
+      world.build_bvh();
+      scenes.push_back(time_scene("raytracer", world, raytracer_camera(aspect), sky_background, width, height, repeats));
+   }
+
+   printf("{\n");
+   printf("  \"config\": { \"rays\": %zu, \"repeats\": %d, \"width\": %d, \"height\": %d, \"samples_per_pixel\": 10, "
+      "\"seed\": %u, \"threads\": %d },\n", num_rays, repeats, width, height, settings.seed, num_threads);
+   printf("  \"kernels\": [\n");
+   for (size_t i = 0; i < kernels.size(); i++)
+   {
+      const kernel_result& k = kernels[i];
+      printf("    { \"name\": \"%s\", \"rays\": %zu, \"ns_per_ray\": %.2f, \"ns_per_ray_median\": %.2f, \"hit_rate\": %.4f }%s\n",
+         k.name.c_str(), k.rays, k.best_ns, k.median_ns, k.hit_rate, i + 1 < kernels.size() ? "," : "");
+   }
+   printf("  ],\n");
+   printf("  \"scenes\": [\n");
+   for (size_t i = 0; i < scenes.size(); i++)
+   {
+      const scene_result& s = scenes[i];
+      printf("    { \"name\": \"%s\", \"seconds\": %.4f, \"seconds_median\": %.4f, \"ns_per_ray\": %.2f, "
+         "\"average_path_length\": %.4f, \"checksum\": %llu }%s\n",
+         s.name.c_str(), s.best_seconds, s.median_seconds, s.ns_per_ray, s.average_path_length, s.checksum,
+         i + 1 < scenes.size() ? "," : "");
+   }
+   printf("  ]\n");
+   printf("}\n");
+   return 0;
+}
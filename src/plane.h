@@ -6,9 +6,9 @@
 
 class plane : public hittable {
 public:
-   plane() : a(0), n(glm::vec3(1,0,0)), mat_ptr(0) {}
+   plane() : a(0), n(glm::vec3(1,0,0)), mat_id(-1) {}
    plane(const glm::point3& p, const glm::vec3& normal, 
-      std::shared_ptr<material> m) : a(p), n(normal), mat_ptr(m) {
+      material_id m) : a(p), n(normal), mat_id(m) {
          assert(glm::length(n) > 0 && "The normal vector of a plane cannot be 0!");
          // make sure the normal follows right hand rule, i.e. it always points left or outside the screen
          if (n[0] > 0 || n[1] < 0 || n[2] < 0)
@@ -17,8 +17,10 @@ public:
          }
       };
 
-   virtual bool hit(const ray& r, hit_record& rec) const override
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override
    {
+      RT_COUNT(tests);
+
       // necessary dot product computations 
       float d = glm::dot(r.direction(), n);
       glm::vec3 u = a - r.origin();
@@ -36,29 +38,49 @@ public:
       else{
          // the ray is not parallel with the plane. Then we compute t using the formula with dot product
          t = q/d;
-         // the ray points away from the plane if t is negative
-         if (t < 0)
-         {
-            return false;
-         }
       }
 
+      // the plane is hit outside the interval (e.g. behind the ray, when t is negative)
+      if (t < t_min || t > t_max)
+      {
+         return false;
+      }
+
+      // save the time when we hit the object; complete_hit() fills the rest
+      rec.t = t;
+      return true;
+   }
+
+   virtual void complete_hit(const ray& r, hit_record& rec) const override
+   {
       // save relevant data in hit record
-      rec.t = t; // save the time when we hit the object
-      rec.p = r.at(t); // ray.origin + t * ray.direction
-      rec.mat_ptr = mat_ptr; 
+      rec.p = r.at(rec.t); // ray.origin + t * ray.direction
+      rec.mat_id = mat_id; 
       
       // save normal
       glm::vec3 outward_normal = normalize(n); // compute unit length normal
       rec.set_face_normal(r, outward_normal);
-      
-      return true;
+   }
+
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override
+   {
+      RT_COUNT(tests);
+
+      // a ray parallel with the plane gives an infinite or undefined t and fails the test
+      float t = glm::dot(a - r.origin(), n) / glm::dot(r.direction(), n);
+      return t >= t_min && t <= t_max;
+   }
+
+   virtual bool bounding_box(aabb& output_box) const override
+   {
+      // a plane is unbounded
+      return false;
    }
 
 public:
    glm::vec3 a;
    glm::vec3 n;
-   std::shared_ptr<material> mat_ptr;
+   material_id mat_id;
 };
 
 #endif
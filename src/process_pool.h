@@ -0,0 +1,288 @@
+// process_pool.h, worker processes that take items from a coordinator over local sockets
+// The pool forks its workers, so they start with everything the coordinator has loaded (e.g. the
+// scene) and do not load it again. Each worker holds one end of a socket pair: the coordinator
+// sends it an item number, the worker runs the work function on it and sends back the bytes of
+// the result. A worker that dies, or sends back a broken result, loses its item to the others.
+// Processes need a POSIX system; elsewhere the pool has no workers and run() returns every item.
+
+#ifndef PROCESS_POOL_H_
+#define PROCESS_POOL_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_PROCESSES
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+class process_pool {
+public:
+   // work(item, result) runs in the workers and fills result with the bytes to send back
+   typedef std::function<void(int, std::string&)> work_fn;
+   // result(item, bytes) runs in the coordinator; it returns false to reject a broken result
+   typedef std::function<bool(int, const std::string&)> result_fn;
+
+   // fork num_processes workers. Fork before starting threads: the workers only get the
+   // calling thread.
+   process_pool(int num_processes, const work_fn& work);
+
+   // stop the workers and wait for them
+   ~process_pool();
+
+   // the workers that are still alive
+   int size() const;
+
+   // send every item to a worker, one at a time per worker, and pass each result to result() as
+   // it comes in. Returns the items that no worker finished because every worker died.
+   std::vector<int> run(const std::vector<int>& items, const result_fn& result);
+
+private:
+   struct worker {
+      int pid;
+      int fd;   // the coordinator end of the socket; -1 once the worker is gone
+      int item; // the item it works on; -1 if idle
+   };
+
+   void stop(worker& w, bool wait_for_exit);
+
+   std::vector<worker> workers;
+};
+
+#ifdef RT_PROCESSES
+
+// read or write exactly size bytes; false on end of file or error
+inline bool read_exact(int fd, void* data, size_t size)
+{
+   char* p = (char*) data;
+   while (size > 0)
+   {
+      ssize_t n = read(fd, p, size);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      p += n;
+      size -= n;
+   }
+   return true;
+}
+
+inline bool write_exact(int fd, const void* data, size_t size)
+{
+   int flags = 0;
+#ifdef MSG_NOSIGNAL
+   flags = MSG_NOSIGNAL; // a dead peer is an error, not a SIGPIPE
+#endif
+   const char* p = (const char*) data;
+   while (size > 0)
+   {
+      ssize_t n = send(fd, p, size, flags);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      p += n;
+      size -= n;
+   }
+   return true;
+}
+
+// the loop of a worker process: items come in as an int32 (a negative one stops the worker),
+// results go out as their uint64 size and their bytes
+inline void worker_main(int fd, const process_pool::work_fn& work)
+{
+   int32_t item;
+   while (read_exact(fd, &item, sizeof(item)) && item >= 0)
+   {
+      std::string result;
+      work(item, result);
+      uint64_t size = result.size();
+      if (!write_exact(fd, &size, sizeof(size)) || !write_exact(fd, result.data(), result.size())) break;
+   }
+   // skip the destructors and buffered output the worker shares with the coordinator
+   _exit(0);
+}
+
+process_pool::process_pool(int num_processes, const work_fn& work)
+{
+   // output still buffered would be written by every worker too
+   std::cout.flush();
+   std::cerr.flush();
+   fflush(0);
+
+   for (int i = 0; i < num_processes; i++)
+   {
+      int ends[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0)
+      {
+         perror("socketpair");
+         break;
+      }
+#ifdef SO_NOSIGPIPE
+      int on = 1;
+      setsockopt(ends[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+      setsockopt(ends[1], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+      pid_t pid = fork();
+      if (pid < 0)
+      {
+         perror("fork");
+         close(ends[0]);
+         close(ends[1]);
+         break;
+      }
+      if (pid == 0)
+      {
+         for (const worker& w : workers) close(w.fd);
+         close(ends[0]);
+         worker_main(ends[1], work);
+      }
+      close(ends[1]);
+      worker w = { (int) pid, ends[0], -1 };
+      workers.push_back(w);
+   }
+}
+
+process_pool::~process_pool()
+{
+   for (worker& w : workers)
+   {
+      if (w.fd < 0) continue;
+      int32_t quit = -1;
+      write_exact(w.fd, &quit, sizeof(quit));
+      stop(w, true);
+   }
+}
+
+int process_pool::size() const
+{
+   int alive = 0;
+   for (const worker& w : workers)
+   {
+      if (w.fd >= 0) alive++;
+   }
+   return alive;
+}
+
+void process_pool::stop(worker& w, bool wait_for_exit)
+{
+   close(w.fd);
+   w.fd = -1;
+   w.item = -1;
+   // a worker that broke off may still be running
+   if (!wait_for_exit) kill(w.pid, SIGKILL);
+   waitpid(w.pid, 0, 0);
+}
+
+std::vector<int> process_pool::run(const std::vector<int>& items, const result_fn& result)
+{
+   std::deque<int> pending(items.begin(), items.end());
+
+   // give every idle worker an item
+   auto assign = [&]()
+   {
+      for (worker& w : workers)
+      {
+         while (w.fd >= 0 && w.item < 0 && !pending.empty())
+         {
+            int32_t item = pending.front();
+            if (!write_exact(w.fd, &item, sizeof(item)))
+            {
+               std::cerr << "worker " << w.pid << " is gone" << std::endl;
+               stop(w, false);
+               break;
+            }
+            w.item = item;
+            pending.pop_front();
+         }
+      }
+   };
+   assign();
+
+   std::vector<pollfd> fds;
+   std::vector<worker*> busy;
+   while (true)
+   {
+      fds.clear();
+      busy.clear();
+      for (worker& w : workers)
+      {
+         if (w.fd < 0 || w.item < 0) continue;
+         pollfd p = { w.fd, POLLIN, 0 };
+         fds.push_back(p);
+         busy.push_back(&w);
+      }
+      // done, or every worker died
+      if (fds.empty()) break;
+
+      if (poll(fds.data(), fds.size(), -1) < 0)
+      {
+         if (errno == EINTR) continue;
+         perror("poll");
+         break;
+      }
+      for (size_t k = 0; k < fds.size(); k++)
+      {
+         if (fds[k].revents == 0) continue;
+         worker& w = *busy[k];
+         int item = w.item;
+         uint64_t size;
+         std::string bytes;
+         // a size beyond 4 GB is garbage from a broken worker
+         bool ok = read_exact(w.fd, &size, sizeof(size)) && size < (1ull << 32);
+         if (ok)
+         {
+            bytes.resize((size_t) size);
+            ok = read_exact(w.fd, &bytes[0], bytes.size()) && result(item, bytes);
+         }
+         if (ok)
+         {
+            w.item = -1;
+         }
+         else
+         {
+            std::cerr << "worker " << w.pid << " died; item " << item << " goes to another" << std::endl;
+            pending.push_front(item);
+            stop(w, false);
+         }
+      }
+      assign();
+   }
+
+   // items left in flight belong to no one any more
+   for (worker& w : workers)
+   {
+      if (w.item >= 0) pending.push_front(w.item);
+   }
+   return std::vector<int>(pending.begin(), pending.end());
+}
+
+#else
+
+process_pool::process_pool(int num_processes, const work_fn& work)
+{
+   if (num_processes > 0) std::cerr << "worker processes are not supported here" << std::endl;
+}
+
+process_pool::~process_pool() {}
+
+int process_pool::size() const { return 0; }
+
+void process_pool::stop(worker& w, bool wait_for_exit) {}
+
+std::vector<int> process_pool::run(const std::vector<int>& items, const result_fn& result)
+{
+   return items;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,248 @@
+// ray_stream.h, many rays traced through the world together, e.g. the camera rays of a tile
+// The camera rays of neighboring pixels are nearly parallel, so they enter the same bvh nodes in
+// the same order. A ray_stream keeps its rays component by component (as soa_array does for
+// primitives), and hit_stream() walks the world bvh once for each packet of up to packet_size of
+// them: a node is fetched once for the whole packet, its box is tested against 8 rays per
+// instruction, and it is skipped as soon as no ray of the packet enters it. The walk follows the
+// first ray of the packet that is still in the node ("ranged" traversal: Wald, Slusallek,
+// Benthin and Wagner, "Interactive Rendering with Coherent Ray Tracing", 2001, and Overbeck,
+// Ramamoorthi and Mark, "Large Ray Packets for Real-Time Whitted Ray Tracing", 2008). The
+// objects in a leaf are still asked one ray at a time, so each ray ends with the hit that
+// hittable_list::hit() finds for it.
+
+#ifndef RAY_STREAM_H_
+#define RAY_STREAM_H_
+
+#include "AGLM.h"
+#include "ray.h"
+#include "hittable_list.h"
+#include "simd.h"
+#include "rng.h"
+#include "denoise.h"
+#include "instrument.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// the components of a ray in a soa_array: its origin, 1 / its direction, and its interval
+enum ray_component {
+   ray_ox, ray_oy, ray_oz, ray_ix, ray_iy, ray_iz, ray_t_min, ray_t_max, ray_components
+};
+
+// rays traced together share the nodes of a packet of at most this many
+const int packet_size = 64;
+
+class ray_stream {
+public:
+   ray_stream() {}
+
+   // n rays, all to be set with set()
+   void resize(int n) {
+      rays.resize(n);
+      soa.resize(n, ray_components);
+      hits.resize(n);
+      closest.assign(n, 0);
+   }
+
+   int size() const { return (int) rays.size(); }
+
+   // ray k looks for hits in [t_min, t_max]
+   void set(int k, const ray& r, float t_min, float t_max) {
+      rays[k] = r;
+      glm::vec3 inv_dir = 1.0f / r.direction();
+      soa[ray_ox][k] = r.origin().x;
+      soa[ray_oy][k] = r.origin().y;
+      soa[ray_oz][k] = r.origin().z;
+      soa[ray_ix][k] = inv_dir.x;
+      soa[ray_iy][k] = inv_dir.y;
+      soa[ray_iz][k] = inv_dir.z;
+      soa[ray_t_min][k] = t_min;
+      soa[ray_t_max][k] = t_max;
+      closest[k] = 0;
+   }
+
+   // after hit_stream(): whether ray k hits anything; hits[k] is then its hit
+   bool hit(int k) const { return closest[k] != 0; }
+
+public:
+   std::vector<ray> rays;
+   soa_array soa; // t_max drops to the nearest hit found so far
+   std::vector<hit_record> hits;
+   std::vector<const hittable*> closest; // the object each ray hits, or null
+};
+
+// the rays from first to end - 1 that enter box, as bits from first (bit 0 is ray first).
+// end - first is at most packet_size.
+uint64_t box_hits_scalar(const soa_array& s, int first, int end, const aabb& box)
+{
+   uint64_t mask = 0;
+   for (int k = first; k < end; k++)
+   {
+      // the slab test of aabb::hit(), on the components of ray k
+      float t_min = s[ray_t_min][k];
+      float t_max = s[ray_t_max][k];
+      for (int a = 0; a < 3; a++)
+      {
+         float inv = s[ray_ix + a][k];
+         float t0 = (box.minimum[a] - s[ray_ox + a][k]) * inv;
+         float t1 = (box.maximum[a] - s[ray_ox + a][k]) * inv;
+         if (inv < 0.0f) std::swap(t0, t1);
+         t_min = t0 > t_min ? t0 : t_min;
+         t_max = t1 < t_max ? t1 : t_max;
+      }
+      if (t_max >= t_min) mask |= uint64_t(1) << (k - first);
+   }
+   return mask;
+}
+
+#ifdef RT_SIMD_X86
+
+// AVX2: 8 rays per step, with the comparisons of the scalar test, so both find the same rays.
+// Lanes past end are masked off; the padding of soa_array keeps their loads in bounds.
+__attribute__((target("avx2")))
+uint64_t box_hits_avx2(const soa_array& s, int first, int end, const aabb& box)
+{
+   uint64_t mask = 0;
+   for (int k = first; k < end; k += 8)
+   {
+      __m256 t_min = _mm256_loadu_ps(s[ray_t_min] + k);
+      __m256 t_max = _mm256_loadu_ps(s[ray_t_max] + k);
+      for (int a = 0; a < 3; a++)
+      {
+         __m256 inv = _mm256_loadu_ps(s[ray_ix + a] + k);
+         __m256 o = _mm256_loadu_ps(s[ray_ox + a] + k);
+         __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.minimum[a]), o), inv);
+         __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.maximum[a]), o), inv);
+         // the sign bit of inv swaps the planes; max and min keep their second operand on NaN,
+         // as the scalar comparisons do
+         __m256 near = _mm256_blendv_ps(t0, t1, inv);
+         __m256 far = _mm256_blendv_ps(t1, t0, inv);
+         t_min = _mm256_max_ps(near, t_min);
+         t_max = _mm256_min_ps(far, t_max);
+      }
+      int lanes = _mm256_movemask_ps(_mm256_cmp_ps(t_max, t_min, _CMP_GE_OQ));
+      if (end - k < 8) lanes &= (1 << (end - k)) - 1;
+      mask |= uint64_t(lanes) << (k - first);
+   }
+   return mask;
+}
+
+// the first ray from first on that enters box, or end
+__attribute__((target("avx2")))
+int first_box_hit_avx2(const soa_array& s, int first, int end, const aabb& box)
+{
+   for (int k = first; k < end; k += 8)
+   {
+      uint64_t lanes = box_hits_avx2(s, k, std::min(k + 8, end), box);
+      if (lanes) return k + __builtin_ctzll(lanes);
+   }
+   return end;
+}
+
+#endif
+
+int first_box_hit_scalar(const soa_array& s, int first, int end, const aabb& box)
+{
+   for (int k = first; k < end; k++)
+   {
+      if (box_hits_scalar(s, k, k + 1, box)) return k;
+   }
+   return end;
+}
+
+// find the nearest hit of every ray of the stream in the world, as world.hit() would, and
+// complete its hit record
+void hit_stream(const hittable_list& world, ray_stream& stream)
+{
+   int n = stream.size();
+   if (!world.accelerated)
+   {
+      for (int k = 0; k < n; k++)
+      {
+         float t_min = stream.soa[ray_t_min][k];
+         float t_max = stream.soa[ray_t_max][k];
+         if (world.hit(stream.rays[k], t_min, t_max, stream.hits[k])) stream.closest[k] = stream.hits[k].object;
+      }
+      return;
+   }
+
+#ifdef RT_SIMD_X86
+   bool avx2 = active_simd_level() == simd_avx2;
+#else
+   bool avx2 = false;
+#endif
+   soa_array& s = stream.soa;
+   float* t_min = s[ray_t_min];
+   float* t_max = s[ray_t_max];
+   hit_record temp_rec;
+
+   for (int begin = 0; begin < n; begin += packet_size)
+   {
+      int end = std::min(n, begin + packet_size);
+      RT_ADD(rays, end - begin);
+
+      // the first ray from first on that enters the box of a node
+      auto first_hit = [&](const aabb& box, int first) -> int
+      {
+#ifdef RT_SIMD_X86
+         if (avx2) return first_box_hit_avx2(s, first, end, box);
+#endif
+         return first_box_hit_scalar(s, first, end, box);
+      };
+
+      // test the objects of a leaf against the rays from first on that enter it
+      auto leaf = [&](const bvh_node& node, int first)
+      {
+#ifdef RT_SIMD_X86
+         uint64_t mask = avx2 ? box_hits_avx2(s, first, end, node.box) : box_hits_scalar(s, first, end, node.box);
+#else
+         uint64_t mask = box_hits_scalar(s, first, end, node.box);
+#endif
+         for (int i = node.offset; i < node.offset + node.count; i++)
+         {
+            const scene_objects::ref& object = world.bounded_refs[i];
+            for (int k = first; k < end; k++)
+            {
+               if (!(mask >> (k - first) & 1)) continue;
+               if (world.bounded_copies.intersect(object, stream.rays[k], t_min[k], t_max[k], temp_rec))
+               {
+                  t_max[k] = temp_rec.t;
+                  stream.hits[k] = temp_rec;
+                  stream.closest[k] = object.object;
+               }
+            }
+         }
+      };
+
+      auto dir_neg = [&](int k, int axis) { return s[ray_ix + axis][k] < 0; };
+      world.accel.traverse_packet(begin, end, first_hit, dir_neg, leaf);
+   }
+
+   for (int k = 0; k < n; k++)
+   {
+      scene_objects::ref nearest = {};
+      if (world.unbounded_copies.intersect_all(stream.rays[k], t_min[k], t_max[k], stream.hits[k], nearest))
+      {
+         stream.closest[k] = nearest.object;
+      }
+      if (!stream.closest[k]) continue;
+      stream.closest[k]->complete_hit(stream.rays[k], stream.hits[k]);
+      stream.hits[k].object = stream.closest[k];
+   }
+}
+
+// one camera sample traced in a stream: render() sets the ray and the random stream the sample
+// continues with, and the tracer sets its color, its first hit (for the denoiser) and its counters
+struct stream_sample {
+   ray r;
+   rng state;
+   glm::color color;
+   sample_features features;
+   pixel_stats stats;
+};
+
+// traces the camera samples given to it, e.g. path_tracer::trace_stream(); see render()
+typedef std::function<void(std::vector<stream_sample>&)> stream_fn;
+
+#endif
@@ -8,51 +8,24 @@
 #include "camera.h"
 #include "material.h"
 #include "hittable_list.h"
+#include "render.h"
+#include "integrator.h"
+#include "scenes.h"
+#include "scene_file.h"
+#include "render_settings.h"
 
 using namespace glm;
 using namespace agl;
 using namespace std;
 
-color ray_color(const ray& r, const hittable_list& world, int depth)
+// the color of rays that leave the scene
+color background(const ray& r)
 {
-   hit_record rec;
-   if (depth <= 0)
-   {
-      return color(0);
-   }
-
-   if (world.hit(r, 0.001f, infinity, rec))
-   {
-      ray scattered;
-      color attenuation;
-      if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-      {
-         color recurseColor = ray_color(scattered, world, depth - 1);
-         return attenuation * recurseColor;
-      }
-      return attenuation;
-   }
    vec3 unit_direction = normalize(r.direction());
    auto t = 0.5f * (unit_direction.y + 1.0f);
    return (1.0f - t) * color(1, 1, 1) + t * color(0.5f, 0.7f, 1.0f);
 }
 
-color normalize_color(const color& c, int samples_per_pixel)
-{
-   // todo: implement me!
-   float scale = 1.0f / samples_per_pixel;
-   float r = std::min(0.999f, std::max(0.0f, c.r * scale));
-   float g = std::min(0.999f, std::max(0.0f, c.g * scale));
-   float b = std::min(0.999f, std::max(0.0f, c.b * scale));
-
-   // apply gamma correction 
-   r = sqrt(r);
-   g = sqrt(g);
-   b = sqrt(b);
-
-   return color(r, g, b);
-}
-
 void ray_trace(ppm_image& image)
 {
    // Image
@@ -62,37 +35,37 @@ void ray_trace(ppm_image& image)
    int samples_per_pixel = 10; // higher => more anti-aliasing
    int max_depth = 10; // higher => less shadow acne
 
-   // World
-   shared_ptr<material> gray = make_shared<lambertian>(color(0.5f));
+   // Camera
+   camera cam = raytracer_camera(aspect);
 
+   // World
    hittable_list world;
-   world.add(make_shared<sphere>(point3(0, 0, -1), 0.5f, gray));
-   world.add(make_shared<sphere>(point3(0, -100.5, -1), 100, gray));
-
-   // Camera
-   vec3 camera_pos(0);
-   float viewport_height = 2.0f;
-   float focal_length = 1.0;
-   camera cam(camera_pos, viewport_height, aspect, focal_length);
+   const std::string& scene_file = global_render_settings().scene_file;
+   if (!scene_file.empty())
+   {
+      // a scene file replaces the built-in scene, and its camera (if it has one) the camera above
+      scene_camera view;
+      if (!load_scene(scene_file, world, view, global_render_settings().num_threads)) return;
+      if (view.defined) cam = view.make_camera(aspect);
+   }
+   else
+   {
+      raytracer_scene(world);
+      world.build_bvh();
+   }
 
    // Ray trace
-   for (int j = 0; j < height; j++)
+   global_render_settings().scene_name = "raytracer";
+   global_render_settings().max_depth = max_depth;
+   path_tracer tracer(world, background, max_depth);
+   render(image, cam, samples_per_pixel, [&](const ray& r)
    {
-      for (int i = 0; i < width; i++)
-      {
-         color c(0, 0, 0);
-         for (int s = 0; s < samples_per_pixel; s++) // antialias
-         {
-            float u = float(i + random_float()) / (width - 1);
-            float v = float(height - j - 1 - random_float()) / (height - 1);
-
-            ray r = cam.get_ray(u, v);
-            c += ray_color(r, world, max_depth);
-         }
-         c = normalize_color(c, samples_per_pixel);
-         image.set_vec3(j, i, c);
-      }
-   }
+      return tracer.trace(r);
+   }, [&](std::vector<stream_sample>& samples)
+   {
+      tracer.trace_stream(samples);
+   });
+   cout << "average path length: " << tracer.average_path_length() << endl;
 
-   image.save("raytracer.png");
+   save_render(image, "raytracer");
 }
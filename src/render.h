@@ -0,0 +1,658 @@
+// render.h, the parallel render driver shared by the ray tracers
+// The image is split into square tiles which a work stealing thread pool renders in parallel.
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include "AGLM.h"
+#include "ray.h"
+#include "camera.h"
+#include "ppm_image.h"
+#include "render_settings.h"
+#include "thread_pool.h"
+#include "tile.h"
+#include "instrument.h"
+#include "denoise.h"
+#include "hdr_image.h"
+#include "checkpoint.h"
+#include "process_pool.h"
+#include "sampler.h"
+#include "ray_stream.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#ifdef RT_INSTRUMENT
+#include <chrono>
+#include <cstdio>
+#endif
+
+// average the samples of a pixel, clamp and gamma correct it
+glm::color normalize_color(const glm::color& c, int samples_per_pixel)
+{
+   float scale = 1.0f / samples_per_pixel;
+   float r = std::min(0.999f, std::max(0.0f, c.r * scale));
+   float g = std::min(0.999f, std::max(0.0f, c.g * scale));
+   float b = std::min(0.999f, std::max(0.0f, c.b * scale));
+
+   // apply gamma correction
+   r = sqrt(r);
+   g = sqrt(g);
+   b = sqrt(b);
+
+   return glm::color(r, g, b);
+}
+
+// running mean and variance of the luminance of the samples of a pixel (Welford's method)
+struct pixel_variance {
+   pixel_variance() : n(0), mean(0), m2(0) {}
+
+   void add(const glm::color& c) {
+      float y = luminance(c);
+      n++;
+      float delta = y - mean;
+      mean += delta / n;
+      m2 += delta * (y - mean);
+   }
+
+   // the variance of the mean luminance
+   float mean_variance() const {
+      return n < 2 ? 0.0f : m2 / ((n - 1) * float(n));
+   }
+
+   // the spread of one sample once gamma corrected: its standard deviation, times the slope of
+   // sqrt() at the mean, so that dark pixels, where noise shows most, need less of it
+   float spread() const {
+      if (n < 2) return 0.0f;
+      return sqrt(m2 / (n - 1)) / (2.0f * sqrt(std::max(mean, 1e-4f)));
+   }
+
+   // the expected error of the pixel once gamma corrected, the standard error of its mean. With
+   // prior_spread, the spread of a sample is taken as prior_spread for prior_weight samples as well
+   // as the spread of the samples taken, so that samples which happen to agree are not trusted
+   // until there are more of them.
+   float noise(float prior_spread = 0.0f, float prior_weight = 0.0f) const {
+      if (n < 2) return infinity;
+      float own = spread();
+      float variance = ((n - 1) * own * own + prior_weight * prior_spread * prior_spread) / (n - 1 + prior_weight);
+      return sqrt(variance / n);
+   }
+
+   int n;
+   float mean;
+   float m2;
+};
+
+// adaptive sampling starts every pixel with adaptive_min_samples samples, then adds adaptive_batch
+// at a time. A few first samples can all miss the light (e.g. behind glass) and agree, which
+// would look like a converged black pixel; so the average spread of the first samples of the
+// pixels of the tile counts as adaptive_prior_weight samples of the spread of each pixel.
+const int adaptive_min_samples = 4;
+const int adaptive_batch = 4;
+const float adaptive_prior_weight = 2.0f;
+
+// the number of samples each pixel of the last render took
+struct sample_map {
+   sample_map() : width(0), height(0) {}
+
+   void resize(int w, int h) {
+      width = w;
+      height = h;
+      counts.assign((size_t) w * h, 0);
+   }
+
+   // row j, column i, as in ppm_image
+   int& at(int j, int i) { return counts[(size_t) j * width + i]; }
+
+   double average() const {
+      double total = 0;
+      for (int count : counts) total += count;
+      return counts.empty() ? 0 : total / counts.size();
+   }
+
+   int width;
+   int height;
+   std::vector<int> counts;
+};
+
+inline sample_map& global_sample_map()
+{
+   static sample_map samples;
+   return samples;
+}
+
+// the sample sums and counts of the last render
+inline hdr_image& global_hdr_image()
+{
+   static hdr_image image;
+   return image;
+}
+
+// render the image with samples_per_pixel jittered camera rays per pixel.
+// radiance(r) returns the color seen along the ray r; it is called from several threads at once.
+// The number of threads, the tile size and the random seed come from global_render_settings().
+// Each sample seeds thread_rng() with (pixel, sample), so the result is the same for any
+// number of threads. The sampler of settings.sampler hands out the first numbers of the camera and
+// of each bounce (see sampler.h).
+// With settings.max_samples > 0, samples_per_pixel is ignored: each pixel takes
+// adaptive_min_samples samples, then batches of adaptive_batch until its noise() falls below
+// settings.noise_threshold or it reaches max_samples, so flat regions stop early and the budget
+// goes to noisy ones. The first samples of a tile set the prior of noise() for each of its pixels.
+// The counts are kept in global_sample_map().
+// With settings.denoise_passes > 0, the first hits of the samples are averaged into
+// global_feature_buffers(), and the image is denoised (see denoise.h) once every tile is done.
+// The sums and counts of the samples are kept in global_hdr_image(). With settings.add_to set,
+// render() first loads that earlier render and adds its samples to it: sample numbers go on from
+// the loaded counts, so they draw new random streams.
+// With settings.checkpoint_file set, the tiles that are done are saved to it every
+// settings.checkpoint_interval seconds, and once more at the end (see checkpoint.h). With
+// settings.resume, the tiles of that checkpoint are restored and not rendered again; they have no
+// counters in global_render_stats(). The program sets settings.scene_name and settings.max_depth
+// first, so that the checkpoint of another scene is not resumed.
+// With settings.num_workers > 0, the tiles are rendered by that many worker processes forked from
+// this one (see process_pool.h), which send back the samples of each tile; the tiles of a worker
+// that dies go to the others, and to the threads of this process if none are left. With
+// RT_INSTRUMENT, the workers send back the counters of the pixels of each tile as well.
+// With settings.streaming and a stream function (e.g. path_tracer::trace_stream()), the samples of
+// a tile are traced in rounds of one sample per pixel (see ray_stream.h), which gives the same
+// image. The counters of a pixel then include its share of the walks its rays made together.
+template <class RadianceFn>
+void render(agl::ppm_image& image, const camera& cam, int samples_per_pixel, const RadianceFn& radiance,
+   const stream_fn& stream = stream_fn())
+{
+   const render_settings& settings = global_render_settings();
+   int height = image.height();
+   int width = image.width();
+
+   std::vector<tile> tiles = make_tiles(width, height, settings.tile_size);
+#ifdef RT_INSTRUMENT
+   global_render_stats().resize(width, height);
+#endif
+   global_sample_map().resize(width, height);
+   bool adaptive = settings.max_samples > 0;
+   bool denoising = settings.denoise_passes > 0;
+   feature_buffers& features = global_feature_buffers();
+   if (denoising) features.resize(width, height);
+
+   hdr_image& hdr = global_hdr_image();
+   hdr.resize(width, height);
+   if (!settings.add_to.empty())
+   {
+      if (!hdr.load(settings.add_to) || hdr.width() != width || hdr.height() != height)
+      {
+         std::cerr << settings.add_to << ": cannot add samples to it; rendering from scratch" << std::endl;
+         hdr.resize(width, height);
+      }
+   }
+
+   int sampler_kind = sampler_id(settings.sampler);
+   if (sampler_kind < 0)
+   {
+      std::cerr << settings.sampler << ": unknown sampler; using independent samples" << std::endl;
+      sampler_kind = 0;
+   }
+   std::unique_ptr<sampler> samples = make_sampler(sampler_kind, settings.seed, width,
+      adaptive ? settings.max_samples : samples_per_pixel);
+
+   std::unique_ptr<render_checkpoint> checkpoint;
+   if (!settings.checkpoint_file.empty())
+   {
+      checkpoint_key key = { width, height, settings.tile_size, adaptive ? 0 : samples_per_pixel,
+         settings.max_samples, settings.noise_threshold, settings.seed, denoising, sampler_kind,
+         scene_stamp(settings.scene_name, settings.scene_file), settings.max_depth };
+      checkpoint.reset(new render_checkpoint(settings.checkpoint_file, settings.checkpoint_interval, key,
+         tiles, hdr, global_sample_map().counts, features));
+      if (settings.resume)
+      {
+         int restored = checkpoint->load();
+         std::cout << "resumed " << restored << " of " << tiles.size() << " tiles" << std::endl;
+      }
+   }
+
+   // show the samples of a tile that was rendered elsewhere
+   auto show_tile = [&](int k)
+   {
+      const tile& t = tiles[k];
+      for (int j = t.y0; j < t.y1; j++)
+      {
+         for (int i = t.x0; i < t.x1; i++)
+         {
+            image.set_vec3(j, i, normalize_color(hdr.sum(j, i), hdr.count(j, i)));
+         }
+      }
+   };
+
+   std::vector<int> pending;
+   for (int k = 0; k < (int) tiles.size(); k++)
+   {
+      if (checkpoint && checkpoint->done(k)) show_tile(k);
+      else pending.push_back(k);
+   }
+
+   // a pixel being rendered: its samples so far, and the number it should reach
+   struct pixel_state {
+      int j, i;
+      glm::color c;
+      int first, s, target, last;
+      glm::color albedo;
+      glm::vec3 normal;
+      float depth;
+      pixel_variance variance;
+      float prior_spread; // of the tile, once every pixel of it has its first samples
+      bool done;
+      pixel_stats stats;
+   };
+
+   auto start_pixel = [&](int j, int i) -> pixel_state
+   {
+      // start from the samples of an earlier render, if any
+      pixel_state p;
+      p.j = j;
+      p.i = i;
+      p.c = hdr.sum(j, i);
+      p.first = hdr.count(j, i);
+      p.s = p.first;
+      p.target = p.first + (adaptive ? std::min(adaptive_min_samples, settings.max_samples) : samples_per_pixel);
+      p.last = p.first + settings.max_samples;
+      p.albedo = glm::color(0);
+      p.normal = glm::vec3(0);
+      p.depth = 0;
+      p.prior_spread = 0;
+      p.done = false;
+      return p;
+   };
+
+   // the pixels of tile k, in rows
+   auto start_tile = [&](int k) -> std::vector<pixel_state>
+   {
+      const tile& t = tiles[k];
+      std::vector<pixel_state> pixels;
+      for (int j = t.y0; j < t.y1; j++)
+      {
+         for (int i = t.x0; i < t.x1; i++)
+         {
+            pixels.push_back(start_pixel(j, i));
+         }
+      }
+      return pixels;
+   };
+
+   // once the pixels of a tile have their first samples, give each the average spread of them
+   auto set_prior = [&](std::vector<pixel_state>& pixels)
+   {
+      if (!adaptive || pixels.empty()) return;
+      double total = 0;
+      for (const pixel_state& p : pixels) total += p.variance.spread();
+      for (pixel_state& p : pixels) p.prior_spread = float(total / pixels.size());
+   };
+
+   // whether pixel p takes another sample; once it reaches its target, adaptive sampling may
+   // raise the target by a batch
+   auto needs_sample = [&](pixel_state& p) -> bool
+   {
+      if (p.done) return false;
+      if (p.s < p.target) return true;
+      if (!adaptive || p.s >= p.last ||
+         p.variance.noise(p.prior_spread, adaptive_prior_weight) < settings.noise_threshold)
+      {
+         p.done = true;
+         return false;
+      }
+      p.target = std::min(p.s + adaptive_batch, p.last);
+      return true;
+   };
+
+   // the camera ray of the next sample of pixel p, with thread_rng() seeded for that sample
+   auto camera_ray = [&](const pixel_state& p) -> ray
+   {
+      // every sample owns its random stream, so the image does not depend on the threads
+      thread_rng().seed(p.j * width + p.i, p.s, settings.seed, samples.get());
+
+      float u = float(p.i + random_float()) / (width - 1);
+      float v = float(height - p.j - 1 - random_float()) / (height - 1);
+      return cam.get_ray(u, v);
+   };
+
+   auto add_sample = [&](pixel_state& p, const glm::color& sample, const sample_features& first_hit)
+   {
+      p.c += sample;
+      p.s++;
+      if (adaptive || denoising) p.variance.add(sample);
+      if (denoising)
+      {
+         p.albedo += first_hit.albedo;
+         p.normal += first_hit.normal;
+         p.depth = std::max(p.depth, first_hit.depth);
+      }
+   };
+
+   auto finish_pixel = [&](pixel_state& p)
+   {
+      int j = p.j, i = p.i;
+      if (denoising)
+      {
+         size_t index = (size_t) j * width + i;
+         int n = p.s - p.first;
+         features.color[index] = p.c / float(p.s);
+         features.variance[index] = p.variance.mean_variance();
+         features.albedo[index] = p.albedo / float(n);
+         features.normal[index] = p.normal / float(n);
+         features.depth[index] = p.depth;
+      }
+      hdr.set(j, i, p.c, p.s);
+      image.set_vec3(j, i, normalize_color(p.c, p.s));
+      global_sample_map().at(j, i) = p.s - p.first;
+#ifdef RT_INSTRUMENT
+      global_render_stats().at(j, i) = p.stats;
+#endif
+   };
+
+   // one pixel after the other, one ray after the other: first the first samples of every pixel,
+   // then the rest of each pixel once the tile has set their prior
+   auto render_tile_rays = [&](int k)
+   {
+      std::vector<pixel_state> pixels = start_tile(k);
+      for (int pass = 0; pass < 2; pass++)
+      {
+         for (pixel_state& p : pixels)
+         {
+#ifdef RT_INSTRUMENT
+            thread_pixel_stats() = pixel_stats();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+            while (pass == 0 ? p.s < p.target : needs_sample(p)) // antialias
+            {
+               ray r = camera_ray(p);
+               if (denoising) thread_sample_features() = sample_features();
+               glm::color sample = radiance(r);
+               add_sample(p, sample, thread_sample_features());
+            }
+#ifdef RT_INSTRUMENT
+            const pixel_stats& counted = thread_pixel_stats();
+            p.stats.rays += counted.rays;
+            p.stats.tests += counted.tests;
+            p.stats.bounces += counted.bounces;
+            p.stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start).count();
+#endif
+         }
+         if (pass == 0) set_prior(pixels);
+      }
+      for (pixel_state& p : pixels) finish_pixel(p);
+   };
+
+   // in rounds: each round hands the next sample of every pixel of the tile that needs one to
+   // stream() at once. The samples and their sums are those of render_tile_rays().
+   auto render_tile_stream = [&](int k)
+   {
+      std::vector<pixel_state> pixels = start_tile(k);
+      std::vector<stream_sample> batch;
+      std::vector<pixel_state*> owners;
+      bool first_samples = true;
+      while (true)
+      {
+#ifdef RT_INSTRUMENT
+         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+         batch.clear();
+         owners.clear();
+         for (pixel_state& p : pixels)
+         {
+            if (first_samples ? p.s >= p.target : !needs_sample(p)) continue;
+            stream_sample sample;
+            sample.r = camera_ray(p);
+            sample.state = thread_rng();
+            batch.push_back(sample);
+            owners.push_back(&p);
+         }
+         if (batch.empty() && first_samples)
+         {
+            set_prior(pixels);
+            first_samples = false;
+            continue;
+         }
+         if (batch.empty()) break;
+
+         stream(batch);
+#ifdef RT_INSTRUMENT
+         // the time of a round is split evenly among its samples
+         uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count() / batch.size();
+#endif
+         for (size_t q = 0; q < batch.size(); q++)
+         {
+            pixel_state& p = *owners[q];
+            add_sample(p, batch[q].color, batch[q].features);
+#ifdef RT_INSTRUMENT
+            p.stats.rays += batch[q].stats.rays;
+            p.stats.tests += batch[q].stats.tests;
+            p.stats.bounces += batch[q].stats.bounces;
+            p.stats.nanoseconds += nanoseconds;
+#endif
+         }
+      }
+      for (pixel_state& p : pixels) finish_pixel(p);
+   };
+
+   bool streaming = settings.streaming && stream;
+   auto render_tile = [&](int k)
+   {
+      if (streaming) render_tile_stream(k);
+      else render_tile_rays(k);
+      // the thread may draw numbers after render() has freed the sampler
+      thread_rng().release_source();
+   };
+
+   if (settings.num_workers > 0)
+   {
+      // workers send their tiles back as pixel records, then their counters, if any, row by row
+      process_pool workers(settings.num_workers, [&](int k, std::string& result)
+      {
+         render_tile(k);
+         std::vector<pixel_record> pixels;
+         append_tile_pixels(tiles[k], hdr, global_sample_map().counts, features, denoising, pixels);
+         std::ostringstream out;
+         binary_writer writer(out);
+         writer.put_array(pixels);
+#ifdef RT_INSTRUMENT
+         std::vector<pixel_stats> stats;
+         const tile& t = tiles[k];
+         for (int j = t.y0; j < t.y1; j++)
+         {
+            for (int i = t.x0; i < t.x1; i++) stats.push_back(global_render_stats().at(j, i));
+         }
+         writer.put_array(stats);
+#endif
+         result = out.str();
+      });
+      pending = workers.run(pending, [&](int k, const std::string& result)
+      {
+         std::vector<pixel_record> pixels;
+         binary_reader reader(result.data(), result.data() + result.size());
+         if (!reader.get_array(pixels) || pixels.size() != tile_pixels(tiles[k])) return false;
+#ifdef RT_INSTRUMENT
+         std::vector<pixel_stats> stats;
+         if (!reader.get_array(stats) || stats.size() != pixels.size()) return false;
+         const tile& t = tiles[k];
+         const pixel_stats* next = stats.data();
+         for (int j = t.y0; j < t.y1; j++)
+         {
+            for (int i = t.x0; i < t.x1; i++) global_render_stats().at(j, i) = *next++;
+         }
+#endif
+         restore_tile_pixels(tiles[k], pixels.data(), hdr, global_sample_map().counts, features, denoising);
+         show_tile(k);
+         if (checkpoint) checkpoint->tile_done(k);
+         return true;
+      });
+      if (!pending.empty())
+      {
+         std::cerr << "no workers left; rendering " << pending.size() << " tiles here" << std::endl;
+      }
+   }
+
+   // the threads start after the workers are forked
+   thread_pool pool(settings.num_threads);
+   pool.parallel_for((int) pending.size(), [&](int n)
+   {
+      render_tile(pending[n]);
+      if (checkpoint) checkpoint->tile_done(pending[n]);
+   });
+   if (checkpoint) checkpoint->save();
+
+   if (denoising)
+   {
+      std::vector<glm::color> denoised;
+      denoise(features, settings.denoise_passes, denoised, pool);
+      for (int j = 0; j < height; j++)
+      {
+         for (int i = 0; i < width; i++)
+         {
+            image.set_vec3(j, i, normalize_color(denoised[(size_t) j * width + i], 1));
+         }
+      }
+   }
+}
+
+// with adaptive sampling, write the samples taken by each pixel of the last render as a gray
+// image, basename_spp.png (white is settings.max_samples), and print their average
+bool save_sample_map(const std::string& basename)
+{
+   const render_settings& settings = global_render_settings();
+   sample_map& samples = global_sample_map();
+   if (settings.max_samples <= 0) return true;
+
+   std::cout << "average samples per pixel: " << samples.average() << std::endl;
+   agl::ppm_image image(samples.width, samples.height);
+   for (int j = 0; j < samples.height; j++)
+   {
+      for (int i = 0; i < samples.width; i++)
+      {
+         image.set_vec3(j, i, glm::color(samples.at(j, i) / float(settings.max_samples)));
+      }
+   }
+   return image.save(basename + "_spp.png");
+}
+
+// with denoising, write the features that guided the denoiser as images: basename_albedo.png,
+// basename_normal.png (the normal n as 0.5 n + 0.5) and basename_depth.png (black is near, white
+// is the farthest surface, and the background is white too)
+bool save_feature_buffers(const std::string& basename)
+{
+   const feature_buffers& features = global_feature_buffers();
+   if (global_render_settings().denoise_passes <= 0) return true;
+
+   float far = 0;
+   for (float z : features.depth)
+   {
+      if (z != infinity) far = std::max(far, z);
+   }
+   if (far <= 0) far = 1;
+
+   agl::ppm_image albedo(features.width, features.height);
+   agl::ppm_image normal(features.width, features.height);
+   agl::ppm_image depth(features.width, features.height);
+   for (int j = 0; j < features.height; j++)
+   {
+      for (int i = 0; i < features.width; i++)
+      {
+         size_t p = (size_t) j * features.width + i;
+         albedo.set_vec3(j, i, glm::min(features.albedo[p], glm::color(1)));
+         normal.set_vec3(j, i, 0.5f * features.normal[p] + glm::vec3(0.5f));
+         depth.set_vec3(j, i, glm::color(std::min(1.0f, features.depth[p] / far)));
+      }
+   }
+   return albedo.save(basename + "_albedo.png") && normal.save(basename + "_normal.png") &&
+      depth.save(basename + "_depth.png");
+}
+
+#ifdef RT_INSTRUMENT
+
+// a ramp from black through blue, magenta, orange and yellow to white, for t in [0, 1]
+glm::color heat_color(float t)
+{
+   static const glm::color stops[] = {
+      glm::color(0, 0, 0), glm::color(0.1f, 0.05f, 0.5f), glm::color(0.6f, 0.1f, 0.55f),
+      glm::color(0.95f, 0.45f, 0.1f), glm::color(1, 0.85f, 0.2f), glm::color(1, 1, 1)
+   };
+   const int last = sizeof(stops) / sizeof(stops[0]) - 1;
+   t = std::min(1.0f, std::max(0.0f, t)) * last;
+   int k = std::min(last - 1, (int) t);
+   return glm::mix(stops[k], stops[k + 1], t - k);
+}
+
+// save a heatmap of value(pixel). Colors are scaled to the 99th percentile, so that a few very
+// costly pixels do not wash out the others.
+template <class ValueFn>
+bool save_heatmap(const std::string& filename, const render_stats& stats, const ValueFn& value)
+{
+   std::vector<double> sorted;
+   sorted.reserve(stats.pixels.size());
+   for (const pixel_stats& p : stats.pixels) sorted.push_back(value(p));
+   if (sorted.empty()) return false;
+   std::sort(sorted.begin(), sorted.end());
+   double scale = sorted[(sorted.size() - 1) * 99 / 100];
+   if (scale <= 0) scale = 1;
+
+   agl::ppm_image image(stats.width, stats.height);
+   for (int j = 0; j < stats.height; j++)
+   {
+      for (int i = 0; i < stats.width; i++)
+      {
+         image.set_vec3(j, i, heat_color(float(value(stats.at(j, i)) / scale)));
+      }
+   }
+   return image.save(filename);
+}
+
+// write the counters of the last render next to its image: basename_stats.csv, one line per
+// pixel, and a heatmap of each counter, basename_rays.png, basename_tests.png,
+// basename_bounces.png and basename_time.png
+bool save_render_stats(const std::string& basename)
+{
+   const render_stats& stats = global_render_stats();
+   std::string csv = basename + "_stats.csv";
+   FILE* file = fopen(csv.c_str(), "w");
+   if (!file)
+   {
+      std::cerr << csv << ": cannot write file" << std::endl;
+      return false;
+   }
+   fprintf(file, "x,y,rays,tests,bounces,nanoseconds\n");
+   for (int j = 0; j < stats.height; j++)
+   {
+      for (int i = 0; i < stats.width; i++)
+      {
+         const pixel_stats& p = stats.at(j, i);
+         fprintf(file, "%d,%d,%u,%u,%u,%llu\n", i, j, p.rays, p.tests, p.bounces, (unsigned long long) p.nanoseconds);
+      }
+   }
+   fclose(file);
+
+   return save_heatmap(basename + "_rays.png", stats, [](const pixel_stats& p) { return (double) p.rays; }) &&
+      save_heatmap(basename + "_tests.png", stats, [](const pixel_stats& p) { return (double) p.tests; }) &&
+      save_heatmap(basename + "_bounces.png", stats, [](const pixel_stats& p) { return (double) p.bounces; }) &&
+      save_heatmap(basename + "_time.png", stats, [](const pixel_stats& p) { return (double) p.nanoseconds; });
+}
+
+#else
+
+// instrumentation is compiled out; there is nothing to write
+inline bool save_render_stats(const std::string& basename) { return true; }
+
+#endif
+
+// save the last render: the image as basename.png, its samples as basename.pfm,
+// basename_samples.pfm and basename_sums.pfm (see hdr_image.h), and the images of the options that are on (see
+// save_sample_map(), save_feature_buffers() and save_render_stats())
+bool save_render(const agl::ppm_image& image, const std::string& basename)
+{
+   bool ok = image.save(basename + ".png");
+   ok = global_hdr_image().save(basename + ".pfm") && ok;
+   ok = save_sample_map(basename) && ok;
+   ok = save_feature_buffers(basename) && ok;
+   return save_render_stats(basename) && ok;
+}
+
+#endif
@@ -0,0 +1,126 @@
+// render_settings.h, options shared by the ray tracers that can be changed from the command line
+
+#ifndef RENDER_SETTINGS_H_
+#define RENDER_SETTINGS_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+struct render_settings {
+   render_settings() : num_threads(0), tile_size(16), seed(0), max_samples(0), noise_threshold(0.01f), denoise_passes(0),
+      checkpoint_interval(60), resume(false), num_workers(0), sampler("sobol"),
+      streaming(false), max_depth(0) {}
+
+   int num_threads; // worker threads; 0 uses every hardware thread
+   int tile_size;   // width and height of a render tile, in pixels
+   unsigned seed;   // selects the random streams; a given seed always renders the same image
+   std::string scene_file; // scene to render instead of the built-in one (see scene_file.h)
+   int max_samples;        // if > 0, sample each pixel adaptively, up to this many samples (see render())
+   float noise_threshold;  // adaptive sampling stops once the pixel noise is below this, in [0, 1] color units
+   int denoise_passes;     // if > 0, filter the image with this many a-trous passes (see denoise.h)
+   std::string add_to;     // an earlier render (NAME.pfm) to add the samples to (see hdr_image.h)
+   std::string checkpoint_file; // if set, save the render in progress to this file (see checkpoint.h)
+   double checkpoint_interval;  // seconds between checkpoints
+   bool resume;                 // continue the render saved in checkpoint_file
+   int num_workers;             // if > 0, render the tiles in this many worker processes (see process_pool.h)
+   std::string sampler;         // independent, stratified, sobol or blue-noise (see sampler.h)
+   bool streaming;              // trace the camera rays of a tile together (see ray_stream.h)
+
+   // set by the program rather than the command line, so that a checkpoint only resumes the same
+   // scene (see checkpoint.h)
+   std::string scene_name; // the built-in scene of the program
+   int max_depth;          // the number of bounces of a path
+};
+
+// the settings used by ray_trace()
+inline render_settings& global_render_settings()
+{
+   static render_settings settings;
+   return settings;
+}
+
+// read the options below from the command line; other arguments are ignored
+//    --threads N   number of render threads
+//    --tile N      tile size in pixels
+//    --seed N      random seed
+//    --scene FILE  text or compiled scene file
+//    --adaptive N  adaptive sampling with at most N samples per pixel
+//    --noise T     noise threshold of adaptive sampling
+//    --denoise N   denoise with N filter passes (3 is a good start)
+//    --add FILE    add the samples to an earlier render saved as FILE (NAME.pfm)
+//    --checkpoint FILE    save the render in progress to FILE
+//    --checkpoint-every S save it every S seconds (60 by default)
+//    --resume FILE        continue the render saved in FILE, and go on saving it there
+//    --workers N          render in N worker processes
+//    --sampler NAME       independent, stratified, sobol (the default) or blue-noise
+//    --stream on|off      trace the camera rays of each tile together (off by default)
+inline void parse_render_settings(int argc, char** argv)
+{
+   render_settings& settings = global_render_settings();
+   for (int i = 1; i + 1 < argc; i++)
+   {
+      if (strcmp(argv[i], "--threads") == 0)
+      {
+         settings.num_threads = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--tile") == 0)
+      {
+         int size = atoi(argv[++i]);
+         if (size > 0) settings.tile_size = size;
+      }
+      else if (strcmp(argv[i], "--seed") == 0)
+      {
+         settings.seed = (unsigned) strtoul(argv[++i], 0, 10);
+      }
+      else if (strcmp(argv[i], "--scene") == 0)
+      {
+         settings.scene_file = argv[++i];
+      }
+      else if (strcmp(argv[i], "--adaptive") == 0)
+      {
+         settings.max_samples = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--noise") == 0)
+      {
+         float threshold = (float) atof(argv[++i]);
+         if (threshold > 0) settings.noise_threshold = threshold;
+      }
+      else if (strcmp(argv[i], "--denoise") == 0)
+      {
+         settings.denoise_passes = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--add") == 0)
+      {
+         settings.add_to = argv[++i];
+      }
+      else if (strcmp(argv[i], "--checkpoint") == 0)
+      {
+         settings.checkpoint_file = argv[++i];
+      }
+      else if (strcmp(argv[i], "--checkpoint-every") == 0)
+      {
+         double seconds = atof(argv[++i]);
+         if (seconds >= 0) settings.checkpoint_interval = seconds;
+      }
+      else if (strcmp(argv[i], "--resume") == 0)
+      {
+         settings.checkpoint_file = argv[++i];
+         settings.resume = true;
+      }
+      else if (strcmp(argv[i], "--workers") == 0)
+      {
+         settings.num_workers = atoi(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--sampler") == 0)
+      {
+         settings.sampler = argv[++i];
+      }
+      else if (strcmp(argv[i], "--stream") == 0)
+      {
+         settings.streaming = strcmp(argv[++i], "on") == 0;
+      }
+   }
+}
+
+#endif
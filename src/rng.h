@@ -0,0 +1,149 @@
+// rng.h, counter-based random numbers with deterministic streams
+// Each stream is keyed by (pixel, sample, bounce) and the n-th number of a stream is a hash
+// of (key, n), in the manner of splitmix64 (Steele, Lea, Flood, "Fast splittable pseudorandom
+// number generators", 2014). A pixel therefore gets the same numbers no matter which thread
+// renders it or in which order the tiles run.
+//
+// The numbers of a path come in streams: one for the camera (the pixel position and the lens) and
+// one per bounce. The first few numbers of each stream are the dimensions of the sample; a sampler
+// (see sampler.h) may hand out those instead, spread evenly over the samples of the pixel.
+
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <atomic>
+#include <cstdint>
+
+// the values of the samples of a pixel, dimension by dimension
+class sampler {
+public:
+   // the value in [0, 1) of sample number sample of pixel pixel (j * width + i) in dimension
+   // dimension. Safe to call from several threads at once.
+   virtual float get(uint32_t pixel, uint32_t sample, uint32_t dimension) const = 0;
+
+   // what get_quad() takes in place of the pixel, e.g. the seed of the pixel, so that a stream
+   // works it out once instead of once per number
+   virtual uint32_t pixel_key(uint32_t pixel) const { return pixel; }
+
+   // the values of get() in the four dimensions from dimension (a multiple of 4) on, for the pixel
+   // of key, so that the work the dimensions of a quad share is done once
+   virtual void get_quad(uint32_t key, uint32_t sample, uint32_t dimension, float* out) const {
+      for (uint32_t k = 0; k < 4; k++) out[k] = get(key, sample, dimension + k);
+   }
+
+   virtual ~sampler() {}
+};
+
+// the dimensions of the camera stream (pixel position, lens) and of each bounce stream (e.g.
+// scattering, a light sample and Russian roulette); numbers drawn beyond them are random. Both are
+// multiples of 4, so every stream starts a quad of sampler::get_quad().
+const uint32_t camera_dimensions = 4;
+const uint32_t bounce_dimensions = 8;
+
+class rng {
+public:
+   rng() : pixel(0), sample(0), base(0), key(0), counter(0), source(0), dimension(0), dimensions(0),
+      source_key(0), quad(no_quad) {}
+   explicit rng(uint64_t stream) :
+      pixel(0), sample(0), base(0), key(mix(stream)), counter(0), source(0), dimension(0), dimensions(0),
+      source_key(0), quad(no_quad) {}
+
+   // start the camera stream of the given pixel and sample. seed selects an independent render;
+   // the first numbers of each stream come from s, if given.
+   void seed(uint32_t pixel_index, uint32_t sample_index, uint32_t seed = 0, const sampler* s = 0) {
+      pixel = pixel_index;
+      sample = sample_index;
+      source = s;
+      base = mix(((uint64_t) pixel << 32 | sample) ^ mix(seed + 0x632BE59BD9B4E019ULL));
+      key = mix(base ^ 0xD1B54A32D192ED03ULL);
+      counter = 0;
+      dimension = 0;
+      dimensions = camera_dimensions;
+      if (source) source_key = source->pixel_key(pixel);
+      quad = no_quad;
+   }
+
+   // stop taking numbers from the sampler, e.g. before it is freed; the stream goes on as it is
+   void release_source() {
+      source = 0;
+      quad = no_quad;
+   }
+
+   // switch to the stream of a bounce along the current path
+   void start_bounce(uint32_t bounce) {
+      key = mix(base ^ (bounce * 0x9E3779B97F4A7C15ULL));
+      counter = 0;
+      dimension = camera_dimensions + bounce * bounce_dimensions;
+      dimensions = bounce_dimensions;
+   }
+
+   uint32_t pixel_index() const { return pixel; }
+   uint32_t sample_index() const { return sample; }
+
+   uint32_t next_uint() {
+      return (uint32_t) (mix(key + (++counter) * 0x9E3779B97F4A7C15ULL) >> 32);
+   }
+
+   // uniform in [0, 1)
+   float next_float() {
+      if (source && counter < dimensions)
+      {
+         uint32_t d = dimension + (uint32_t) counter++;
+         if (d / 4 != quad)
+         {
+            quad = d / 4;
+            source->get_quad(source_key, sample, d & ~3u, values);
+         }
+         return values[d % 4];
+      }
+      return (next_uint() >> 8) * (1.0f / 16777216.0f);
+   }
+
+   // fill out[0] ... out[n-1] with uniforms in [0, 1)
+   void fill(float* out, int n) {
+      if (source)
+      {
+         for (int i = 0; i < n; i++) out[i] = next_float();
+         return;
+      }
+      uint64_t k = key;
+      uint64_t c = counter;
+      for (int i = 0; i < n; i++)
+      {
+         out[i] = (uint32_t) (mix(k + (c + i + 1) * 0x9E3779B97F4A7C15ULL) >> 40) * (1.0f / 16777216.0f);
+      }
+      counter = c + n;
+   }
+
+   static uint64_t mix(uint64_t z) {
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      return z ^ (z >> 31);
+   }
+
+private:
+   uint32_t pixel;
+   uint32_t sample;
+   uint64_t base;    // key of the (pixel, sample) path
+   uint64_t key;     // key of the current bounce
+   uint64_t counter; // numbers drawn from the current bounce
+   const sampler* source; // hands out the first numbers of each stream, if set
+   uint32_t dimension;    // the dimension of the first number of the current stream
+   uint32_t dimensions;   // the numbers of the current stream that source hands out
+   uint32_t source_key;   // source->pixel_key(pixel)
+   uint32_t quad;         // the quad of dimensions in values, of this sample
+   float values[4];
+
+   static const uint32_t no_quad = 0xFFFFFFFFu;
+};
+
+// the generator of the calling thread. The render driver seeds it per pixel and sample; threads
+// that never seed it (tools, tests) still get distinct streams.
+inline rng& thread_rng()
+{
+   static std::atomic<uint64_t> next_stream(0);
+   thread_local rng generator(next_stream++);
+   return generator;
+}
+
+#endif
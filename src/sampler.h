@@ -0,0 +1,388 @@
+// sampler.h, well distributed sample values in place of independent random numbers
+// Each number a path draws has a dimension: its position along the path (see rng.h). A sampler
+// gives the value of sample s of a pixel in dimension d so that, across the samples of the pixel,
+// each dimension (and each pair and quad of them) is covered evenly instead of by chance. The
+// sampling helpers of AGLM.h map values to directions and disks in closed form, so that even
+// coverage of the values carries over to the directions.
+//
+//    stratified  each dimension is split into one stratum per sample, visited in a random order
+//                per pixel and dimension (a Latin hypercube, with jitter inside the strata)
+//    sobol       the Sobol sequence in four dimensions, Owen scrambled per pixel; every further
+//                quad of dimensions is a copy with its own scramble and sample order (Burley,
+//                "Practical Hash-based Owen Scrambling", JCGT 2020)
+//    blue-noise  one Sobol sequence for every pixel, shifted per pixel by a blue noise mask, so
+//                that neighboring pixels err in opposite directions and the noise left is fine
+//                grained (Georgiev and Fajardo, "Blue-noise Dithered Sampling", 2016)
+
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include "rng.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// a hash of two values, for scrambling seeds
+inline uint32_t hash_combine(uint32_t a, uint32_t b)
+{
+   return (uint32_t) (rng::mix(((uint64_t) a << 32 | b) + 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+// 32 bits to a float in [0, 1)
+inline float bits_to_float(uint32_t x)
+{
+   return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+inline uint32_t reverse_bits(uint32_t x)
+{
+   x = (x << 16) | (x >> 16);
+   x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+   x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+   x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+   x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+   return x;
+}
+
+// a random permutation of the bits of x in which each bit flips depending only on the bits
+// above it (an Owen scramble), chosen by seed
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed)
+{
+   // Laine and Karras' hash permutes from the low bits up; reversing makes it nest from the top
+   x = reverse_bits(x);
+   x += seed;
+   x ^= x * 0x6c50b47cu;
+   x ^= x * 0xb82f1e52u;
+   x ^= x * 0xc7afe638u;
+   x ^= x * 0x8d22f6e6u;
+   return reverse_bits(x);
+}
+
+// the direction numbers of the Sobol sequence in dimensions 0 to 3, bit by bit of the index
+static const uint32_t sobol_directions[4][32] = {
+   { 0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000, 0x04000000, 0x02000000, 0x01000000,
+     0x00800000, 0x00400000, 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000, 0x00010000,
+     0x00008000, 0x00004000, 0x00002000, 0x00001000, 0x00000800, 0x00000400, 0x00000200, 0x00000100,
+     0x00000080, 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004, 0x00000002, 0x00000001 },
+   { 0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000,
+     0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000,
+     0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00,
+     0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff },
+   { 0x80000000, 0xc0000000, 0x60000000, 0x90000000, 0xe8000000, 0x5c000000, 0x8e000000, 0xc5000000,
+     0x68800000, 0x9cc00000, 0xee600000, 0x55900000, 0x80680000, 0xc09c0000, 0x60ee0000, 0x90550000,
+     0xe8808000, 0x5cc0c000, 0x8e606000, 0xc5909000, 0x6868e800, 0x9c9c5c00, 0xeeee8e00, 0x5555c500,
+     0x8000e880, 0xc0005cc0, 0x60008e60, 0x9000c590, 0xe8006868, 0x5c009c9c, 0x8e00eeee, 0xc5005555 },
+   { 0x80000000, 0xc0000000, 0x20000000, 0x50000000, 0xf8000000, 0x74000000, 0xa2000000, 0x93000000,
+     0xd8800000, 0x25400000, 0x59e00000, 0xe6d00000, 0x78080000, 0xb40c0000, 0x82020000, 0xc3050000,
+     0x208f8000, 0x51474000, 0xfbea2000, 0x75d93000, 0xa0858800, 0x914e5400, 0xdbe79e00, 0x25db6d00,
+     0x58800080, 0xe54000c0, 0x79e00020, 0xb6d00050, 0x800800f8, 0xc00c0074, 0x200200a2, 0x50050093 }
+};
+
+// the direction numbers XORed together for every value of every byte of an index, so that a point
+// takes four lookups instead of a step per bit: [dimension][byte of the index][its value]
+struct sobol_table {
+   uint32_t bytes[4][4][256];
+};
+
+// made once, on first use
+const sobol_table& sobol_bytes();
+
+// the bits of the Sobol point number index in dimension dimension (0 to 3)
+inline uint32_t sobol(uint32_t index, int dimension)
+{
+   const uint32_t (&bytes)[4][256] = sobol_bytes().bytes[dimension];
+   return bytes[0][index & 0xff] ^ bytes[1][(index >> 8) & 0xff] ^ bytes[2][(index >> 16) & 0xff] ^
+      bytes[3][index >> 24];
+}
+
+const sobol_table& sobol_bytes()
+{
+   static const sobol_table table = []()
+   {
+      sobol_table t;
+      for (int d = 0; d < 4; d++)
+      {
+         for (int byte = 0; byte < 4; byte++)
+         {
+            for (uint32_t value = 0; value < 256; value++)
+            {
+               uint32_t x = 0;
+               for (int bit = 0; bit < 8; bit++)
+               {
+                  if (value >> bit & 1) x ^= sobol_directions[d][8 * byte + bit];
+               }
+               t.bytes[d][byte][value] = x;
+            }
+         }
+      }
+      return t;
+   }();
+   return table;
+}
+
+// scrambled Sobol points in quads of dimensions, the scrambles seeded by seed
+inline float padded_sobol(uint32_t sample, uint32_t dimension, uint32_t seed)
+{
+   // every quad of dimensions visits the points in its own order; the order of the first 2^k
+   // samples is a permutation of the first 2^k points, so the prefixes stay stratified
+   uint32_t quad = dimension / 4;
+   uint32_t index = owen_scramble(sample, hash_combine(seed, quad));
+   uint32_t x = sobol(index, dimension % 4);
+   return bits_to_float(owen_scramble(x, hash_combine(seed, 0x51ED270Bu + dimension)));
+}
+
+// padded_sobol() in the four dimensions from dimension (a multiple of 4) on, which share the
+// point of their quad
+inline void padded_sobol_quad(uint32_t sample, uint32_t dimension, uint32_t seed, float* out)
+{
+   uint32_t index = owen_scramble(sample, hash_combine(seed, dimension / 4));
+   for (uint32_t k = 0; k < 4; k++)
+   {
+      out[k] = bits_to_float(owen_scramble(sobol(index, k), hash_combine(seed, 0x51ED270Bu + dimension + k)));
+   }
+}
+
+class sobol_sampler : public sampler {
+public:
+   sobol_sampler(uint32_t seed) : seed(seed) {}
+
+   virtual float get(uint32_t pixel, uint32_t sample, uint32_t dimension) const override {
+      return padded_sobol(sample, dimension, pixel_key(pixel));
+   }
+
+   // the seed of the scrambles of the pixel
+   virtual uint32_t pixel_key(uint32_t pixel) const override { return hash_combine(seed, pixel); }
+
+   virtual void get_quad(uint32_t key, uint32_t sample, uint32_t dimension, float* out) const override {
+      padded_sobol_quad(sample, dimension, key, out);
+   }
+
+private:
+   uint32_t seed;
+};
+
+class stratified_sampler : public sampler {
+public:
+   // samples_per_pixel strata per dimension; further samples start new rounds of strata
+   stratified_sampler(uint32_t seed, int samples_per_pixel) :
+      seed(seed), strata(samples_per_pixel > 0 ? samples_per_pixel : 1) {}
+
+   virtual float get(uint32_t pixel, uint32_t sample, uint32_t dimension) const override {
+      return value(pixel_key(pixel), sample, dimension);
+   }
+
+   // the seed of the permutations of the pixel
+   virtual uint32_t pixel_key(uint32_t pixel) const override { return hash_combine(seed, pixel); }
+
+   virtual void get_quad(uint32_t key, uint32_t sample, uint32_t dimension, float* out) const override {
+      for (uint32_t k = 0; k < 4; k++) out[k] = value(key, sample, dimension + k);
+   }
+
+   // the place of i in a random permutation of [0, n) chosen by key
+   // (Kensler, "Correlated Multi-Jittered Sampling", 2013)
+   static uint32_t permute(uint32_t i, uint32_t n, uint32_t key);
+
+private:
+   // get() for the pixel with the given seed
+   float value(uint32_t pixel_seed, uint32_t sample, uint32_t dimension) const {
+      uint32_t round = sample / strata;
+      uint32_t key = hash_combine(pixel_seed, hash_combine(dimension, round));
+      uint32_t stratum = permute(sample % strata, strata, key);
+      float jitter = bits_to_float(hash_combine(key, sample));
+      return std::min((stratum + jitter) / strata, 0.99999994f);
+   }
+
+   uint32_t seed;
+   uint32_t strata;
+};
+
+uint32_t stratified_sampler::permute(uint32_t i, uint32_t n, uint32_t key)
+{
+   // hash within the next power of two and walk the cycle until the result lands below n
+   uint32_t w = n - 1;
+   w |= w >> 1;
+   w |= w >> 2;
+   w |= w >> 4;
+   w |= w >> 8;
+   w |= w >> 16;
+   do
+   {
+      i ^= key;
+      i *= 0xe170893d;
+      i ^= key >> 16;
+      i ^= (i & w) >> 4;
+      i ^= key >> 8;
+      i *= 0x0929eb3f;
+      i ^= key >> 23;
+      i ^= (i & w) >> 1;
+      i *= 1 | key >> 27;
+      i *= 0x6935fa69;
+      i ^= (i & w) >> 11;
+      i *= 0x74dcb303;
+      i ^= (i & w) >> 2;
+      i *= 0x9e501cc3;
+      i ^= (i & w) >> 2;
+      i *= 0xc860a3df;
+      i &= w;
+      i ^= i >> 5;
+   } while (i >= n);
+   return (i + key) % n;
+}
+
+// the side of the blue noise mask
+const int blue_noise_size = 64;
+
+// a blue_noise_size^2 mask of the values (k + 0.5) / size^2, each once, placed so that close
+// pixels have distant values (Ulichney's void and cluster method). Made once, on first use.
+const std::vector<float>& blue_noise_mask();
+
+class blue_noise_sampler : public sampler {
+public:
+   // width is the width of the image, to find the pixel in the mask
+   blue_noise_sampler(uint32_t seed, int width) : seed(seed), width(width > 0 ? width : 1), mask(blue_noise_mask()) {}
+
+   virtual float get(uint32_t pixel, uint32_t sample, uint32_t dimension) const override {
+      return shift(pixel, dimension, padded_sobol(sample, dimension, seed));
+   }
+
+   virtual void get_quad(uint32_t pixel, uint32_t sample, uint32_t dimension, float* out) const override {
+      padded_sobol_quad(sample, dimension, seed, out);
+      for (uint32_t k = 0; k < 4; k++) out[k] = shift(pixel, dimension + k, out[k]);
+   }
+
+private:
+   // value shifted by the mask at pixel, modulo 1
+   float shift(uint32_t pixel, uint32_t dimension, float value) const {
+      // every dimension reads the mask at its own offset, so that dimensions do not correlate
+      uint32_t offset = hash_combine(seed, dimension);
+      uint32_t x = (pixel % width + offset) % blue_noise_size;
+      uint32_t y = (pixel / width + (offset >> 16)) % blue_noise_size;
+      value += mask[y * blue_noise_size + x];
+      return value >= 1.0f ? std::min(value - 1.0f, 0.99999994f) : value;
+   }
+
+   uint32_t seed;
+   uint32_t width;
+   const std::vector<float>& mask;
+};
+
+const std::vector<float>& blue_noise_mask()
+{
+   static const std::vector<float> mask = []()
+   {
+      const int size = blue_noise_size;
+      const int n = size * size;
+      // the energy a point adds to the pixels around it: a gaussian on the torus
+      std::vector<float> kernel(n);
+      for (int y = 0; y < size; y++)
+      {
+         for (int x = 0; x < size; x++)
+         {
+            int dx = std::min(x, size - x), dy = std::min(y, size - y);
+            kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * 1.5f * 1.5f));
+         }
+      }
+      std::vector<char> on(n, 0);
+      std::vector<float> energy(n, 0.0f);
+      auto toggle = [&](int p, bool set)
+      {
+         on[p] = set;
+         int px = p % size, py = p / size;
+         float sign = set ? 1.0f : -1.0f;
+         for (int y = 0; y < size; y++)
+         {
+            const float* row = &kernel[((y - py + size) % size) * size];
+            float* out = &energy[y * size];
+            for (int x = 0; x < size; x++) out[x] += sign * row[(x - px + size) % size];
+         }
+      };
+      // the set point with the most energy (the tightest cluster), or the unset one with the least
+      // (the largest void)
+      auto extreme = [&](bool cluster)
+      {
+         int best = -1;
+         for (int q = 0; q < n; q++)
+         {
+            if ((on[q] != 0) != cluster) continue;
+            if (best < 0 || (cluster ? energy[q] > energy[best] : energy[q] < energy[best])) best = q;
+         }
+         return best;
+      };
+
+      // a tenth of the pixels at random, then moved from clusters to voids until even
+      rng random(0xB1);
+      int initial = n / 10;
+      for (int placed = 0; placed < initial;)
+      {
+         int p = random.next_uint() % n;
+         if (!on[p])
+         {
+            toggle(p, true);
+            placed++;
+         }
+      }
+      while (true)
+      {
+         int cluster = extreme(true);
+         toggle(cluster, false);
+         int gap = extreme(false);
+         toggle(gap, true);
+         if (gap == cluster) break;
+      }
+
+      // rank the initial points by taking clusters away, then rank the rest by filling voids
+      std::vector<int> rank(n, 0);
+      std::vector<char> initial_on = on;
+      std::vector<float> initial_energy = energy;
+      for (int r = initial - 1; r >= 0; r--)
+      {
+         int cluster = extreme(true);
+         toggle(cluster, false);
+         rank[cluster] = r;
+      }
+      on = initial_on;
+      energy = initial_energy;
+      for (int r = initial; r < n; r++)
+      {
+         int gap = extreme(false);
+         toggle(gap, true);
+         rank[gap] = r;
+      }
+
+      std::vector<float> values(n);
+      for (int p = 0; p < n; p++) values[p] = (rank[p] + 0.5f) / n;
+      return values;
+   }();
+   return mask;
+}
+
+// the names of the samplers, in the order of their ids
+const char* const sampler_names[] = { "independent", "stratified", "sobol", "blue-noise" };
+
+// the id of the sampler called name, or -1 if there is none
+inline int sampler_id(const std::string& name)
+{
+   for (int id = 0; id < 4; id++)
+   {
+      if (name == sampler_names[id]) return id;
+   }
+   return -1;
+}
+
+// the sampler with the given id for an image of the given width with samples_per_pixel samples;
+// null for independent, which leaves the numbers to the random streams of rng
+std::unique_ptr<sampler> make_sampler(int id, uint32_t seed, int width, int samples_per_pixel)
+{
+   switch (id)
+   {
+   case 1: return std::unique_ptr<sampler>(new stratified_sampler(seed, samples_per_pixel));
+   case 2: return std::unique_ptr<sampler>(new sobol_sampler(seed));
+   case 3: return std::unique_ptr<sampler>(new blue_noise_sampler(seed, width));
+   default: return std::unique_ptr<sampler>();
+   }
+}
+
+#endif
@@ -0,0 +1,1099 @@
+// scene_file.h, scenes described in text files, and their compiled (binary) form
+// A scene file has one statement per line; '#' starts a comment. Points, vectors and colors are
+// three numbers, angles are in degrees, and materials are referred to by name:
+//
+//    camera simple 0 0 6  2 4                # position, viewport height, focal length
+//    camera lookat 0 0 0  0 0 -120  0 1 0  90 [aperture [focus distance]]
+//    material gray lambertian 0.5 0.5 0.5    # albedo
+//    material red metal 1 0 0  0.3           # albedo, fuzz
+//    material glass dielectric 1.5           # index of refraction
+//    material blue phong 0 0 6               # view position, with the default colors and light
+//    material wall phong diffuse specular ambient light view kd ks ka shininess [noshadows]
+//    material lamp diffuse_light 10 10 10    # emitted radiance; spheres and disks of it are lights
+//    sphere 0 0 -1  0.5  gray                # center, radius
+//    plane 0 -4 0  0 1 -0.6  wall            # point, normal
+//    triangle 0 0 0  1 0 0  0 1 0  gray
+//    line 0 0 0  1 0 0  gray
+//    circle 0 0 -120  40  -81 0 18  gray     # center, radius, euler angles: a ten slice disk mesh
+//    disk 0 0 -120  0 1 0  20 40  gray       # center, normal, inner and outer radius (0 for no hole)
+//    mesh bunny.obj gray                     # .obj or .ply, relative to the scene file
+//    translate 1 0 0                         # also: rotate x y z, scale s (uniform)
+//    push                                    # save the transform; pop restores it
+//
+// Transforms apply to the primitives that follow them. Circles and meshes are instances (see
+// instance.h): every circle shares one disk mesh, and every mesh statement naming the same file
+// shares one copy of it, whatever their transforms and materials.
+//
+// Parsing a big scene, loading its meshes and building the bvhs can take seconds. The compiled
+// form stores the materials, the geometry with its precomputed mesh triangles, and the bvhs as
+// they are laid out in memory. Loading maps the file and copies each array out in one piece, with
+// nothing to parse or build. load_scene() keeps a compiled copy next to each text scene and uses
+// it while the scene file and its meshes are unchanged.
+
+#ifndef SCENE_FILE_H_
+#define SCENE_FILE_H_
+
+#include "AGLM.h"
+#include "ray.h"
+#include "camera.h"
+#include "material.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "plane.h"
+#include "triangle.h"
+#include "line.h"
+#include "disk.h"
+#include "binary_io.h"
+#include "triangle_mesh.h"
+#include "instance.h"
+#include "mesh_loader.h"
+#include "scenes.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// the camera of a scene file; the aspect ratio comes from the image
+struct scene_camera {
+   scene_camera() : defined(false), look_at(false), position(0), lookat(0,0,-1), vup(0,1,0),
+      vfov(90), aperture(0), focus_dist(1), viewport_height(2), focal_length(1) {}
+
+   camera make_camera(float aspect) const {
+      if (look_at) return camera(position, lookat, vup, vfov, aspect, aperture, focus_dist);
+      return camera(position, viewport_height, aspect, focal_length);
+   }
+
+   bool defined;          // false when the scene has no camera statement
+   bool look_at;          // camera lookat (positionable) or camera simple (looks down -z)
+   glm::point3 position;  // lookfrom
+   glm::point3 lookat;
+   glm::vec3 vup;
+   float vfov;            // vertical field of view in degrees
+   float aperture;
+   float focus_dist;
+   float viewport_height;
+   float focal_length;
+};
+
+// read a text scene into world (materials, objects and bvh) and cam. Mesh files are loaded with
+// num_threads threads. The scene file and the mesh files are appended to sources, if given.
+// On error, print the file, line and reason and return false, leaving world and cam unchanged.
+bool parse_scene(const std::string& filename, hittable_list& world, scene_camera& cam,
+   int num_threads = 1, std::vector<std::string>* sources = 0);
+
+// write a scene in compiled form. The world should have its bvh built. sources are the files the
+// scene was made from, recorded so that compiled_scene_current() can tell when they change.
+bool save_compiled_scene(const std::string& filename, const hittable_list& world, const scene_camera& cam,
+   const std::vector<std::string>& sources = std::vector<std::string>());
+
+// read a compiled scene. On error, print the reason and return false, leaving world and cam unchanged.
+bool load_compiled_scene(const std::string& filename, hittable_list& world, scene_camera& cam);
+
+// whether filename is a compiled scene whose sources are unchanged since it was written
+bool compiled_scene_current(const std::string& filename);
+
+// read a text or a compiled scene. A text scene is read from its compiled copy (filename + ".bin")
+// when that is current; otherwise it is parsed and the compiled copy is written again.
+bool load_scene(const std::string& filename, hittable_list& world, scene_camera& cam, int num_threads = 1);
+
+// the compiled form is a header, the sources, the camera, the materials, the objects that instances
+// share, the objects and the bvh of the world. Values are in the byte order and layout of the machine that wrote them; the header
+// rejects files from a machine that differs.
+const char compiled_scene_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\n' };
+const uint32_t compiled_scene_version = 3;
+
+struct compiled_scene_header {
+   char magic[8];
+   uint32_t version;
+   uint32_t byte_order;  // 0x01020304
+   uint32_t float_size;  // sizeof(float)
+   uint32_t vec3_size;   // sizeof(glm::vec3)
+   uint32_t node_size;   // sizeof(bvh_node)
+   uint32_t reserved;
+};
+
+enum compiled_tag {
+   tag_lambertian, tag_phong, tag_metal, tag_dielectric, tag_diffuse_light,
+   tag_sphere = 16, tag_plane, tag_triangle, tag_line, tag_mesh, tag_instance, tag_disk
+};
+
+// whether the nodes form a tree over num_prims primitives, so that a corrupt file cannot make the
+// traversal read out of bounds
+bool valid_bvh(const std::vector<bvh_node>& nodes, size_t num_prims)
+{
+   // children come after their parent, so depths are known when a node is reached
+   std::vector<int> depth(nodes.size(), 0);
+   for (size_t i = 0; i < nodes.size(); i++)
+   {
+      const bvh_node& node = nodes[i];
+      if (depth[i] >= bvh::stack_size) return false;
+      if (node.count > 0)
+      {
+         if (node.offset < 0 || (size_t) node.offset + node.count > num_prims) return false;
+      }
+      else if (node.count < 0 || node.offset <= (int) i || (size_t) node.offset >= nodes.size() ||
+         i + 1 >= nodes.size() || node.axis < 0 || node.axis > 2)
+      {
+         return false;
+      }
+      else
+      {
+         depth[i + 1] = std::max(depth[i + 1], depth[i] + 1);
+         depth[node.offset] = std::max(depth[node.offset], depth[i] + 1);
+      }
+   }
+   return true;
+}
+
+// saves and restores a built triangle_mesh, including its precomputed triangles and bvh
+struct compiled_mesh {
+   static void write(binary_writer& out, const triangle_mesh& mesh) {
+      out.put(mesh.mat_id);
+      out.put_array(mesh.vertices);
+      out.put_array(mesh.indices);
+      out.put((int32_t) mesh.tris.size());
+      out.put_array(mesh.tris.data);
+      out.put_array(mesh.normals);
+      out.put_array(mesh.accel.nodes);
+   }
+
+   static bool read(binary_reader& in, triangle_mesh& mesh) {
+      int32_t count;
+      if (!in.get(mesh.mat_id) || !in.get_array(mesh.vertices) || !in.get_array(mesh.indices) ||
+         !in.get(count) || !in.get_array(mesh.tris.data) || !in.get_array(mesh.normals) ||
+         !in.get_array(mesh.accel.nodes))
+      {
+         return false;
+      }
+      mesh.tris.count = count;
+      mesh.tris.stride = soa_array::padded(count);
+      size_t n = (size_t) count;
+      if (!mesh.tris.valid(triangle_components) || mesh.normals.size() != n || mesh.indices.size() != 3 * n ||
+         !valid_bvh(mesh.accel.nodes, n) || (mesh.accel.nodes.empty() && n > 0))
+      {
+         return false;
+      }
+      for (int index : mesh.indices)
+      {
+         if (index < 0 || (size_t) index >= mesh.vertices.size()) return false;
+      }
+      return true;
+   }
+};
+
+// modification time and size of a file, to tell whether it changed
+bool file_stamp(const std::string& filename, int64_t& mtime, int64_t& size)
+{
+   struct stat info;
+   if (stat(filename.c_str(), &info) != 0) return false;
+   mtime = (int64_t) info.st_mtime;
+   size = (int64_t) info.st_size;
+   return true;
+}
+
+// reads the statements of a text scene (see the top of this file)
+class scene_parser {
+public:
+   scene_parser(const std::string& file, int threads) : filename(file), num_threads(threads) {
+      // mesh paths are relative to the scene file
+      size_t slash = filename.find_last_of("/\\");
+      directory = slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+      transforms.push_back(glm::mat4(1.0f));
+   }
+
+   // parse one statement; on error, set error and return false
+   bool statement(const std::string& keyword, std::istringstream& args, std::string& error);
+
+public:
+   hittable_list world;
+   scene_camera cam;
+   std::vector<std::string> meshes; // the mesh files loaded
+
+private:
+   bool read_vec3(std::istringstream& args, glm::vec3& v) {
+      return (bool) (args >> v.x >> v.y >> v.z);
+   }
+
+   bool read_material(std::istringstream& args, material_id& id, std::string& error) {
+      std::string name;
+      if (!(args >> name))
+      {
+         error = "missing material";
+         return false;
+      }
+      std::map<std::string, material_id>::const_iterator found = materials.find(name);
+      if (found == materials.end())
+      {
+         error = "unknown material '" + name + "'";
+         return false;
+      }
+      id = found->second;
+      return true;
+   }
+
+   bool parse_material(std::istringstream& args, std::string& error);
+
+   glm::point3 transform_point(const glm::point3& p) const {
+      return glm::vec3(transforms.back() * glm::vec4(p, 1.0f));
+   }
+
+   glm::vec3 transform_normal(const glm::vec3& n) const {
+      return glm::transpose(glm::inverse(glm::mat3(transforms.back()))) * n;
+   }
+
+   // the transforms are rotations, translations and uniform scales
+   float transform_scale() const {
+      return glm::length(glm::vec3(transforms.back()[0]));
+   }
+
+   std::string filename;
+   std::string directory;
+   int num_threads;
+   std::map<std::string, material_id> materials;
+   std::map<std::string, shared_ptr<triangle_mesh>> loaded; // mesh files, in their own coordinates
+   shared_ptr<triangle_mesh> circle_mesh; // the unit_circle() of every circle
+   std::vector<glm::mat4> transforms; // the current transform is last; push and pop grow and shrink it
+};
+
+bool scene_parser::parse_material(std::istringstream& args, std::string& error)
+{
+   std::string name, type;
+   if (!(args >> name >> type))
+   {
+      error = "material needs a name and a type";
+      return false;
+   }
+
+   shared_ptr<material> m;
+   if (type == "lambertian")
+   {
+      glm::color albedo;
+      if (read_vec3(args, albedo)) m = make_shared<lambertian>(albedo);
+   }
+   else if (type == "metal")
+   {
+      glm::color albedo;
+      float fuzz;
+      if (read_vec3(args, albedo) && args >> fuzz) m = make_shared<metal>(albedo, fuzz);
+   }
+   else if (type == "dielectric")
+   {
+      float ir;
+      if (args >> ir) m = make_shared<dielectric>(ir);
+   }
+   else if (type == "diffuse_light")
+   {
+      glm::color emit;
+      if (read_vec3(args, emit)) m = make_shared<diffuse_light>(emit);
+   }
+   else if (type == "phong")
+   {
+      // a view position alone, or every parameter; either may end with noshadows
+      std::vector<float> values;
+      bool shadows = true;
+      std::string token;
+      while (args >> token)
+      {
+         if (token == "noshadows")
+         {
+            shadows = false;
+            break;
+         }
+         char* end;
+         values.push_back(strtof(token.c_str(), &end));
+         if (*end != '\0')
+         {
+            error = "bad number '" + token + "'";
+            return false;
+         }
+      }
+      args.clear();
+
+      const float* v = values.data();
+      if (values.size() == 3)
+      {
+         shared_ptr<phong> p = make_shared<phong>(glm::vec3(v[0], v[1], v[2]));
+         p->shadows = shadows;
+         m = p;
+      }
+      else if (values.size() == 19)
+      {
+         m = make_shared<phong>(glm::color(v[0], v[1], v[2]), glm::color(v[3], v[4], v[5]),
+            glm::color(v[6], v[7], v[8]), glm::point3(v[9], v[10], v[11]), glm::point3(v[12], v[13], v[14]),
+            v[15], v[16], v[17], v[18], shadows);
+      }
+      else
+      {
+         error = "phong needs a view position, or diffuse, specular and ambient colors, light and view "
+            "positions, kd, ks, ka and shininess";
+         return false;
+      }
+   }
+   else
+   {
+      error = "unknown material type '" + type + "'";
+      return false;
+   }
+
+   if (!m)
+   {
+      error = "missing or bad values for " + type;
+      return false;
+   }
+   materials[name] = world.materials.add(m);
+   return true;
+}
+
+bool scene_parser::statement(const std::string& keyword, std::istringstream& args, std::string& error)
+{
+   if (keyword == "camera")
+   {
+      std::string type;
+      args >> type;
+      scene_camera c;
+      c.defined = true;
+      if (type == "simple")
+      {
+         if (!read_vec3(args, c.position) || !(args >> c.viewport_height >> c.focal_length))
+         {
+            error = "camera simple needs a position, a viewport height and a focal length";
+            return false;
+         }
+      }
+      else if (type == "lookat")
+      {
+         c.look_at = true;
+         if (!read_vec3(args, c.position) || !read_vec3(args, c.lookat) || !read_vec3(args, c.vup) ||
+            !(args >> c.vfov))
+         {
+            error = "camera lookat needs lookfrom, lookat, vup and a field of view";
+            return false;
+         }
+         c.focus_dist = glm::length(c.lookat - c.position);
+         if (args >> c.aperture) args >> c.focus_dist;
+         args.clear();
+      }
+      else
+      {
+         error = "unknown camera '" + type + "' (expected simple or lookat)";
+         return false;
+      }
+      cam = c;
+   }
+   else if (keyword == "material")
+   {
+      if (!parse_material(args, error)) return false;
+   }
+   else if (keyword == "sphere")
+   {
+      glm::point3 center;
+      float radius;
+      material_id m;
+      if (!read_vec3(args, center) || !(args >> radius) || radius <= 0)
+      {
+         error = "sphere needs a center and a positive radius";
+         return false;
+      }
+      if (!read_material(args, m, error)) return false;
+      world.add(make_shared<sphere>(transform_point(center), radius * transform_scale(), m));
+   }
+   else if (keyword == "plane")
+   {
+      glm::point3 p;
+      glm::vec3 n;
+      material_id m;
+      if (!read_vec3(args, p) || !read_vec3(args, n) || glm::length(n) <= 0)
+      {
+         error = "plane needs a point and a nonzero normal";
+         return false;
+      }
+      if (!read_material(args, m, error)) return false;
+      world.add(make_shared<plane>(transform_point(p), transform_normal(n), m));
+   }
+   else if (keyword == "triangle")
+   {
+      glm::point3 a, b, c;
+      material_id m;
+      if (!read_vec3(args, a) || !read_vec3(args, b) || !read_vec3(args, c) ||
+         near_zero(glm::cross(b - a, c - a)))
+      {
+         error = "triangle needs three corners that are not colinear";
+         return false;
+      }
+      if (!read_material(args, m, error)) return false;
+      world.add(make_shared<triangle>(transform_point(a), transform_point(b), transform_point(c), m));
+   }
+   else if (keyword == "line")
+   {
+      glm::point3 a, b;
+      material_id m;
+      if (!read_vec3(args, a) || !read_vec3(args, b) || a == b)
+      {
+         error = "line needs two different endpoints";
+         return false;
+      }
+      if (!read_material(args, m, error)) return false;
+      world.add(make_shared<line>(transform_point(a), transform_point(b), m));
+   }
+   else if (keyword == "disk")
+   {
+      glm::point3 center;
+      glm::vec3 normal;
+      float inner, outer;
+      material_id m;
+      if (!read_vec3(args, center) || !read_vec3(args, normal) || glm::length(normal) <= 0 ||
+         !(args >> inner >> outer) || inner < 0 || outer <= inner)
+      {
+         error = "disk needs a center, a nonzero normal, and radii 0 <= inner < outer";
+         return false;
+      }
+      if (!read_material(args, m, error)) return false;
+      float s = transform_scale();
+      world.add(make_shared<disk>(transform_point(center), transform_normal(normal), inner * s, outer * s, m));
+   }
+   else if (keyword == "circle")
+   {
+      glm::point3 center;
+      float radius;
+      glm::vec3 angles;
+      material_id m;
+      if (!read_vec3(args, center) || !(args >> radius) || radius <= 0 || !read_vec3(args, angles))
+      {
+         error = "circle needs a center, a positive radius and euler angles";
+         return false;
+      }
+      if (!read_material(args, m, error)) return false;
+      if (!circle_mesh) circle_mesh = unit_circle(m);
+      world.add(make_shared<instance>(circle_mesh,
+         transforms.back() * placement(center, radius, angles * float(M_PI / 180.0)), m));
+   }
+   else if (keyword == "mesh")
+   {
+      std::string path;
+      material_id m;
+      if (!(args >> path))
+      {
+         error = "mesh needs a file";
+         return false;
+      }
+      if (!read_material(args, m, error)) return false;
+      bool absolute = path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':');
+      if (!absolute) path = directory + path;
+
+      shared_ptr<triangle_mesh>& mesh = loaded[path];
+      if (!mesh)
+      {
+         shared_ptr<triangle_mesh> file_mesh = make_shared<triangle_mesh>(m);
+         if (!load_mesh(path, *file_mesh, num_threads))
+         {
+            error = "cannot load mesh " + path;
+            return false;
+         }
+         file_mesh->build();
+         mesh = file_mesh;
+         meshes.push_back(path);
+      }
+      world.add(make_shared<instance>(mesh, transforms.back(), m));
+   }
+   else if (keyword == "translate" || keyword == "rotate")
+   {
+      glm::vec3 v;
+      if (!read_vec3(args, v))
+      {
+         error = keyword + " needs three numbers";
+         return false;
+      }
+      glm::mat4 step = keyword == "translate" ? glm::translate(glm::mat4(1.0f), v) :
+         glm::toMat4(glm::quat(v * float(M_PI / 180.0)));
+      transforms.back() = transforms.back() * step;
+   }
+   else if (keyword == "scale")
+   {
+      float s;
+      if (!(args >> s) || s <= 0)
+      {
+         error = "scale needs a positive factor";
+         return false;
+      }
+      transforms.back() = glm::scale(transforms.back(), glm::vec3(s));
+   }
+   else if (keyword == "push")
+   {
+      transforms.push_back(transforms.back());
+   }
+   else if (keyword == "pop")
+   {
+      if (transforms.size() == 1)
+      {
+         error = "pop without push";
+         return false;
+      }
+      transforms.pop_back();
+   }
+   else
+   {
+      error = "unknown statement '" + keyword + "'";
+      return false;
+   }
+
+   std::string extra;
+   if (args >> extra)
+   {
+      error = "unexpected '" + extra + "'";
+      return false;
+   }
+   return true;
+}
+
+bool parse_scene(const std::string& filename, hittable_list& world, scene_camera& cam,
+   int num_threads, std::vector<std::string>* sources)
+{
+   std::ifstream file(filename.c_str());
+   if (!file)
+   {
+      std::cerr << filename << ": cannot open file" << std::endl;
+      return false;
+   }
+
+   scene_parser parser(filename, num_threads);
+   std::string text;
+   int line_number = 0;
+   while (std::getline(file, text))
+   {
+      line_number++;
+      size_t comment = text.find('#');
+      if (comment != std::string::npos) text.erase(comment);
+
+      std::istringstream args(text);
+      std::string keyword, error;
+      if (!(args >> keyword)) continue; // blank line
+      if (!parser.statement(keyword, args, error))
+      {
+         std::cerr << filename << ":" << line_number << ": " << error << std::endl;
+         return false;
+      }
+   }
+
+   parser.world.build_bvh();
+   world = std::move(parser.world);
+   cam = parser.cam;
+   if (sources)
+   {
+      sources->push_back(filename);
+      sources->insert(sources->end(), parser.meshes.begin(), parser.meshes.end());
+   }
+   return true;
+}
+
+// write one object. shared numbers the objects that instances refer to.
+bool write_object(binary_writer& out, const hittable* h, const std::map<const hittable*, uint32_t>& shared)
+{
+   if (const sphere* s = dynamic_cast<const sphere*>(h))
+   {
+      out.put((uint32_t) tag_sphere);
+      out.put(s->center);
+      out.put(s->radius);
+      out.put(s->mat_id);
+   }
+   else if (const plane* p = dynamic_cast<const plane*>(h))
+   {
+      out.put((uint32_t) tag_plane);
+      out.put(p->a);
+      out.put(p->n);
+      out.put(p->mat_id);
+   }
+   else if (const triangle* t = dynamic_cast<const triangle*>(h))
+   {
+      out.put((uint32_t) tag_triangle);
+      out.put(t->a);
+      out.put(t->b);
+      out.put(t->c);
+      out.put(t->mat_id);
+   }
+   else if (const line* l = dynamic_cast<const line*>(h))
+   {
+      out.put((uint32_t) tag_line);
+      out.put(l->a);
+      out.put(l->b);
+      out.put(l->normal);
+      out.put(l->mat_id);
+   }
+   else if (const disk* k = dynamic_cast<const disk*>(h))
+   {
+      out.put((uint32_t) tag_disk);
+      out.put(k->center);
+      out.put(k->n);
+      out.put(k->inner_radius);
+      out.put(k->outer_radius);
+      out.put(k->mat_id);
+   }
+   else if (const triangle_mesh* mesh = dynamic_cast<const triangle_mesh*>(h))
+   {
+      out.put((uint32_t) tag_mesh);
+      compiled_mesh::write(out, *mesh);
+   }
+   else if (const instance* inst = dynamic_cast<const instance*>(h))
+   {
+      out.put((uint32_t) tag_instance);
+      out.put(inst->transform);
+      out.put(inst->mat_id);
+      out.put(shared.find(inst->object.get())->second);
+   }
+   else
+   {
+      return false;
+   }
+   return true;
+}
+
+bool save_compiled_scene(const std::string& filename, const hittable_list& world, const scene_camera& cam,
+   const std::vector<std::string>& sources)
+{
+   std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+   if (!file)
+   {
+      std::cerr << filename << ": cannot write file" << std::endl;
+      return false;
+   }
+   binary_writer out(file);
+
+   compiled_scene_header header;
+   memcpy(header.magic, compiled_scene_magic, sizeof(header.magic));
+   header.version = compiled_scene_version;
+   header.byte_order = 0x01020304;
+   header.float_size = sizeof(float);
+   header.vec3_size = sizeof(glm::vec3);
+   header.node_size = sizeof(bvh_node);
+   header.reserved = 0;
+   out.put(header);
+
+   // the sources, with their time and size when compiled
+   out.put((uint32_t) sources.size());
+   for (const std::string& source : sources)
+   {
+      int64_t mtime = 0, size = -1;
+      file_stamp(source, mtime, size);
+      out.put_string(source);
+      out.put(mtime);
+      out.put(size);
+   }
+
+   out.put((uint8_t) cam.defined);
+   out.put((uint8_t) cam.look_at);
+   out.put(cam.position);
+   out.put(cam.lookat);
+   out.put(cam.vup);
+   out.put(cam.vfov);
+   out.put(cam.aperture);
+   out.put(cam.focus_dist);
+   out.put(cam.viewport_height);
+   out.put(cam.focal_length);
+
+   out.put((uint32_t) world.materials.size());
+   for (int i = 0; i < world.materials.size(); i++)
+   {
+      const material& m = world.materials[i];
+      if (const lambertian* l = dynamic_cast<const lambertian*>(&m))
+      {
+         out.put((uint32_t) tag_lambertian);
+         out.put(l->albedo);
+      }
+      else if (const phong* p = dynamic_cast<const phong*>(&m))
+      {
+         out.put((uint32_t) tag_phong);
+         out.put(p->diffuseColor);
+         out.put(p->specColor);
+         out.put(p->ambientColor);
+         out.put(p->lightPos);
+         out.put(p->viewPos);
+         out.put(p->kd);
+         out.put(p->ks);
+         out.put(p->ka);
+         out.put(p->shininess);
+         out.put((uint8_t) p->shadows);
+      }
+      else if (const metal* mt = dynamic_cast<const metal*>(&m))
+      {
+         out.put((uint32_t) tag_metal);
+         out.put(mt->albedo);
+         out.put(mt->fuzz);
+      }
+      else if (const dielectric* d = dynamic_cast<const dielectric*>(&m))
+      {
+         out.put((uint32_t) tag_dielectric);
+         out.put(d->ir);
+      }
+      else if (const diffuse_light* e = dynamic_cast<const diffuse_light*>(&m))
+      {
+         out.put((uint32_t) tag_diffuse_light);
+         out.put(e->emit);
+      }
+      else
+      {
+         std::cerr << filename << ": cannot compile material " << i << std::endl;
+         return false;
+      }
+   }
+
+   // the objects that instances share come first, so that instances can refer to them
+   std::map<const hittable*, uint32_t> shared;
+   std::vector<const hittable*> shared_objects;
+   for (const auto& object : world.objects)
+   {
+      const instance* inst = dynamic_cast<const instance*>(object.get());
+      if (inst && shared.insert(std::make_pair(inst->object.get(), (uint32_t) shared_objects.size())).second)
+      {
+         shared_objects.push_back(inst->object.get());
+      }
+   }
+   out.put((uint64_t) shared_objects.size());
+   for (const hittable* h : shared_objects)
+   {
+      // instances of instances are not supported
+      if (dynamic_cast<const instance*>(h) || !write_object(out, h, shared))
+      {
+         std::cerr << filename << ": cannot compile object of type " << typeid(*h).name() << std::endl;
+         return false;
+      }
+   }
+
+   out.put((uint64_t) world.objects.size());
+   for (const auto& object : world.objects)
+   {
+      const hittable* h = object.get();
+      if (!write_object(out, h, shared))
+      {
+         std::cerr << filename << ": cannot compile object of type " << typeid(*h).name() << std::endl;
+         return false;
+      }
+   }
+
+   out.put((uint8_t) world.accelerated);
+   if (world.accelerated)
+   {
+      out.put_array(world.accel.nodes);
+      out.put_array(world.accel.indices);
+   }
+
+   file.close();
+   if (!file)
+   {
+      std::cerr << filename << ": cannot write file" << std::endl;
+      return false;
+   }
+   return true;
+}
+
+// read the header and the sources of a compiled scene; sources_current tells whether every source
+// still has the time and size it had when compiled
+bool read_compiled_header(binary_reader& in, bool& sources_current)
+{
+   compiled_scene_header header;
+   if (!in.get(header) || memcmp(header.magic, compiled_scene_magic, sizeof(header.magic)) != 0 ||
+      header.version != compiled_scene_version || header.byte_order != 0x01020304 ||
+      header.float_size != sizeof(float) || header.vec3_size != sizeof(glm::vec3) ||
+      header.node_size != sizeof(bvh_node))
+   {
+      return false;
+   }
+
+   sources_current = true;
+   uint32_t num_sources;
+   if (!in.get(num_sources)) return false;
+   for (uint32_t i = 0; i < num_sources; i++)
+   {
+      std::string source;
+      int64_t mtime, size, now_mtime, now_size;
+      if (!in.get_string(source) || !in.get(mtime) || !in.get(size)) return false;
+      if (!file_stamp(source, now_mtime, now_size) || now_mtime != mtime || now_size != size)
+      {
+         sources_current = false;
+      }
+   }
+   return true;
+}
+
+// read one object; instances refer to the shared objects read before them. Returns null for an
+// unknown object, or one with a material out of range.
+// Objects are filled in field by field: the constructors would redo their set up (e.g. a plane
+// flips its normal to follow its orientation rule).
+shared_ptr<hittable> read_object(binary_reader& in, const std::vector<shared_ptr<hittable>>& shared,
+   int num_materials)
+{
+   uint32_t tag = 0;
+   in.get(tag);
+   shared_ptr<hittable> object;
+   material_id m = -1;
+   if (tag == tag_sphere)
+   {
+      shared_ptr<sphere> s = make_shared<sphere>();
+      in.get(s->center);
+      in.get(s->radius);
+      in.get(s->mat_id);
+      m = s->mat_id;
+      object = s;
+   }
+   else if (tag == tag_plane)
+   {
+      shared_ptr<plane> p = make_shared<plane>();
+      in.get(p->a);
+      in.get(p->n);
+      in.get(p->mat_id);
+      m = p->mat_id;
+      object = p;
+   }
+   else if (tag == tag_triangle)
+   {
+      shared_ptr<triangle> t = make_shared<triangle>();
+      in.get(t->a);
+      in.get(t->b);
+      in.get(t->c);
+      in.get(t->mat_id);
+      m = t->mat_id;
+      object = t;
+   }
+   else if (tag == tag_line)
+   {
+      shared_ptr<line> l = make_shared<line>();
+      in.get(l->a);
+      in.get(l->b);
+      in.get(l->normal);
+      in.get(l->mat_id);
+      m = l->mat_id;
+      object = l;
+   }
+   else if (tag == tag_disk)
+   {
+      shared_ptr<disk> k = make_shared<disk>();
+      in.get(k->center);
+      in.get(k->n);
+      in.get(k->inner_radius);
+      in.get(k->outer_radius);
+      in.get(k->mat_id);
+      m = k->mat_id;
+      object = k;
+   }
+   else if (tag == tag_mesh)
+   {
+      shared_ptr<triangle_mesh> mesh = make_shared<triangle_mesh>();
+      if (!compiled_mesh::read(in, *mesh)) return 0;
+      m = mesh->mat_id;
+      object = mesh;
+   }
+   else if (tag == tag_instance)
+   {
+      glm::mat4 transform;
+      uint32_t index = 0;
+      in.get(transform);
+      in.get(m);
+      in.get(index);
+      if (index >= shared.size()) return 0;
+      object = make_shared<instance>(shared[index], transform, m);
+   }
+   else
+   {
+      return 0;
+   }
+
+   if (!in.ok() || m < -1 || m >= num_materials) return 0;
+   return object;
+}
+
+bool load_compiled_scene(const std::string& filename, hittable_list& world, scene_camera& cam)
+{
+   mapped_file file;
+   if (!file.open(filename))
+   {
+      std::cerr << filename << ": cannot open file" << std::endl;
+      return false;
+   }
+   binary_reader in(file.begin(), file.end());
+
+   bool sources_current;
+   if (!read_compiled_header(in, sources_current))
+   {
+      std::cerr << filename << ": not a compiled scene, or compiled on another kind of machine" << std::endl;
+      return false;
+   }
+
+   hittable_list scene;
+   scene_camera view;
+   uint8_t defined = 0, look_at = 0;
+   in.get(defined);
+   in.get(look_at);
+   in.get(view.position);
+   in.get(view.lookat);
+   in.get(view.vup);
+   in.get(view.vfov);
+   in.get(view.aperture);
+   in.get(view.focus_dist);
+   in.get(view.viewport_height);
+   in.get(view.focal_length);
+   view.defined = defined != 0;
+   view.look_at = look_at != 0;
+
+   uint32_t num_materials = 0;
+   in.get(num_materials);
+   for (uint32_t i = 0; i < num_materials && in.ok(); i++)
+   {
+      uint32_t tag = 0;
+      in.get(tag);
+      if (tag == tag_lambertian)
+      {
+         glm::color albedo;
+         in.get(albedo);
+         scene.materials.add(make_shared<lambertian>(albedo));
+      }
+      else if (tag == tag_phong)
+      {
+         glm::color diffuse, spec, ambient;
+         glm::point3 light, view_pos;
+         float kd, ks, ka, shininess;
+         uint8_t shadows = 1;
+         in.get(diffuse);
+         in.get(spec);
+         in.get(ambient);
+         in.get(light);
+         in.get(view_pos);
+         in.get(kd);
+         in.get(ks);
+         in.get(ka);
+         in.get(shininess);
+         in.get(shadows);
+         scene.materials.add(make_shared<phong>(diffuse, spec, ambient, light, view_pos, kd, ks, ka, shininess,
+            shadows != 0));
+      }
+      else if (tag == tag_metal)
+      {
+         glm::color albedo;
+         float fuzz = 0;
+         in.get(albedo);
+         in.get(fuzz);
+         scene.materials.add(make_shared<metal>(albedo, fuzz));
+      }
+      else if (tag == tag_dielectric)
+      {
+         float ir = 1;
+         in.get(ir);
+         scene.materials.add(make_shared<dielectric>(ir));
+      }
+      else if (tag == tag_diffuse_light)
+      {
+         glm::color emit;
+         in.get(emit);
+         scene.materials.add(make_shared<diffuse_light>(emit));
+      }
+      else
+      {
+         std::cerr << filename << ": unknown material" << std::endl;
+         return false;
+      }
+   }
+
+   uint64_t num_shared = 0;
+   std::vector<shared_ptr<hittable>> shared;
+   in.get(num_shared);
+   for (uint64_t i = 0; i < num_shared && in.ok(); i++)
+   {
+      shared_ptr<hittable> object = read_object(in, shared, scene.materials.size());
+      if (!object || dynamic_cast<const instance*>(object.get()))
+      {
+         std::cerr << filename << (in.ok() ? ": bad object" : ": file is truncated") << std::endl;
+         return false;
+      }
+      shared.push_back(object);
+   }
+
+   uint64_t num_objects = 0;
+   size_t num_bounded = 0;
+   in.get(num_objects);
+   for (uint64_t i = 0; i < num_objects && in.ok(); i++)
+   {
+      shared_ptr<hittable> object = read_object(in, shared, scene.materials.size());
+      if (!object)
+      {
+         std::cerr << filename << (in.ok() ? ": bad object" : ": file is truncated") << std::endl;
+         return false;
+      }
+      aabb box;
+      if (object->bounding_box(box)) num_bounded++;
+      scene.add(object);
+   }
+
+   uint8_t accelerated = 0;
+   in.get(accelerated);
+   if (accelerated && in.ok())
+   {
+      bvh tree;
+      in.get_array(tree.nodes);
+      in.get_array(tree.indices);
+      bool valid = tree.indices.size() == num_bounded && valid_bvh(tree.nodes, tree.indices.size()) &&
+         (num_bounded == 0 || !tree.nodes.empty());
+      for (size_t i = 0; valid && i < tree.indices.size(); i++)
+      {
+         valid = tree.indices[i] >= 0 && (size_t) tree.indices[i] < num_bounded;
+      }
+      if (in.ok() && !valid)
+      {
+         std::cerr << filename << ": bad bvh" << std::endl;
+         return false;
+      }
+      scene.set_bvh(std::move(tree));
+   }
+
+   if (!in.ok())
+   {
+      std::cerr << filename << ": file is truncated" << std::endl;
+      return false;
+   }
+
+   world = std::move(scene);
+   cam = view;
+   return true;
+}
+
+bool compiled_scene_current(const std::string& filename)
+{
+   mapped_file file;
+   if (!file.open(filename)) return false;
+   binary_reader in(file.begin(), file.end());
+   bool sources_current;
+   return read_compiled_header(in, sources_current) && sources_current;
+}
+
+bool load_scene(const std::string& filename, hittable_list& world, scene_camera& cam, int num_threads)
+{
+   // a compiled scene is used as it is
+   std::ifstream file(filename.c_str(), std::ios::binary);
+   char magic[sizeof(compiled_scene_magic)] = { 0 };
+   file.read(magic, sizeof(magic));
+   file.close();
+   if (memcmp(magic, compiled_scene_magic, sizeof(magic)) == 0)
+   {
+      return load_compiled_scene(filename, world, cam);
+   }
+
+   std::string compiled = filename + ".bin";
+   if (compiled_scene_current(compiled) && load_compiled_scene(compiled, world, cam))
+   {
+      return true;
+   }
+
+   std::vector<std::string> sources;
+   if (!parse_scene(filename, world, cam, num_threads, &sources)) return false;
+
+   // if the compiled copy cannot be written, the next run parses the scene again
+   save_compiled_scene(compiled, world, cam, sources);
+   return true;
+}
+
+#endif
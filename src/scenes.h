@@ -0,0 +1,344 @@
+// scenes.h, scene building helpers shared by the ray tracers and the benchmarks
+// (moved out of basic.cpp)
+
+#ifndef SCENES_H_
+#define SCENES_H_
+
+#include "AGLM.h"
+#include "sphere.h"
+#include "plane.h"
+#include "triangle.h"
+#include "line.h"
+#include "triangle_mesh.h"
+#include "instance.h"
+#include "disk.h"
+#include "sphere_set.h"
+#include "camera.h"
+#include "material.h"
+#include "hittable_list.h"
+
+// counterclockwise rotation of a vector by theta on the xz plane
+glm::point3 xy_rotation(glm::point3& p, float theta)
+{
+   glm::point3 q;
+   // apply the 2d rotation matrix
+   q[0] = std::cos(theta) * p[0] - std::sin(theta) * p[1];
+   q[1] = std::sin(theta) * p[0] + std::cos(theta) * p[1];
+   q[2] = q[2];
+   return q;
+}
+
+// translate a point p by a vector v
+glm::point3 translation(glm::point3& p, glm::vec3 v)
+{
+   glm::point3 q;
+   // apply the translation
+   q[0] = p[0] + v[0];
+   q[1] = p[1] + v[1];
+   q[2] = p[2] + v[2];
+   return q;
+}
+
+// rotate a point by an euler angle a
+glm::point3 rotation(glm::point3& p, glm::vec3 a)
+{
+   glm::quat Q = glm::quat(a);
+   glm::mat3 M = glm::toMat3(Q);
+   return M*p;
+}
+
+// create a circle with center c and radius r in the scene
+void circle(const glm::point3& c, float r, material_id m, glm::vec3 a, hittable_list& world)
+{
+   // angle of each slice
+   float dtheta = 2*M_PI/static_cast<float>(10);
+   // starting point
+   glm::point3 p(r, 0, 0);
+
+   for (int i =0; i < 10; i++)
+   {
+      // find the two points that define the current slice
+      float theta1 = static_cast<float>(i) * dtheta;
+      float theta2 = static_cast<float>(i+1) * dtheta;
+      glm::point3 v1 = xy_rotation(p, theta1);
+      glm::point3 v2 = xy_rotation(p, theta2);
+      v1 = rotation(v1, a);
+      v2 = rotation(v2, a);
+      glm::point3 p1 = translation(v1, c);
+      glm::point3 p2 = translation(v2, c);
+
+      world.add(make_shared<triangle>(c, p1, p2, m));
+   }
+}
+
+// add a circle with center c and radius r to a mesh: ten slices sharing the center vertex
+void circle(const glm::point3& c, float r, glm::vec3 a, triangle_mesh& mesh)
+{
+   // angle of each slice
+   float dtheta = 2*M_PI/static_cast<float>(10);
+   // starting point
+   glm::point3 p(r, 0, 0);
+
+   int center = mesh.add_vertex(c);
+   int first = -1;
+   int previous = -1;
+   for (int i = 0; i < 10; i++)
+   {
+      // the rim points are shared by neighboring slices
+      glm::point3 v = xy_rotation(p, static_cast<float>(i) * dtheta);
+      v = rotation(v, a);
+      int current = mesh.add_vertex(translation(v, c));
+      if (i == 0)
+      {
+         first = current;
+      }
+      else
+      {
+         mesh.add_triangle(center, previous, current);
+      }
+      previous = current;
+   }
+   mesh.add_triangle(center, previous, first);
+}
+
+void tetrahedron(material_id m1, material_id m2, material_id m3, material_id m4, hittable_list& world)
+{
+   // tetrahedron in the unique image
+   glm::point3 p1 = glm::point3(13,-16,-20);
+   glm::point3 p2 = glm::point3(8,-28,-40);
+   glm::point3 p3 = glm::point3(30,-28,-40);
+   glm::point3 p4 = glm::point3(13, -10, -30);
+
+   // tetrahedron demonstration
+   /*glm::point3 p1 = glm::point3(0,-0.8, -1);
+   glm::point3 p2 = glm::point3(2,-1,-2);
+   glm::point3 p3 = glm::point3(-2,-1,-2);
+   glm::point3 p4 = glm::point3(0,1,-1.5);*/
+
+   world.add(make_shared<triangle>(p1, p2, p3, m1));
+   world.add(make_shared<triangle>(p1, p2, p4, m1));
+   world.add(make_shared<triangle>(p1, p3, p4, m1));
+   world.add(make_shared<triangle>(p4, p2, p3, m1));
+   
+}
+
+// add the tetrahedron of the unique image to a mesh, with its faces wound outward
+void tetrahedron(triangle_mesh& mesh)
+{
+   int p1 = mesh.add_vertex(glm::point3(13,-16,-20));
+   int p2 = mesh.add_vertex(glm::point3(8,-28,-40));
+   int p3 = mesh.add_vertex(glm::point3(30,-28,-40));
+   int p4 = mesh.add_vertex(glm::point3(13, -10, -30));
+
+   mesh.add_triangle(p1, p2, p3);
+   mesh.add_triangle(p1, p4, p2);
+   mesh.add_triangle(p1, p3, p4);
+   mesh.add_triangle(p4, p3, p2);
+}
+
+// create a planet in the scene
+void planet(const glm::point3& c, float r, float d, material_id m1, material_id m2, glm::vec3 a, hittable_list& world)
+{
+
+   world.add(make_shared<sphere>(c, r, m1));
+
+   // the ring is a flat annulus from the surface out to r+d, facing the z axis turned by the euler
+   // angles a, where circle() would put its disk
+   glm::vec3 normal = glm::toMat3(glm::quat(a)) * glm::vec3(0, 0, 1);
+   world.add(make_shared<disk>(c, normal, r, r+d, m2));
+}
+
+// the transform that scales by s, rotates by the euler angles a and moves to c, the way circle()
+// places its disk
+glm::mat4 placement(const glm::point3& c, float s, glm::vec3 a)
+{
+   return glm::translate(glm::mat4(1.0f), c) * glm::toMat4(glm::quat(a)) * glm::scale(glm::mat4(1.0f), glm::vec3(s));
+}
+
+// a disk of radius 1 around the origin in the xy plane, as a mesh that planets can share
+shared_ptr<triangle_mesh> unit_circle(material_id m)
+{
+   shared_ptr<triangle_mesh> ring = make_shared<triangle_mesh>(m);
+   circle(glm::point3(0), 1.0f, glm::vec3(0), *ring);
+   ring->build();
+   return ring;
+}
+
+// create a planet whose ring is an instance of ring, a unit_circle() shared by any number of
+// planets, so that a belt of planets costs one ring mesh
+void planet(const glm::point3& c, float r, float d, material_id m1, material_id m2, glm::vec3 a,
+   const shared_ptr<hittable>& ring, hittable_list& world)
+{
+   world.add(make_shared<sphere>(c, r, m1));
+   world.add(make_shared<instance>(ring, placement(c, r + d, a), m2));
+}
+
+// an asteroid field: n spheres with radii in [r0, r1] scattered over the box from lo to hi, in one
+// sphere_set
+shared_ptr<sphere_set> asteroid_field(int n, const glm::point3& lo, const glm::point3& hi, float r0, float r1,
+   material_id m)
+{
+   shared_ptr<sphere_set> field = make_shared<sphere_set>();
+   for (int i = 0; i < n; i++)
+   {
+      glm::point3 c = lo + (hi - lo) * glm::vec3(random_float(), random_float(), random_float());
+      field->add(c, random_float(r0, r1), m);
+   }
+   field->build();
+   return field;
+}
+
+// the Space Station scene (see results/basic.png). Phong materials are lit for a viewer at camera_pos
+void space_station(hittable_list& world, const glm::point3& camera_pos)
+{
+   using glm::color;
+   using glm::point3;
+   using glm::vec3;
+
+   material_id planetm = world.materials.add(make_shared<lambertian>(color(237.0f/255.0f, 219.0f/255.0f, 173.0f/255.0f)));
+   material_id circlem = world.materials.add(make_shared<lambertian>(color(252.0f/255.0f, 238.0f/255.0f, 173.0f/255.0f)));
+   material_id varus = world.materials.add(make_shared<lambertian>(color(98.0f/255.0f, 174.0f/255.0f, 231.0f/255.0f)));
+   material_id yellow = world.materials.add(make_shared<lambertian>(color(246.0f/255.0f, 255.0f/255.0f, 104.0f/255.0f)));
+   material_id gray = world.materials.add(make_shared<lambertian>(color(140.0f/255.0f, 140.0f/255.0f, 148.0f/255.0f)));
+
+   // the lights are outside the room, behind the walls, so the walls are not shadowed
+   material_id lwall = world.materials.add(make_shared<phong>(color(49.0f/255.0f, 38.0f/255.0f, 96.0f/255.0f), 
+     color(1,1,1),
+     color(.01f, .01f, .01f),
+     vec3(0,100,-1000),
+     camera_pos, 
+     0.45, 0.45, 0.1, 20.0, false));
+   material_id rwall = world.materials.add(make_shared<phong>(color(49.0f/255.0f, 38.0f/255.0f,96.0f/255.0f), 
+     color(1,1,1),
+     color(.01f, .01f, .01f),
+     vec3(0,100,-1000),
+     camera_pos, 
+     0.45, 0.45, 0.1, 20.0, false));
+   material_id floor = world.materials.add(make_shared<phong>(color(88.0f/255.0f, 98.0f/255.0f,100.0f/255.0f), 
+     color(1,1,1),
+     color(.01f, .01f, .01f),
+     vec3(0,03,-10000),
+     camera_pos, 
+     0.45, 0.45, 0.1, 20.0, false));
+   material_id ceiling = world.materials.add(make_shared<phong>(color(0.0f/255.0f, 0.0f/255.0f,0.0f/255.0f), 
+     color(1,1,1),
+     color(.01f, .01f, .01f),
+     vec3(0,3,-10000),
+     camera_pos, 
+     0.45, 0.45, 0.1, 20.0, false));
+   material_id glass = world.materials.add(make_shared<dielectric>(1.5f));
+   material_id metalBlue = world.materials.add(make_shared<lambertian>(color(211.0f/255.0f, 236.0f/255.0f, 230.0f/255.0f)));
+
+   world.add(make_shared<plane>(point3(0,-4,0), vec3(0,1,-0.6), floor));
+   world.add(make_shared<plane>(point3(6,0,0), vec3(1,0,0.7), lwall));
+   world.add(make_shared<plane>(point3(-6,0,0), vec3(1,0,-0.7), rwall));
+   world.add(make_shared<plane>(point3(0,4,0), vec3(0,1,0.6), ceiling));
+
+   world.add(make_shared<plane>(point3(0,0,-100), vec3(0,0,1), glass));
+   planet(point3(0,0,-120), 20.0f, 20.0f, planetm, circlem, vec3(-0.45 * M_PI,0, 0.1 * M_PI), world);
+   world.add(make_shared<sphere>(point3(-30, 30, -200), 3.0f, yellow));
+   world.add(make_shared<sphere>(point3(25, 18, -120), 5.0f, gray));
+   world.add(make_shared<sphere>(point3(30, -30, -160), 10.0f, varus));
+
+   shared_ptr<triangle_mesh> tetra = make_shared<triangle_mesh>(metalBlue);
+   tetrahedron(*tetra);
+   tetra->build();
+   world.add(tetra);
+}
+
+// the camera of the Space Station scene
+camera space_station_camera(float aspect)
+{
+   glm::point3 lookfrom(0,0,0);
+   glm::point3 lookat(0,0,-120);
+   glm::vec3 vup(0,1,0);
+   auto dist_to_focus = (lookfrom-lookat).length();
+   auto aperture = 0.0;
+   return camera(lookfrom, lookat, vup, 90, aspect, aperture, dist_to_focus);
+}
+
+// the spheres of materials.cpp: one per material (see results/materials.png). The phong sphere is
+// lit for a viewer at camera_pos
+void materials_scene(hittable_list& world, const glm::point3& camera_pos)
+{
+   using glm::color;
+   using glm::point3;
+
+   material_id gray = world.materials.add(make_shared<lambertian>(color(0.5f)));
+   material_id matteGreen = world.materials.add(make_shared<lambertian>(color(0, 0.5f, 0)));
+   material_id metalRed = world.materials.add(make_shared<metal>(color(1, 0, 0), 0.3f));
+   material_id glass = world.materials.add(make_shared<dielectric>(1.5f));
+   material_id phongDefault = world.materials.add(make_shared<phong>(camera_pos));
+
+   world.add(make_shared<sphere>(point3(-2.25, 0, -1), 0.5f, phongDefault));
+   world.add(make_shared<sphere>(point3(-0.75, 0, -1), 0.5f, glass));
+   world.add(make_shared<sphere>(point3(2.25, 0, -1), 0.5f, metalRed));
+   world.add(make_shared<sphere>(point3(0.75, 0, -1), 0.5f, matteGreen));
+   world.add(make_shared<sphere>(point3(0, -100.5, -1), 100, gray));
+}
+
+// the camera of materials.cpp
+camera materials_camera(float aspect)
+{
+   glm::point3 camera_pos(0, 0, 6);
+   float viewport_height = 2.0f;
+   float focal_length = 4.0;
+   return camera(camera_pos, viewport_height, aspect, focal_length);
+}
+
+// the gray sphere on the ground of raytracer.cpp
+void raytracer_scene(hittable_list& world)
+{
+   material_id gray = world.materials.add(make_shared<lambertian>(glm::color(0.5f)));
+
+   world.add(make_shared<sphere>(glm::point3(0, 0, -1), 0.5f, gray));
+   world.add(make_shared<sphere>(glm::point3(0, -100.5, -1), 100, gray));
+}
+
+// the camera of raytracer.cpp
+camera raytracer_camera(float aspect)
+{
+   glm::point3 camera_pos(0);
+   float viewport_height = 2.0f;
+   float focal_length = 1.0;
+   return camera(camera_pos, viewport_height, aspect, focal_length);
+}
+
+// a room lit only by a small lamp and a ceiling panel, as in scenes/lamps.scene
+void lamp_room(hittable_list& world)
+{
+   using glm::color;
+   using glm::point3;
+   using glm::vec3;
+
+   material_id white = world.materials.add(make_shared<lambertian>(color(0.73f)));
+   material_id red = world.materials.add(make_shared<lambertian>(color(0.65f, 0.05f, 0.05f)));
+   material_id green = world.materials.add(make_shared<lambertian>(color(0.12f, 0.45f, 0.15f)));
+   material_id gold = world.materials.add(make_shared<metal>(color(0.8f, 0.6f, 0.2f), 0.1f));
+   material_id glass = world.materials.add(make_shared<dielectric>(1.5f));
+   material_id bulb = world.materials.add(make_shared<diffuse_light>(color(40, 36, 30)));
+   material_id panel = world.materials.add(make_shared<diffuse_light>(color(6.0f)));
+
+   world.add(make_shared<plane>(point3(0, 0, 0), vec3(0, 1, 0), white));
+   world.add(make_shared<plane>(point3(0, 3, 0), vec3(0, -1, 0), white));
+   world.add(make_shared<plane>(point3(0, 0, -2), vec3(0, 0, 1), white));
+   world.add(make_shared<plane>(point3(-2, 0, 0), vec3(1, 0, 0), red));
+   world.add(make_shared<plane>(point3(2, 0, 0), vec3(-1, 0, 0), green));
+
+   world.add(make_shared<sphere>(point3(-0.8f, 0.5f, -0.6f), 0.5f, white));
+   world.add(make_shared<sphere>(point3(0.8f, 0.4f, 0), 0.4f, gold));
+   world.add(make_shared<sphere>(point3(0, 0.3f, 0.8f), 0.3f, glass));
+
+   world.add(make_shared<sphere>(point3(0.9f, 2.2f, -1.2f), 0.1f, bulb));
+   world.add(make_shared<disk>(point3(0, 2.99f, 0), vec3(0, -1, 0), 0.0f, 0.35f, panel));
+}
+
+// the camera of lamp_room()
+camera lamp_room_camera(float aspect)
+{
+   glm::point3 lookfrom(0, 1, 4);
+   glm::point3 lookat(0, 0.6f, 0);
+   return camera(lookfrom, lookat, glm::vec3(0, 1, 0), 60, aspect, 0, glm::length(lookat - lookfrom));
+}
+
+#endif
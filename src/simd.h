@@ -0,0 +1,399 @@
+// simd.h, ray tests against 4 or 8 primitives at once, over structure-of-arrays storage
+// Primitives of one kind are kept component by component (every center x, then every center y,
+// ...), so that one instruction loads a component of 8 neighboring primitives. A kernel tests
+// one ray against the primitives of a bvh leaf and returns the nearest hit. There are AVX2 (8
+// lanes), SSE2 (4 lanes) and scalar kernels; the CPU is asked at runtime which it can run, so one
+// binary runs anywhere. The kernels do the arithmetic of the scalar code in the same order and
+// without fused multiply-adds, so all of them return the same hits, bit for bit.
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include "AGLM.h"
+#include "ray.h"
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RT_SIMD_X86
+#include <immintrin.h>
+#endif
+
+enum simd_level { simd_scalar, simd_sse, simd_avx2 };
+
+// the widest kernels the CPU runs
+inline simd_level detected_simd_level()
+{
+#ifdef RT_SIMD_X86
+   if (__builtin_cpu_supports("avx2")) return simd_avx2;
+   if (__builtin_cpu_supports("sse2")) return simd_sse;
+#endif
+   return simd_scalar;
+}
+
+// the kernels in use; detected once. It may be lowered (e.g. to compare kernels), but never
+// raised above detected_simd_level().
+inline simd_level& active_simd_level()
+{
+   static simd_level level = detected_simd_level();
+   return level;
+}
+
+// the widest kernel, in primitives
+const int simd_max_width = 8;
+
+// n primitives of a few float components each, stored component by component: component c of
+// primitive i is (*this)[c][i]. Each component is followed by padding, so that a kernel can load
+// a whole vector starting at any primitive.
+class soa_array {
+public:
+   soa_array() : count(0), stride(0) {}
+
+   void resize(int n, int components) {
+      count = n;
+      stride = padded(n);
+      data.assign((size_t) components * stride, 0.0f);
+   }
+
+   int size() const { return count; }
+
+   float* operator[](int c) { return &data[(size_t) c * stride]; }
+   const float* operator[](int c) const { return &data[(size_t) c * stride]; }
+
+   // whether data and count agree, e.g. after they were read from a file
+   bool valid(int components) const {
+      return count >= 0 && stride == padded(count) && data.size() == (size_t) components * stride;
+   }
+
+   static int padded(int n) { return n + simd_max_width - 1; }
+
+public:
+   std::vector<float> data;
+   int count;
+   int stride;
+};
+
+// the components of a sphere in a soa_array
+enum sphere_component { sphere_cx, sphere_cy, sphere_cz, sphere_r2, sphere_components };
+
+// the components of a triangle in a soa_array: v0 and the edges v1 - v0 and v2 - v0
+enum triangle_component {
+   triangle_v0x, triangle_v0y, triangle_v0z, triangle_e1x, triangle_e1y, triangle_e1z,
+   triangle_e2x, triangle_e2y, triangle_e2z, triangle_components
+};
+
+// a ray with what the kernels derive from it, computed once per ray rather than once per leaf
+struct kernel_ray {
+   kernel_ray(const ray& r) : orig(r.orig), dir(r.dir) {
+      float len = glm::length(r.dir);
+      unit_dir = r.dir / len;
+      inv_len = 1.0f / len;
+   }
+
+   glm::point3 orig;
+   glm::vec3 dir;
+   glm::vec3 unit_dir;
+   float inv_len; // 1 / length(dir), which turns distances along unit_dir into ray times
+};
+
+// the nearest of the count primitives from first that r hits in [t_min, t_max]: returns its index
+// and lowers t_max to its time, or returns -1. On equal times the last primitive wins, as in a
+// scalar loop that accepts t <= t_max.
+typedef int (*leaf_kernel)(const soa_array& prims, int first, int count, const kernel_ray& r, float t_min,
+   float& t_max);
+
+struct simd_kernels {
+   const char* name;
+   int width; // primitives per step
+   leaf_kernel nearest_sphere;
+   leaf_kernel nearest_triangle;
+};
+
+// the kernels of a level, or of the active one
+const simd_kernels& kernels(simd_level level);
+inline const simd_kernels& active_kernels() { return kernels(active_simd_level()); }
+
+// scalar kernels: the geometric sphere test of sphere::intersect() and the Moller-Trumbore test
+// that triangle_mesh used before its triangles were split into components
+
+int nearest_sphere_scalar(const soa_array& s, int first, int count, const kernel_ray& r, float t_min, float& t_max)
+{
+   int nearest = -1;
+   for (int i = first; i < first + count; i++)
+   {
+      // the ray passes the center at distance sqrt(m2), s_i along the unit direction
+      glm::vec3 el = glm::point3(s[sphere_cx][i], s[sphere_cy][i], s[sphere_cz][i]) - r.orig;
+      float s_i = glm::dot(el, r.unit_dir);
+      float el2 = glm::dot(el, el);
+      float r2 = s[sphere_r2][i];
+      float m2 = el2 - s_i * s_i;
+      if (m2 > r2) continue;
+
+      float q = sqrt(r2 - m2);
+      float t = (s_i - q) * r.inv_len;
+      if (t < t_min || t > t_max)
+      {
+         t = (s_i + q) * r.inv_len;
+         if (t < t_min || t > t_max) continue;
+      }
+      t_max = t;
+      nearest = i;
+   }
+   return nearest;
+}
+
+int nearest_triangle_scalar(const soa_array& tris, int first, int count, const kernel_ray& r, float t_min,
+   float& t_max)
+{
+   int nearest = -1;
+   for (int i = first; i < first + count; i++)
+   {
+      glm::point3 v0(tris[triangle_v0x][i], tris[triangle_v0y][i], tris[triangle_v0z][i]);
+      glm::vec3 e1(tris[triangle_e1x][i], tris[triangle_e1y][i], tris[triangle_e1z][i]);
+      glm::vec3 e2(tris[triangle_e2x][i], tris[triangle_e2y][i], tris[triangle_e2z][i]);
+
+      // a parallel ray (det = 0) gives non-finite u, v and fails the tests
+      glm::vec3 pvec = glm::cross(r.dir, e2);
+      float inv_det = 1.0f / glm::dot(e1, pvec);
+      glm::vec3 tvec = r.orig - v0;
+      float u = glm::dot(tvec, pvec) * inv_det;
+      glm::vec3 qvec = glm::cross(tvec, e1);
+      float v = glm::dot(r.dir, qvec) * inv_det;
+      float t = glm::dot(e2, qvec) * inv_det;
+      if ((u >= 0.0f) & (v >= 0.0f) & (u + v <= 1.0f) & (t >= t_min) & (t <= t_max))
+      {
+         t_max = t;
+         nearest = i;
+      }
+   }
+   return nearest;
+}
+
+#ifdef RT_SIMD_X86
+
+// SSE2: 4 primitives per step. Lanes past the leaf are masked off; the padding of soa_array keeps
+// their loads in bounds.
+
+// a & b when mask, else c
+__attribute__((target("sse2"))) inline __m128 select_sse(__m128 mask, __m128 a, __m128 b)
+{
+   return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// the index of the nearest hit among the lanes of t that hits marks, or -1; lowers t_max
+__attribute__((target("sse2"))) inline int nearest_lane_sse(__m128 hits, __m128 t, int first, float& t_max)
+{
+   int mask = _mm_movemask_ps(hits);
+   if (mask == 0) return -1;
+   t = select_sse(hits, t, _mm_set1_ps(infinity));
+   __m128 m = _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+   m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+   mask &= _mm_movemask_ps(_mm_cmpeq_ps(t, m));
+   t_max = _mm_cvtss_f32(m);
+   return first + 31 - __builtin_clz(mask);
+}
+
+__attribute__((target("sse2")))
+int nearest_sphere_sse(const soa_array& s, int first, int count, const kernel_ray& r, float t_min, float& t_max)
+{
+   const __m128 ox = _mm_set1_ps(r.orig.x), oy = _mm_set1_ps(r.orig.y), oz = _mm_set1_ps(r.orig.z);
+   const __m128 dx = _mm_set1_ps(r.unit_dir.x), dy = _mm_set1_ps(r.unit_dir.y), dz = _mm_set1_ps(r.unit_dir.z);
+   const __m128 inv_len = _mm_set1_ps(r.inv_len), t_minv = _mm_set1_ps(t_min);
+   const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+   int nearest = -1;
+   for (int i = first; i < first + count; i += 4)
+   {
+      __m128 active = _mm_cmplt_ps(lane, _mm_set1_ps(float(first + count - i)));
+      __m128 elx = _mm_sub_ps(_mm_loadu_ps(s[sphere_cx] + i), ox);
+      __m128 ely = _mm_sub_ps(_mm_loadu_ps(s[sphere_cy] + i), oy);
+      __m128 elz = _mm_sub_ps(_mm_loadu_ps(s[sphere_cz] + i), oz);
+      __m128 r2 = _mm_loadu_ps(s[sphere_r2] + i);
+      __m128 sv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(elx, dx), _mm_mul_ps(ely, dy)), _mm_mul_ps(elz, dz));
+      __m128 el2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(elx, elx), _mm_mul_ps(ely, ely)), _mm_mul_ps(elz, elz));
+      __m128 m2 = _mm_sub_ps(el2, _mm_mul_ps(sv, sv));
+      __m128 close = _mm_and_ps(active, _mm_cmple_ps(m2, r2));
+      // most steps miss every sphere, and skip the square root
+      if (_mm_movemask_ps(close) == 0) continue;
+
+      __m128 q = _mm_sqrt_ps(_mm_sub_ps(r2, m2));
+      __m128 t_maxv = _mm_set1_ps(t_max);
+      __m128 t0 = _mm_mul_ps(_mm_sub_ps(sv, q), inv_len);
+      __m128 t1 = _mm_mul_ps(_mm_add_ps(sv, q), inv_len);
+      __m128 in0 = _mm_and_ps(_mm_cmpge_ps(t0, t_minv), _mm_cmple_ps(t0, t_maxv));
+      __m128 in1 = _mm_and_ps(_mm_cmpge_ps(t1, t_minv), _mm_cmple_ps(t1, t_maxv));
+      __m128 hits = _mm_and_ps(close, _mm_or_ps(in0, in1));
+
+      int lane_hit = nearest_lane_sse(hits, select_sse(in0, t0, t1), i, t_max);
+      if (lane_hit >= 0) nearest = lane_hit;
+   }
+   return nearest;
+}
+
+__attribute__((target("sse2")))
+int nearest_triangle_sse(const soa_array& tris, int first, int count, const kernel_ray& r, float t_min,
+   float& t_max)
+{
+   const __m128 ox = _mm_set1_ps(r.orig.x), oy = _mm_set1_ps(r.orig.y), oz = _mm_set1_ps(r.orig.z);
+   const __m128 dx = _mm_set1_ps(r.dir.x), dy = _mm_set1_ps(r.dir.y), dz = _mm_set1_ps(r.dir.z);
+   const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), t_minv = _mm_set1_ps(t_min);
+   const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+
+   int nearest = -1;
+   for (int i = first; i < first + count; i += 4)
+   {
+      __m128 active = _mm_cmplt_ps(lane, _mm_set1_ps(float(first + count - i)));
+      __m128 e1x = _mm_loadu_ps(tris[triangle_e1x] + i);
+      __m128 e1y = _mm_loadu_ps(tris[triangle_e1y] + i);
+      __m128 e1z = _mm_loadu_ps(tris[triangle_e1z] + i);
+      __m128 e2x = _mm_loadu_ps(tris[triangle_e2x] + i);
+      __m128 e2y = _mm_loadu_ps(tris[triangle_e2y] + i);
+      __m128 e2z = _mm_loadu_ps(tris[triangle_e2z] + i);
+
+      // pvec = cross(dir, e2), qvec = cross(tvec, e1)
+      __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+      __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+      __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+      __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+      __m128 inv_det = _mm_div_ps(one, det);
+
+      __m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(tris[triangle_v0x] + i));
+      __m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(tris[triangle_v0y] + i));
+      __m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(tris[triangle_v0z] + i));
+      __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+      __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(e1y, tz));
+      __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(e1z, tx));
+      __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(e1x, ty));
+      __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+      __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+      __m128 hits = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+         _mm_cmple_ps(_mm_add_ps(u, v), one));
+      hits = _mm_and_ps(hits, _mm_and_ps(_mm_cmpge_ps(t, t_minv), _mm_cmple_ps(t, _mm_set1_ps(t_max))));
+      hits = _mm_and_ps(hits, active);
+
+      int lane_hit = nearest_lane_sse(hits, t, i, t_max);
+      if (lane_hit >= 0) nearest = lane_hit;
+   }
+   return nearest;
+}
+
+// AVX2: the same with 8 primitives per step
+
+__attribute__((target("avx2"))) inline int nearest_lane_avx2(__m256 hits, __m256 t, int first, float& t_max)
+{
+   int mask = _mm256_movemask_ps(hits);
+   if (mask == 0) return -1;
+   t = _mm256_blendv_ps(_mm256_set1_ps(infinity), t, hits);
+   __m256 m = _mm256_min_ps(t, _mm256_permute2f128_ps(t, t, 1));
+   m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+   m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+   mask &= _mm256_movemask_ps(_mm256_cmp_ps(t, m, _CMP_EQ_OQ));
+   t_max = _mm256_cvtss_f32(m);
+   return first + 31 - __builtin_clz(mask);
+}
+
+__attribute__((target("avx2")))
+int nearest_sphere_avx2(const soa_array& s, int first, int count, const kernel_ray& r, float t_min, float& t_max)
+{
+   const __m256 ox = _mm256_set1_ps(r.orig.x), oy = _mm256_set1_ps(r.orig.y), oz = _mm256_set1_ps(r.orig.z);
+   const __m256 dx = _mm256_set1_ps(r.unit_dir.x), dy = _mm256_set1_ps(r.unit_dir.y), dz = _mm256_set1_ps(r.unit_dir.z);
+   const __m256 inv_len = _mm256_set1_ps(r.inv_len), t_minv = _mm256_set1_ps(t_min);
+   const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+   int nearest = -1;
+   for (int i = first; i < first + count; i += 8)
+   {
+      __m256 active = _mm256_cmp_ps(lane, _mm256_set1_ps(float(first + count - i)), _CMP_LT_OQ);
+      __m256 elx = _mm256_sub_ps(_mm256_loadu_ps(s[sphere_cx] + i), ox);
+      __m256 ely = _mm256_sub_ps(_mm256_loadu_ps(s[sphere_cy] + i), oy);
+      __m256 elz = _mm256_sub_ps(_mm256_loadu_ps(s[sphere_cz] + i), oz);
+      __m256 r2 = _mm256_loadu_ps(s[sphere_r2] + i);
+      __m256 sv = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(elx, dx), _mm256_mul_ps(ely, dy)), _mm256_mul_ps(elz, dz));
+      __m256 el2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(elx, elx), _mm256_mul_ps(ely, ely)), _mm256_mul_ps(elz, elz));
+      __m256 m2 = _mm256_sub_ps(el2, _mm256_mul_ps(sv, sv));
+      __m256 close = _mm256_and_ps(active, _mm256_cmp_ps(m2, r2, _CMP_LE_OQ));
+      if (_mm256_movemask_ps(close) == 0) continue;
+
+      __m256 q = _mm256_sqrt_ps(_mm256_sub_ps(r2, m2));
+      __m256 t_maxv = _mm256_set1_ps(t_max);
+      __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(sv, q), inv_len);
+      __m256 t1 = _mm256_mul_ps(_mm256_add_ps(sv, q), inv_len);
+      __m256 in0 = _mm256_and_ps(_mm256_cmp_ps(t0, t_minv, _CMP_GE_OQ), _mm256_cmp_ps(t0, t_maxv, _CMP_LE_OQ));
+      __m256 in1 = _mm256_and_ps(_mm256_cmp_ps(t1, t_minv, _CMP_GE_OQ), _mm256_cmp_ps(t1, t_maxv, _CMP_LE_OQ));
+      __m256 hits = _mm256_and_ps(close, _mm256_or_ps(in0, in1));
+
+      int lane_hit = nearest_lane_avx2(hits, _mm256_blendv_ps(t1, t0, in0), i, t_max);
+      if (lane_hit >= 0) nearest = lane_hit;
+   }
+   return nearest;
+}
+
+__attribute__((target("avx2")))
+int nearest_triangle_avx2(const soa_array& tris, int first, int count, const kernel_ray& r, float t_min,
+   float& t_max)
+{
+   const __m256 ox = _mm256_set1_ps(r.orig.x), oy = _mm256_set1_ps(r.orig.y), oz = _mm256_set1_ps(r.orig.z);
+   const __m256 dx = _mm256_set1_ps(r.dir.x), dy = _mm256_set1_ps(r.dir.y), dz = _mm256_set1_ps(r.dir.z);
+   const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), t_minv = _mm256_set1_ps(t_min);
+   const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+   int nearest = -1;
+   for (int i = first; i < first + count; i += 8)
+   {
+      __m256 active = _mm256_cmp_ps(lane, _mm256_set1_ps(float(first + count - i)), _CMP_LT_OQ);
+      __m256 e1x = _mm256_loadu_ps(tris[triangle_e1x] + i);
+      __m256 e1y = _mm256_loadu_ps(tris[triangle_e1y] + i);
+      __m256 e1z = _mm256_loadu_ps(tris[triangle_e1z] + i);
+      __m256 e2x = _mm256_loadu_ps(tris[triangle_e2x] + i);
+      __m256 e2y = _mm256_loadu_ps(tris[triangle_e2y] + i);
+      __m256 e2z = _mm256_loadu_ps(tris[triangle_e2z] + i);
+
+      // pvec = cross(dir, e2), qvec = cross(tvec, e1)
+      __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+      __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+      __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+      __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+      __m256 inv_det = _mm256_div_ps(one, det);
+
+      __m256 tx = _mm256_sub_ps(ox, _mm256_loadu_ps(tris[triangle_v0x] + i));
+      __m256 ty = _mm256_sub_ps(oy, _mm256_loadu_ps(tris[triangle_v0y] + i));
+      __m256 tz = _mm256_sub_ps(oz, _mm256_loadu_ps(tris[triangle_v0z] + i));
+      __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)),
+         _mm256_mul_ps(tz, pz)), inv_det);
+
+      __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(e1y, tz));
+      __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(e1z, tx));
+      __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(e1x, ty));
+      __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)),
+         _mm256_mul_ps(dz, qz)), inv_det);
+      __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)),
+         _mm256_mul_ps(e2z, qz)), inv_det);
+
+      __m256 hits = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, zero, _CMP_GE_OQ)),
+         _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+      hits = _mm256_and_ps(hits, _mm256_and_ps(_mm256_cmp_ps(t, t_minv, _CMP_GE_OQ),
+         _mm256_cmp_ps(t, _mm256_set1_ps(t_max), _CMP_LE_OQ)));
+      hits = _mm256_and_ps(hits, active);
+
+      int lane_hit = nearest_lane_avx2(hits, t, i, t_max);
+      if (lane_hit >= 0) nearest = lane_hit;
+   }
+   return nearest;
+}
+
+#endif
+
+const simd_kernels& kernels(simd_level level)
+{
+   static const simd_kernels scalar = { "scalar", 1, nearest_sphere_scalar, nearest_triangle_scalar };
+#ifdef RT_SIMD_X86
+   static const simd_kernels sse = { "sse2", 4, nearest_sphere_sse, nearest_triangle_sse };
+   static const simd_kernels avx2 = { "avx2", 8, nearest_sphere_avx2, nearest_triangle_avx2 };
+   if (level == simd_avx2) return avx2;
+   if (level == simd_sse) return sse;
+#endif
+   return scalar;
+}
+
+#endif
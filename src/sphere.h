@@ -7,21 +7,35 @@
 
 class sphere : public hittable {
 public:
-   sphere() : radius(1), center(0), mat_ptr(0) {}
-   sphere(const glm::point3& cen, float r, std::shared_ptr<material> m) : 
-      center(cen), radius(r), mat_ptr(m) {
+   sphere() : radius(1), center(0), mat_id(-1) {}
+   sphere(const glm::point3& cen, float r, material_id m) : 
+      center(cen), radius(r), mat_id(m) {
          assert(radius > 0 && "The radius of a sphere cannot be 0!");
       };
 
-   virtual bool hit(const ray& r, hit_record& rec) const override;
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override;
+   virtual void complete_hit(const ray& r, hit_record& rec) const override;
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override;
+
+   // lights: directions are picked uniformly in the cone of the sphere seen from outside
+   virtual material_id light_material() const override { return mat_id; }
+   virtual bool sample_surface(const glm::point3& origin, float u1, float u2, hit_record& rec, float& pdf) const override;
+   virtual float surface_pdf(const glm::point3& origin, const hit_record& rec) const override;
+
+   virtual bool bounding_box(aabb& output_box) const override {
+      output_box = aabb(center - glm::vec3(radius), center + glm::vec3(radius));
+      return true;
+   }
 
 public:
    glm::point3 center;
    float radius;
-   std::shared_ptr<material> mat_ptr;
+   material_id mat_id;
 };
 
-bool sphere::hit(const ray& r, hit_record& rec) const {
+bool sphere::intersect(const ray& r, float t_min, float t_max, hit_record& rec) const {
+   RT_COUNT(tests);
+
    /* Analytic method
    glm::vec3 oc = r.origin() - center;
    float a = glm::dot(r.direction(), r.direction());
@@ -33,18 +47,10 @@ bool sphere::hit(const ray& r, hit_record& rec) const {
    float sqrtd = sqrt(discriminant);
 
    float t = (-half_b - sqrtd) / a;
-   if (t < 0) t = (-half_b + sqrtd) / a;
-   if (t < 0) return false;
-
-   // save relevant data in hit record
-   rec.t = t; // save the time when we hit the object
-   rec.p = r.at(t); // ray.origin + t * ray.direction
-   rec.mat_ptr = mat_ptr; 
-
-   // save normal
-   glm::vec3 outward_normal = normalize(rec.p - center); // compute unit length normal
-   rec.set_face_normal(r, outward_normal);
+   if (t < t_min || t > t_max) t = (-half_b + sqrtd) / a;
+   if (t < t_min || t > t_max) return false;
 
+   rec.t = t;
    return true;
    */
 
@@ -56,33 +62,92 @@ bool sphere::hit(const ray& r, hit_record& rec) const {
    float s = glm::dot(el, d);
    float elSqr = glm::dot(el, el);
    float rSqr = radius * radius;
-   if (s < 0 && elSqr > rSqr) return false;
 
    float mSqr = elSqr - s * s;
    if (mSqr > rSqr) return false;
 
+   // take the nearer root unless it is outside [t_min, t_max]; from inside the sphere, the
+   // nearer root is behind the origin
    float q = sqrt(rSqr - mSqr);
-   float t;
-   if (elSqr > rSqr)
+   float t = (s - q)/len;
+   if (t < t_min || t > t_max)
    {
-      t = s - q;
+      t = (s + q)/len;
+      if (t < t_min || t > t_max) return false;
    }
-   else{
-      t = s + q;
-   }
-   t = t/len;
 
+   // save the time when we hit the object; complete_hit() fills the rest
+   rec.t = t;
+   return true;
+}
+
+void sphere::complete_hit(const ray& r, hit_record& rec) const {
    // save relevant data in hit record
-   rec.t = t; // save the time when we hit the object
-   rec.p = r.at(t); // ray.origin + t * ray.direction
-   rec.mat_ptr = mat_ptr; 
+   rec.p = r.at(rec.t); // ray.origin + t * ray.direction
+   rec.mat_id = mat_id; 
 
    // save normal
    glm::vec3 outward_normal = normalize(rec.p - center); // compute unit length normal
    rec.set_face_normal(r, outward_normal);
+}
+
+bool sphere::occluded(const ray& r, float t_min, float t_max) const {
+   RT_COUNT(tests);
 
+   // analytic method: the ray is blocked if either root lies in [t_min, t_max]
+   glm::vec3 oc = r.origin() - center;
+   float a = glm::dot(r.direction(), r.direction());
+   float half_b = glm::dot(oc, r.direction());
+   float c = glm::length2(oc) - radius*radius;
+
+   float discriminant = half_b*half_b - a*c;
+   if (discriminant < 0) return false;
+   float sqrtd = sqrt(discriminant);
+
+   float t1 = (-half_b - sqrtd) / a;
+   float t2 = (-half_b + sqrtd) / a;
+   return (t1 >= t_min && t1 <= t_max) || (t2 >= t_min && t2 <= t_max);
+}
+
+// 1 - cos of the half angle of the cone the sphere fills seen from origin; 0 from inside
+inline float cone_spread(const glm::point3& origin, const glm::point3& center, float radius)
+{
+   float sin2_max = radius * radius / glm::length2(center - origin);
+   if (sin2_max >= 1.0f) return 0;
+   // 1 - sqrt(1 - s) without the cancellation for small cones
+   return sin2_max / (1.0f + sqrt(1.0f - sin2_max));
+}
+
+bool sphere::sample_surface(const glm::point3& origin, float u1, float u2, hit_record& rec, float& pdf) const {
+   // inside the sphere, every direction hits it and the cone is of no use
+   float spread = cone_spread(origin, center, radius);
+   if (spread <= 0) return false;
+
+   // a direction in the cone around the center
+   glm::vec3 to_center = center - origin;
+   glm::vec3 w = glm::normalize(to_center);
+   glm::vec3 u, v;
+   orthonormal_basis(w, u, v);
+   float cos_theta = 1.0f - u1 * spread;
+   float sin_theta = sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+   float phi = 2.0f * pi * u2;
+   glm::vec3 direction = sin_theta * (std::cos(phi) * u + std::sin(phi) * v) + cos_theta * w;
+
+   // its nearer hit; at the rim of the cone the discriminant may round below 0
+   float b = glm::dot(to_center, direction);
+   float c = glm::length2(to_center) - radius * radius;
+   rec.t = b - sqrt(std::max(0.0f, b * b - c));
+   rec.p = origin + rec.t * direction;
+   rec.mat_id = mat_id;
+   rec.set_face_normal(ray(origin, direction), normalize(rec.p - center));
+   pdf = 1.0f / (2.0f * pi * spread);
    return true;
 }
 
+float sphere::surface_pdf(const glm::point3& origin, const hit_record& rec) const {
+   float spread = cone_spread(origin, center, radius);
+   return spread > 0 ? 1.0f / (2.0f * pi * spread) : 0.0f;
+}
+
 #endif
 
@@ -0,0 +1,143 @@
+// sphere_set.h, many spheres in one object with their own bvh, e.g. an asteroid field
+// A sphere object costs a virtual call, a pointer and a node of the world bvh; here the centers
+// and squared radii are stored component by component in bvh leaf order, and the kernels of
+// simd.h test a whole leaf of spheres at once. The spheres are not lights (see sphere for those).
+
+#ifndef SPHERE_SET_H_
+#define SPHERE_SET_H_
+
+#include "hittable.h"
+#include "AGLM.h"
+#include "bvh.h"
+#include "simd.h"
+#include <vector>
+
+class sphere_set : public hittable {
+public:
+   sphere_set() {}
+
+   // add a sphere and return its index; build() changes the indices
+   int add(const glm::point3& center, float radius, material_id m) {
+      assert(radius > 0 && "The radius of a sphere cannot be 0!");
+      centers.push_back(center);
+      radii.push_back(radius);
+      materials.push_back(m);
+      return (int) centers.size() - 1;
+   }
+
+   int size() const { return (int) centers.size(); }
+
+   // sort the spheres in bvh leaf order and build the bvh over them. Call once all spheres are
+   // added.
+   void build();
+
+   // bytes used by the spheres and the bvh
+   size_t memory_bytes() const {
+      return centers.capacity() * sizeof(glm::point3) + radii.capacity() * sizeof(float) +
+         materials.capacity() * sizeof(material_id) + spheres.data.capacity() * sizeof(float) +
+         accel.nodes.capacity() * sizeof(bvh_node);
+   }
+
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override;
+   virtual void complete_hit(const ray& r, hit_record& rec) const override;
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override;
+
+   virtual bool bounding_box(aabb& output_box) const override {
+      if (accel.empty()) return false;
+      output_box = accel.bounds();
+      return true;
+   }
+
+public:
+   std::vector<glm::point3> centers; // build() sorts all three in bvh leaf order
+   std::vector<float> radii;
+   std::vector<material_id> materials;
+
+private:
+   soa_array spheres; // the center and squared radius of each sphere, in leaf order
+   bvh accel;
+};
+
+void sphere_set::build()
+{
+   int n = size();
+   std::vector<aabb> boxes(n);
+   for (int i = 0; i < n; i++)
+   {
+      boxes[i] = aabb(centers[i] - glm::vec3(radii[i]), centers[i] + glm::vec3(radii[i]));
+   }
+   int width = active_kernels().width;
+   accel.build(boxes, std::max(4, width), width);
+
+   std::vector<glm::point3> sorted_centers(n);
+   std::vector<float> sorted_radii(n);
+   std::vector<material_id> sorted_materials(n);
+   spheres.resize(n, sphere_components);
+   for (int i = 0; i < n; i++)
+   {
+      int k = accel.indices[i];
+      sorted_centers[i] = centers[k];
+      sorted_radii[i] = radii[k];
+      sorted_materials[i] = materials[k];
+      spheres[sphere_cx][i] = centers[k].x;
+      spheres[sphere_cy][i] = centers[k].y;
+      spheres[sphere_cz][i] = centers[k].z;
+      spheres[sphere_r2][i] = radii[k] * radii[k];
+   }
+   centers.swap(sorted_centers);
+   radii.swap(sorted_radii);
+   materials.swap(sorted_materials);
+   accel.indices.clear();
+   accel.indices.shrink_to_fit();
+}
+
+bool sphere_set::intersect(const ray& r, float t_min, float t_max, hit_record& rec) const
+{
+   leaf_kernel nearest_sphere = active_kernels().nearest_sphere;
+   kernel_ray kr(r);
+   int closest = -1;
+   float t = infinity;
+
+   auto leaf = [&](int offset, int count, float leaf_min_t, float& leaf_max_t) -> bool
+   {
+      RT_ADD(tests, count);
+      int i = nearest_sphere(spheres, offset, count, kr, leaf_min_t, leaf_max_t);
+      if (i < 0) return false;
+      closest = i;
+      t = leaf_max_t;
+      return true;
+   };
+
+   if (!accel.traverse(r, t_min, t_max, leaf))
+   {
+      return false;
+   }
+
+   // save the time and the sphere; complete_hit() fills the rest
+   rec.t = t;
+   rec.part = closest;
+   return true;
+}
+
+void sphere_set::complete_hit(const ray& r, hit_record& rec) const
+{
+   rec.p = r.at(rec.t);
+   rec.mat_id = materials[rec.part];
+   rec.set_face_normal(r, normalize(rec.p - centers[rec.part]));
+}
+
+bool sphere_set::occluded(const ray& r, float t_min, float t_max) const
+{
+   leaf_kernel nearest_sphere = active_kernels().nearest_sphere;
+   kernel_ray kr(r);
+
+   auto leaf = [&](int offset, int count, float leaf_min_t, float leaf_max_t) -> bool
+   {
+      RT_ADD(tests, count);
+      return nearest_sphere(spheres, offset, count, kr, leaf_min_t, leaf_max_t) >= 0;
+   };
+
+   return accel.occluded(r, t_min, t_max, leaf);
+}
+
+#endif
@@ -0,0 +1,165 @@
+// thread_pool.h, a fixed-size pool of worker threads that balance their work by stealing
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class thread_pool {
+public:
+   // num_threads <= 0 uses one thread per hardware thread
+   explicit thread_pool(int num_threads = 0);
+   ~thread_pool();
+
+   int size() const { return (int) workers.size(); }
+
+   // run body(k) for every k in [0, count) and wait until all of them finished.
+   // Each worker starts with a contiguous block of items, which it runs front to back.
+   // A worker that runs out steals from the back of another worker's block, so expensive
+   // regions get shared out instead of stalling the one worker that owns them.
+   void parallel_for(int count, const std::function<void(int)>& body);
+
+   static int default_size() {
+      unsigned n = std::thread::hardware_concurrency();
+      return n == 0 ? 1 : (int) n;
+   }
+
+private:
+   struct work_queue {
+      std::mutex lock;
+      std::deque<int> items;
+   };
+
+   void worker_loop(int id);
+   bool pop(int id, int& item);
+   bool steal(int id, int& item);
+
+   std::vector<std::thread> workers;
+   std::vector<std::unique_ptr<work_queue>> queues;
+
+   std::mutex lock; // guards the fields below
+   std::condition_variable wake;
+   std::condition_variable done;
+   const std::function<void(int)>* job;
+   unsigned long generation;
+   int busy; // workers that have not yet run out of items for the current job
+   bool stopping;
+};
+
+thread_pool::thread_pool(int num_threads) : job(0), generation(0), busy(0), stopping(false)
+{
+   if (num_threads <= 0) num_threads = default_size();
+
+   for (int i = 0; i < num_threads; i++)
+   {
+      queues.push_back(std::unique_ptr<work_queue>(new work_queue()));
+   }
+   for (int i = 0; i < num_threads; i++)
+   {
+      workers.push_back(std::thread(&thread_pool::worker_loop, this, i));
+   }
+}
+
+thread_pool::~thread_pool()
+{
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+   }
+   wake.notify_all();
+   for (std::thread& worker : workers)
+   {
+      worker.join();
+   }
+}
+
+void thread_pool::parallel_for(int count, const std::function<void(int)>& body)
+{
+   if (count <= 0) return;
+
+   // deal out contiguous blocks, so that neighbouring items start on the same worker
+   int n = size();
+   for (int i = 0; i < n; i++)
+   {
+      int begin = (int) ((long long) count * i / n);
+      int end = (int) ((long long) count * (i + 1) / n);
+      std::lock_guard<std::mutex> guard(queues[i]->lock);
+      for (int k = begin; k < end; k++)
+      {
+         queues[i]->items.push_back(k);
+      }
+   }
+
+   std::unique_lock<std::mutex> guard(lock);
+   job = &body;
+   busy = n;
+   generation++;
+   wake.notify_all();
+   done.wait(guard, [this] { return busy == 0; });
+   job = 0;
+}
+
+bool thread_pool::pop(int id, int& item)
+{
+   work_queue& queue = *queues[id];
+   std::lock_guard<std::mutex> guard(queue.lock);
+   if (queue.items.empty()) return false;
+   item = queue.items.front();
+   queue.items.pop_front();
+   return true;
+}
+
+bool thread_pool::steal(int id, int& item)
+{
+   int n = size();
+   for (int k = 1; k < n; k++)
+   {
+      work_queue& victim = *queues[(id + k) % n];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (!victim.items.empty())
+      {
+         item = victim.items.back();
+         victim.items.pop_back();
+         return true;
+      }
+   }
+   return false;
+}
+
+void thread_pool::worker_loop(int id)
+{
+   unsigned long seen = 0;
+   while (true)
+   {
+      const std::function<void(int)>* body;
+      {
+         std::unique_lock<std::mutex> guard(lock);
+         wake.wait(guard, [&] { return stopping || generation != seen; });
+         if (stopping) return;
+         seen = generation;
+         body = job;
+      }
+
+      // items are only added while every worker is idle, so once all queues
+      // are empty this worker is finished with the current job
+      int item;
+      while (pop(id, item) || steal(id, item))
+      {
+         (*body)(item);
+      }
+
+      std::lock_guard<std::mutex> guard(lock);
+      if (--busy == 0)
+      {
+         done.notify_all();
+      }
+   }
+}
+
+#endif
@@ -0,0 +1,30 @@
+// tile.h, the rectangles of pixels that renders are split into
+
+#ifndef TILE_H_
+#define TILE_H_
+
+#include <algorithm>
+#include <vector>
+
+// a rectangle of pixels: columns [x0, x1) and rows [y0, y1)
+struct tile {
+   int x0, y0;
+   int x1, y1;
+};
+
+// split a width x height image into tiles of tile_size x tile_size pixels, in scanline order
+std::vector<tile> make_tiles(int width, int height, int tile_size)
+{
+   std::vector<tile> tiles;
+   for (int y = 0; y < height; y += tile_size)
+   {
+      for (int x = 0; x < width; x += tile_size)
+      {
+         tile t = { x, y, std::min(x + tile_size, width), std::min(y + tile_size, height) };
+         tiles.push_back(t);
+      }
+   }
+   return tiles;
+}
+
+#endif
@@ -5,26 +5,27 @@
 #include "hittable.h"
 #include "AGLM.h"
 #include "line.h"
+#include "plane.h"
 
 class triangle : public hittable {
 public:
-   triangle() : a(glm::point3(1,0,0)), b(glm::point3(0,1,0)), c(glm::point3(0,0,1)), mat_ptr(0) {}
+   triangle() : a(glm::point3(1,0,0)), b(glm::point3(0,1,0)), c(glm::point3(0,0,1)), mat_id(-1) {}
    triangle(const glm::point3& v0, const glm::point3& v1, const glm::point3& v2, 
-      std::shared_ptr<material> m) : a(v0), b(v1), c(v2), mat_ptr(m) {
+      material_id m) : a(v0), b(v1), c(v2), mat_id(m) {
          assert(!near_zero(glm::cross(b - a, c - a)) && "The three vertices of a triangle cannot be  colinear!");
       };
 
-   virtual bool hit(const ray& r, hit_record& rec) const override
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override
    {
       // find the supporting plane of the triangle
       glm::vec3 ab = b - a;
       glm::vec3 ac = c - a;
       glm::vec3 bc = c - b;
       glm::vec3 n = glm::normalize(glm::cross(ab, ac));
-      plane p (a, n, mat_ptr);
+      plane p (a, n, mat_id);
 
       // check if the ray hits the supporting plane. If so, save the relevant data to hit_record. Otherwise, return false
-      if (!p.hit(r, rec))
+      if (!p.intersect(r, 0, infinity, rec))
       {
          return false;
       }
@@ -45,19 +46,19 @@ public:
          }
          else{
             // if the origin is not inside the triangle, check if it hits an edge of the triangle
-            line l1(a, b, 0);
-            line l2(b, c, 0);
-            line l3(a, c ,0);
+            line l1(a, b, -1);
+            line l2(b, c, -1);
+            line l3(a, c ,-1);
 
-            if (l1.hit(r, rec))
+            if (l1.intersect(r, 0, infinity, rec))
             {
                t = rec.t;
             }
-            if (l2.hit(r, rec) && (rec.t < t || t == 0))
+            if (l2.intersect(r, 0, infinity, rec) && (rec.t < t || t == 0))
             {
                t = rec.t;
             }
-            if (l3.hit(r, rec) && (rec.t < t || t == 0))
+            if (l3.intersect(r, 0, infinity, rec) && (rec.t < t || t == 0))
             {
                t = rec.t;
             }
@@ -70,6 +71,12 @@ public:
          }
       }
       else{
+         // the supporting plane is hit outside the interval
+         if (rec.t < t_min || rec.t > t_max)
+         {
+            return false;
+         }
+
          // let q be the intersection of r and p
          glm::vec3 q = r.origin() + r.direction() * rec.t;
 
@@ -88,20 +95,14 @@ public:
          }
       }
 
-      // save relevant data in hit record
-      rec.t = t; // save the time when we hit the object
-      rec.p = r.at(t); // ray.origin + t * ray.direction
-      rec.mat_ptr = mat_ptr; 
-
-      // save normal
-      // make sure the normal follows right hand rule, i.e. it always points left or outside the screen
-      if (n[0] > 0 || n[1] < 0 || n[2] < 0)
+      // the triangle is hit outside the interval
+      if (t < t_min || t > t_max)
       {
-         n = -n;
+         return false;
       }
-      glm::vec3 outward_normal = normalize(n); // compute unit length normal
-      rec.set_face_normal(r, outward_normal);
 
+      // save the time when we hit the object; complete_hit() fills the rest
+      rec.t = t;
       return true;
 
 /*
@@ -156,7 +157,7 @@ public:
       // save relevant data in hit record
       rec.t = t; // save the time when we hit the object
       rec.p = r.at(t); // ray.origin + t * ray.direction
-      rec.mat_ptr = mat_ptr; 
+      rec.mat_id = mat_id; 
 
       glm::vec3 ab = b - a;
       glm::vec3 ac = c - a;
@@ -175,11 +176,52 @@ public:
 */
    }
 
+   virtual void complete_hit(const ray& r, hit_record& rec) const override
+   {
+      // save relevant data in hit record
+      rec.p = r.at(rec.t); // ray.origin + t * ray.direction
+      rec.mat_id = mat_id; 
+
+      // save normal
+      glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
+      // make sure the normal follows right hand rule, i.e. it always points left or outside the screen
+      if (n[0] > 0 || n[1] < 0 || n[2] < 0)
+      {
+         n = -n;
+      }
+      glm::vec3 outward_normal = normalize(n); // compute unit length normal
+      rec.set_face_normal(r, outward_normal);
+   }
+
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override
+   {
+      RT_COUNT(tests);
+
+      // Moller-Trumbore; a ray parallel with the triangle gives non-finite u, v and fails the tests
+      glm::vec3 e1 = b - a;
+      glm::vec3 e2 = c - a;
+      glm::vec3 pvec = glm::cross(r.direction(), e2);
+      float inv_det = 1.0f / glm::dot(e1, pvec);
+      glm::vec3 tvec = r.origin() - a;
+      float u = glm::dot(tvec, pvec) * inv_det;
+      glm::vec3 qvec = glm::cross(tvec, e1);
+      float v = glm::dot(r.direction(), qvec) * inv_det;
+      float t = glm::dot(e2, qvec) * inv_det;
+      return u >= 0 && v >= 0 && u + v <= 1 && t >= t_min && t <= t_max;
+   }
+
+   virtual bool bounding_box(aabb& output_box) const override
+   {
+      output_box = aabb(glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)));
+      output_box.pad();
+      return true;
+   }
+
 public:
    glm::point3 a;
    glm::point3 b;
    glm::point3 c;
-   std::shared_ptr<material> mat_ptr;
+   material_id mat_id;
 };
 
 #endif
@@ -0,0 +1,176 @@
+// triangle_mesh.h, many triangles sharing one vertex buffer, one material and one bvh
+// Unlike triangle, which rebuilds its supporting plane on every hit, the edges and normal of each
+// triangle are computed once by build() and rays are tested with the Moller-Trumbore algorithm
+// (Moller, Trumbore, "Fast, Minimum Storage Ray/Triangle Intersection", 1997). The edges are
+// stored component by component, so that the kernels of simd.h test a whole leaf at once.
+
+#ifndef TRIANGLE_MESH_H_
+#define TRIANGLE_MESH_H_
+
+#include "hittable.h"
+#include "AGLM.h"
+#include "bvh.h"
+#include "simd.h"
+#include <vector>
+
+class triangle_mesh : public hittable {
+public:
+   triangle_mesh() : mat_id(-1) {}
+   triangle_mesh(material_id m) : mat_id(m) {}
+   triangle_mesh(const std::vector<glm::point3>& verts, const std::vector<int>& idx,
+      material_id m) : vertices(verts), indices(idx), mat_id(m) {
+         build();
+      }
+
+   // add a vertex and return its index
+   int add_vertex(const glm::point3& p) {
+      vertices.push_back(p);
+      return (int) vertices.size() - 1;
+   }
+
+   // add the triangle (v0, v1, v2); its outward normal follows the right-hand rule
+   void add_triangle(int i0, int i1, int i2) {
+      indices.push_back(i0);
+      indices.push_back(i1);
+      indices.push_back(i2);
+   }
+
+   void add_triangle(const glm::point3& a, const glm::point3& b, const glm::point3& c) {
+      int i0 = add_vertex(a);
+      int i1 = add_vertex(b);
+      int i2 = add_vertex(c);
+      add_triangle(i0, i1, i2);
+   }
+
+   int num_triangles() const { return (int) indices.size() / 3; }
+
+   // precompute the edges and normal of every triangle and build the bvh over them.
+   // Call once all triangles are added (the constructor with arrays calls it).
+   void build();
+
+   // bytes used by the vertices, indices, precomputed triangles and bvh
+   size_t memory_bytes() const {
+      return vertices.capacity() * sizeof(glm::point3) + indices.capacity() * sizeof(int) +
+         tris.data.capacity() * sizeof(float) + normals.capacity() * sizeof(glm::vec3) +
+         accel.nodes.capacity() * sizeof(bvh_node);
+   }
+
+   virtual bool intersect(const ray& r, float t_min, float t_max, hit_record& rec) const override;
+   virtual void complete_hit(const ray& r, hit_record& rec) const override;
+   virtual bool occluded(const ray& r, float t_min, float t_max) const override;
+
+   virtual bool bounding_box(aabb& output_box) const override {
+      if (accel.empty()) return false;
+      output_box = accel.bounds();
+      return true;
+   }
+
+public:
+   std::vector<glm::point3> vertices;
+   std::vector<int> indices; // three vertex indices per triangle; build() sorts them in bvh leaf order
+   material_id mat_id;
+
+private:
+   soa_array tris; // v0, e1 = v1 - v0 and e2 = v2 - v0 of each triangle, in bvh leaf order
+   std::vector<glm::vec3> normals; // unit normal cross(e1, e2) of each triangle, in leaf order
+   bvh accel;
+
+   friend struct compiled_mesh; // saves and restores a built mesh (see scene_file.h)
+};
+
+void triangle_mesh::build()
+{
+   int n = num_triangles();
+   std::vector<aabb> boxes(n);
+   for (int i = 0; i < n; i++)
+   {
+      const glm::point3& a = vertices[indices[3 * i]];
+      const glm::point3& b = vertices[indices[3 * i + 1]];
+      const glm::point3& c = vertices[indices[3 * i + 2]];
+      boxes[i] = aabb(glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)));
+      boxes[i].pad();
+   }
+   // leaves as wide as the kernels (at least 4), which test a full leaf about as fast as one triangle
+   int width = active_kernels().width;
+   accel.build(boxes, std::max(4, width), width);
+
+   // store the triangles in leaf order, so that a leaf covers a contiguous range
+   std::vector<int> sorted(indices.size());
+   tris.resize(n, triangle_components);
+   normals.resize(n);
+   for (int i = 0; i < n; i++)
+   {
+      int k = accel.indices[i];
+      for (int corner = 0; corner < 3; corner++)
+      {
+         sorted[3 * i + corner] = indices[3 * k + corner];
+      }
+      const glm::point3& a = vertices[sorted[3 * i]];
+      glm::vec3 e1 = vertices[sorted[3 * i + 1]] - a;
+      glm::vec3 e2 = vertices[sorted[3 * i + 2]] - a;
+      for (int axis = 0; axis < 3; axis++)
+      {
+         tris[triangle_v0x + axis][i] = a[axis];
+         tris[triangle_e1x + axis][i] = e1[axis];
+         tris[triangle_e2x + axis][i] = e2[axis];
+      }
+      normals[i] = glm::normalize(glm::cross(e1, e2));
+   }
+   indices.swap(sorted);
+   accel.indices.clear();
+   accel.indices.shrink_to_fit();
+}
+
+bool triangle_mesh::intersect(const ray& r, float t_min, float t_max, hit_record& rec) const
+{
+   leaf_kernel nearest_triangle = active_kernels().nearest_triangle;
+   kernel_ray kr(r);
+   int closest = -1;
+   float t = infinity;
+
+   auto leaf = [&](int offset, int count, float leaf_min_t, float& leaf_max_t) -> bool
+   {
+      RT_ADD(tests, count);
+      int i = nearest_triangle(tris, offset, count, kr, leaf_min_t, leaf_max_t);
+      if (i < 0) return false;
+      closest = i;
+      t = leaf_max_t;
+      return true;
+   };
+
+   if (!accel.traverse(r, t_min, t_max, leaf))
+   {
+      return false;
+   }
+
+   // save the time and the triangle; complete_hit() fills the rest
+   rec.t = t;
+   rec.part = closest;
+   return true;
+}
+
+void triangle_mesh::complete_hit(const ray& r, hit_record& rec) const
+{
+   // save relevant data in hit record
+   rec.p = r.at(rec.t); // ray.origin + t * ray.direction
+   rec.mat_id = mat_id;
+
+   // save normal
+   rec.set_face_normal(r, normals[rec.part]);
+}
+
+bool triangle_mesh::occluded(const ray& r, float t_min, float t_max) const
+{
+   leaf_kernel nearest_triangle = active_kernels().nearest_triangle;
+   kernel_ray kr(r);
+
+   auto leaf = [&](int offset, int count, float leaf_min_t, float leaf_max_t) -> bool
+   {
+      RT_ADD(tests, count);
+      return nearest_triangle(tris, offset, count, kr, leaf_min_t, leaf_max_t) >= 0;
+   };
+
+   return accel.occluded(r, t_min, t_max, leaf);
+}
+
+#endif
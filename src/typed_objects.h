@@ -0,0 +1,199 @@
+// typed_objects.h, the objects of a scene stored by class, so that they are called without virtual calls
+// hittable_list keeps its objects as shared_ptr<hittable>, and every test of a ray against one is
+// a virtual call that the compiler cannot inline. A typed_objects<Ts...> keeps a copy of every
+// object whose class is one of Ts in a vector of that class (a tuple of vectors, one per class),
+// and calls it as that class, so that the intersection code of each class inlines: one object at
+// a time through a ref (e.g. the objects of a bvh leaf), or all of them in a loop per class (e.g.
+// the planes that every ray tests). Objects of other classes (meshes, instances, ...) are called
+// through hittable.
+
+#ifndef TYPED_OBJECTS_H_
+#define TYPED_OBJECTS_H_
+
+#include "hittable.h"
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+template <class... Ts>
+class typed_objects {
+public:
+   // an object of the scene: the position of its class in Ts (-1 for other classes), its index in
+   // the vector of that class, and the object itself
+   struct ref {
+      int kind;
+      int index;
+      const hittable* object;
+   };
+
+   void clear() {
+      lists = std::tuple<std::vector<Ts>...>();
+      for (auto& list : sources) list.clear();
+      others.clear();
+   }
+
+   // copy object into the vector of its class, if it is one of Ts (and not derived from one)
+   ref add(const hittable* object) { return add_as(object, at<0>()); }
+
+   // the calls of hittable, made on the copy by its class
+   bool intersect(const ref& o, const ray& r, float t_min, float t_max, hit_record& rec) const {
+      intersect_call call = { r, t_min, t_max, rec };
+      return apply(o, call, at<0>());
+   }
+
+   void complete_hit(const ref& o, const ray& r, hit_record& rec) const {
+      complete_hit_call call = { r, rec };
+      apply(o, call, at<0>());
+   }
+
+   bool occluded(const ref& o, const ray& r, float t_min, float t_max) const {
+      occluded_call call = { r, t_min, t_max };
+      return apply(o, call, at<0>());
+   }
+
+   // the nearest hit of all objects in [t_min, t_max], tested class by class, so objects at the
+   // same time are not taken in the order they were added. Lowers t_max to the hit, and sets rec as
+   // intersect() does and closest to the object hit.
+   bool intersect_all(const ray& r, float t_min, float& t_max, hit_record& rec, ref& closest) const {
+      hit_record temp_rec;
+      return intersect_all(r, t_min, t_max, temp_rec, rec, closest, at<0>());
+   }
+
+   // whether any object blocks the ray in [t_min, t_max]
+   bool occluded_any(const ray& r, float t_min, float t_max) const {
+      return occluded_any(r, t_min, t_max, at<0>());
+   }
+
+   // the number of copies of class K of Ts
+   template <int K>
+   int count() const { return (int) std::get<K>(lists).size(); }
+
+private:
+   template <int K>
+   using at = std::integral_constant<int, K>;
+
+   typedef at<sizeof...(Ts)> end;
+
+   // class K of Ts
+   template <int K>
+   using type = typename std::tuple_element<K, std::tuple<Ts...>>::type;
+
+   template <int K>
+   ref add_as(const hittable* object, at<K>) {
+      typedef type<K> T;
+      if (typeid(*object) != typeid(T)) return add_as(object, at<K + 1>());
+      std::vector<T>& list = std::get<K>(lists);
+      list.push_back(static_cast<const T&>(*object));
+      sources[K].push_back(object);
+      ref o = { K, (int) list.size() - 1, object };
+      return o;
+   }
+
+   ref add_as(const hittable* object, end) {
+      others.push_back(object);
+      ref o = { -1, (int) others.size() - 1, object };
+      return o;
+   }
+
+   template <int K>
+   bool intersect_all(const ray& r, float t_min, float& t_max, hit_record& temp_rec, hit_record& rec,
+      ref& closest, at<K>) const {
+      typedef type<K> T;
+      const std::vector<T>& list = std::get<K>(lists);
+      bool hit = false;
+      for (int i = 0; i < (int) list.size(); i++)
+      {
+         if (list[i].T::intersect(r, t_min, t_max, temp_rec))
+         {
+            hit = true;
+            t_max = temp_rec.t;
+            rec = temp_rec;
+            closest.kind = K;
+            closest.index = i;
+            closest.object = sources[K][i];
+         }
+      }
+      return intersect_all(r, t_min, t_max, temp_rec, rec, closest, at<K + 1>()) || hit;
+   }
+
+   bool intersect_all(const ray& r, float t_min, float& t_max, hit_record& temp_rec, hit_record& rec,
+      ref& closest, end) const {
+      bool hit = false;
+      for (int i = 0; i < (int) others.size(); i++)
+      {
+         if (others[i]->intersect(r, t_min, t_max, temp_rec))
+         {
+            hit = true;
+            t_max = temp_rec.t;
+            rec = temp_rec;
+            closest.kind = -1;
+            closest.index = i;
+            closest.object = others[i];
+         }
+      }
+      return hit;
+   }
+
+   template <int K>
+   bool occluded_any(const ray& r, float t_min, float t_max, at<K>) const {
+      typedef type<K> T;
+      for (const T& object : std::get<K>(lists))
+      {
+         if (object.T::occluded(r, t_min, t_max)) return true;
+      }
+      return occluded_any(r, t_min, t_max, at<K + 1>());
+   }
+
+   bool occluded_any(const ray& r, float t_min, float t_max, end) const {
+      for (const hittable* object : others)
+      {
+         if (object->occluded(r, t_min, t_max)) return true;
+      }
+      return false;
+   }
+
+   // call(the object of o, as its class)
+   template <class Call, int K>
+   bool apply(const ref& o, Call& call, at<K>) const {
+      if (o.kind == K) return call(std::get<K>(lists)[o.index]);
+      return apply(o, call, at<K + 1>());
+   }
+
+   template <class Call>
+   bool apply(const ref& o, Call& call, end) const { return call(*o.object); }
+
+   // the calls: a class of Ts is named, so that its function is called directly
+   struct intersect_call {
+      const ray& r;
+      float t_min;
+      float t_max;
+      hit_record& rec;
+      template <class T>
+      bool operator()(const T& object) const { return object.T::intersect(r, t_min, t_max, rec); }
+      bool operator()(const hittable& object) const { return object.intersect(r, t_min, t_max, rec); }
+   };
+
+   struct complete_hit_call {
+      const ray& r;
+      hit_record& rec;
+      template <class T>
+      bool operator()(const T& object) const { object.T::complete_hit(r, rec); return true; }
+      bool operator()(const hittable& object) const { object.complete_hit(r, rec); return true; }
+   };
+
+   struct occluded_call {
+      const ray& r;
+      float t_min;
+      float t_max;
+      template <class T>
+      bool operator()(const T& object) const { return object.T::occluded(r, t_min, t_max); }
+      bool operator()(const hittable& object) const { return object.occluded(r, t_min, t_max); }
+   };
+
+   std::tuple<std::vector<Ts>...> lists;
+   std::vector<const hittable*> sources[sizeof...(Ts)]; // the object of each copy
+   std::vector<const hittable*> others; // the objects of other classes
+};
+
+#endif